@@ -0,0 +1,110 @@
+// ----------------------------------------------------------------------------------
+// Arduino.h (native_shims)
+//
+// Just enough of the Arduino core, and of arduino-esp32 on top of it, for the
+// firmware's DSP and LED headers to build on a Linux machine. Only env:native in
+// platformio.ini ever sees this, the device build uses the real one.
+
+#pragma once
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+using std::min;
+using std::max;
+
+#define IRAM_ATTR
+#define PI ( 3.1415926535897932384626433832795 )
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+
+#define IDF_VER "native"
+
+#define LOW ( 0 )
+#define HIGH ( 1 )
+#define INPUT ( 0x01 )
+#define OUTPUT ( 0x03 )
+#define INPUT_PULLUP ( 0x05 )
+
+inline uint64_t native_elapsed_ns() {
+	static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+inline uint32_t micros() { return native_elapsed_ns() / 1000; }
+inline uint32_t millis() { return native_elapsed_ns() / 1000000; }
+inline void delay(uint32_t ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+
+// There's no cycle counter worth trusting on a host that changes clocks and
+// cores under us, so this is a 1GHz CPU: one "cycle" is a nanosecond
+inline uint32_t getCpuFrequencyMhz() { return 1000; }
+
+struct native_esp_class {
+	uint32_t restart_count = 0;  // Nothing restarts here, tests can check that something asked to
+
+	uint32_t getCycleCount() { return uint32_t(native_elapsed_ns()); }
+	uint32_t getFreeHeap() { return 320 * 1024; }
+	void restart() { restart_count++; }
+};
+
+inline native_esp_class ESP;
+
+// Pins read back whatever was last written to them, INPUT_PULLUP ones start HIGH
+inline uint8_t native_pin_levels[64];
+
+inline void pinMode(uint8_t pin, uint8_t mode) {
+	if (mode == INPUT_PULLUP) { native_pin_levels[pin] = HIGH; }
+}
+
+inline void digitalWrite(uint8_t pin, uint8_t level) { native_pin_levels[pin] = level; }
+inline int digitalRead(uint8_t pin) { return native_pin_levels[pin]; }
+
+class String {
+	public:
+		String(const char* text = "") : text(text) {}
+		String(const std::string& text) : text(text) {}
+
+		const char* c_str() const { return text.c_str(); }
+		unsigned int length() const { return text.length(); }
+
+		void toCharArray(char* buffer, unsigned int buffer_size) const {
+			if (buffer_size == 0) { return; }
+			size_t length = min(text.length(), size_t(buffer_size - 1));
+			memcpy(buffer, text.c_str(), length);
+			buffer[length] = '\0';
+		}
+
+		bool operator==(const char* other) const { return text == other; }
+		String operator+(const String& other) const { return String(text + other.text); }
+
+	private:
+		std::string text;
+};
+
+struct native_serial_class {
+	void begin(uint32_t baud_rate) {}
+	void print(const char* message) { fputs(message, stdout); }
+	void println(const char* message = "") { puts(message); }
+	int printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+	void flush() { fflush(stdout); }
+};
+
+inline int native_serial_class::printf(const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+	int length = vprintf(format, args);
+	va_end(args);
+	return length;
+}
+
+inline native_serial_class Serial;
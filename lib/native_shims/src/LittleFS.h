@@ -0,0 +1,128 @@
+// ----------------------------------------------------------------------------------
+// LittleFS.h (native_shims)
+//
+// LittleFS as a directory on the host, NATIVE_LITTLEFS_ROOT stands in for the
+// root of the partition. Only what the firmware uses from FS.h is here.
+
+#pragma once
+
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <memory>
+#include <string>
+
+#ifndef NATIVE_LITTLEFS_ROOT
+#define NATIVE_LITTLEFS_ROOT "/tmp/emotiscope_littlefs"
+#endif
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+struct native_file_handle {
+	FILE* file = NULL;
+	DIR* dir = NULL;
+	std::string path;  // On the host
+
+	~native_file_handle() {
+		if (file != NULL) { fclose(file); }
+		if (dir != NULL) { closedir(dir); }
+	}
+};
+
+// Copies share one handle, like the device's File
+class File {
+	public:
+		File() {}
+		File(std::shared_ptr<native_file_handle> handle) : handle(handle) {}
+
+		operator bool() const { return handle != NULL && (handle->file != NULL || handle->dir != NULL); }
+
+		size_t write(uint8_t byte) { return write(&byte, 1); }
+		size_t write(const uint8_t* buffer, size_t length) {
+			if (handle == NULL || handle->file == NULL) { return 0; }
+			return fwrite(buffer, 1, length, handle->file);
+		}
+
+		int read() {
+			if (handle == NULL || handle->file == NULL) { return -1; }
+			int byte = fgetc(handle->file);
+			return (byte == EOF) ? -1 : byte;
+		}
+		size_t read(uint8_t* buffer, size_t length) {
+			if (handle == NULL || handle->file == NULL) { return 0; }
+			return fread(buffer, 1, length, handle->file);
+		}
+
+		size_t size() {
+			if (handle == NULL) { return 0; }
+			if (handle->file != NULL) { fflush(handle->file); }
+
+			struct stat file_stat;
+			if (stat(handle->path.c_str(), &file_stat) != 0) { return 0; }
+			return file_stat.st_size;
+		}
+
+		const char* name() {
+			if (handle == NULL) { return ""; }
+			const char* last_slash = strrchr(handle->path.c_str(), '/');
+			return (last_slash != NULL) ? last_slash + 1 : handle->path.c_str();
+		}
+
+		bool isDirectory() { return handle != NULL && handle->dir != NULL; }
+
+		File openNextFile() {
+			if (isDirectory() == false) { return File(); }
+
+			while (struct dirent* entry = readdir(handle->dir)) {
+				if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+					continue;
+				}
+				return open_host_path(handle->path + "/" + entry->d_name, FILE_READ);
+			}
+			return File();
+		}
+
+		void close() { handle = NULL; }
+
+		static File open_host_path(const std::string& path, const char* mode) {
+			std::shared_ptr<native_file_handle> handle = std::make_shared<native_file_handle>();
+			handle->path = path;
+
+			struct stat path_stat;
+			if (stat(path.c_str(), &path_stat) == 0 && S_ISDIR(path_stat.st_mode)) {
+				handle->dir = opendir(path.c_str());
+			}
+			else {
+				handle->file = fopen(path.c_str(), (strcmp(mode, FILE_READ) == 0) ? "rb" : (strcmp(mode, FILE_APPEND) == 0) ? "ab" : "wb");
+			}
+			return File(handle);
+		}
+
+	private:
+		std::shared_ptr<native_file_handle> handle;
+};
+
+struct native_littlefs_class {
+	bool begin(bool format_if_failed = false) {
+		::mkdir(NATIVE_LITTLEFS_ROOT, 0755);
+		struct stat root_stat;
+		return stat(NATIVE_LITTLEFS_ROOT, &root_stat) == 0 && S_ISDIR(root_stat.st_mode);
+	}
+
+	File open(const char* path, const char* mode = FILE_READ) { return File::open_host_path(host_path(path), mode); }
+
+	bool exists(const char* path) {
+		struct stat path_stat;
+		return stat(host_path(path).c_str(), &path_stat) == 0;
+	}
+
+	bool remove(const char* path) { return ::remove(host_path(path).c_str()) == 0; }
+	bool mkdir(const char* path) { return ::mkdir(host_path(path).c_str(), 0755) == 0; }
+
+	std::string host_path(const char* path) { return std::string(NATIVE_LITTLEFS_ROOT) + path; }
+};
+
+inline native_littlefs_class LittleFS;
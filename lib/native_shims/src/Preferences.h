@@ -0,0 +1,79 @@
+// ----------------------------------------------------------------------------------
+// Preferences.h (native_shims)
+//
+// NVS in RAM. Every Preferences object opened on the same namespace sees the same
+// keys for as long as the program runs, like they'd survive a reboot on the device
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+
+inline std::map<std::string, std::map<std::string, std::vector<uint8_t>>> native_nvs;
+
+class Preferences {
+	public:
+		bool begin(const char* name, bool read_only = false) {
+			keys = &native_nvs[name];
+			this->read_only = read_only;
+			return true;
+		}
+
+		void end() { keys = NULL; }
+
+		bool clear() {
+			if (keys == NULL || read_only) { return false; }
+			keys->clear();
+			return true;
+		}
+
+		bool remove(const char* key) {
+			if (keys == NULL || read_only) { return false; }
+			return keys->erase(key) > 0;
+		}
+
+		bool isKey(const char* key) { return keys != NULL && keys->count(key) > 0; }
+
+		size_t putFloat(const char* key, float value) { return put(key, &value, sizeof(value)); }
+		size_t putInt(const char* key, int32_t value) { return put(key, &value, sizeof(value)); }
+		size_t putUInt(const char* key, uint32_t value) { return put(key, &value, sizeof(value)); }
+		size_t putULong(const char* key, uint32_t value) { return put(key, &value, sizeof(value)); }
+		size_t putBool(const char* key, bool value) { return put(key, &value, sizeof(value)); }
+		size_t putBytes(const char* key, const void* value, size_t length) { return put(key, value, length); }
+
+		float getFloat(const char* key, float default_value = 0.0) { return get(key, default_value); }
+		int32_t getInt(const char* key, int32_t default_value = 0) { return get(key, default_value); }
+		uint32_t getUInt(const char* key, uint32_t default_value = 0) { return get(key, default_value); }
+		uint32_t getULong(const char* key, uint32_t default_value = 0) { return get(key, default_value); }
+		bool getBool(const char* key, bool default_value = false) { return get(key, default_value); }
+
+		size_t getBytes(const char* key, void* buffer, size_t max_length) {
+			if (isKey(key) == false) { return 0; }
+			std::vector<uint8_t>& value = (*keys)[key];
+			if (value.size() > max_length) { return 0; }
+			memcpy(buffer, value.data(), value.size());
+			return value.size();
+		}
+
+	private:
+		std::map<std::string, std::vector<uint8_t>>* keys = NULL;
+		bool read_only = false;
+
+		size_t put(const char* key, const void* value, size_t length) {
+			if (keys == NULL || read_only) { return 0; }
+			const uint8_t* bytes = (const uint8_t*)value;
+			(*keys)[key].assign(bytes, bytes + length);
+			return length;
+		}
+
+		template <typename T>
+		T get(const char* key, T default_value) {
+			if (isKey(key) == false || (*keys)[key].size() != sizeof(T)) { return default_value; }
+			T value;
+			memcpy(&value, (*keys)[key].data(), sizeof(T));
+			return value;
+		}
+};
@@ -0,0 +1,21 @@
+// ----------------------------------------------------------------------------------
+// PsychicHttp.h (native_shims)
+//
+// No network here. Messages sent to every websocket client (broadcast() in
+// utilities.h) are counted and the last one is kept, so tests can check them
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+class PsychicWebSocketHandler {
+	public:
+		char last_message[256] = { 0 };
+		uint32_t messages_sent = 0;
+
+		void sendAll(const char* message) {
+			strncpy(last_message, message, sizeof(last_message) - 1);
+			messages_sent++;
+		}
+};
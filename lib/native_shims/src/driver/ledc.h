@@ -0,0 +1,46 @@
+// ----------------------------------------------------------------------------------
+// driver/ledc.h (native_shims)
+//
+// The indicator light's PWM, the last duty cycle set is kept in native_ledc_duty
+
+#pragma once
+
+#include <stdint.h>
+#include "../esp_err.h"
+
+typedef enum { LEDC_LOW_SPEED_MODE = 0 } ledc_mode_t;
+typedef enum { LEDC_TIMER_0 = 0 } ledc_timer_t;
+typedef enum { LEDC_CHANNEL_0 = 0 } ledc_channel_t;
+typedef enum { LEDC_TIMER_13_BIT = 13 } ledc_timer_bit_t;
+typedef enum { LEDC_AUTO_CLK = 0 } ledc_clk_cfg_t;
+typedef enum { LEDC_INTR_DISABLE = 0 } ledc_intr_type_t;
+
+typedef struct {
+	ledc_mode_t speed_mode;
+	ledc_timer_bit_t duty_resolution;
+	ledc_timer_t timer_num;
+	uint32_t freq_hz;
+	ledc_clk_cfg_t clk_cfg;
+} ledc_timer_config_t;
+
+typedef struct {
+	int gpio_num;
+	ledc_mode_t speed_mode;
+	ledc_channel_t channel;
+	ledc_intr_type_t intr_type;
+	ledc_timer_t timer_sel;
+	uint32_t duty;
+	int hpoint;
+} ledc_channel_config_t;
+
+inline uint32_t native_ledc_duty = 0;
+
+inline esp_err_t ledc_timer_config(const ledc_timer_config_t* timer_conf) { return ESP_OK; }
+inline esp_err_t ledc_channel_config(const ledc_channel_config_t* ledc_conf) { return ESP_OK; }
+
+inline esp_err_t ledc_set_duty(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t duty) {
+	native_ledc_duty = duty;
+	return ESP_OK;
+}
+
+inline esp_err_t ledc_update_duty(ledc_mode_t speed_mode, ledc_channel_t channel) { return ESP_OK; }
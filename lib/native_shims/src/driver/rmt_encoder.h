@@ -0,0 +1,118 @@
+// ----------------------------------------------------------------------------------
+// driver/rmt_encoder.h (native_shims)
+//
+// The RMT types led_driver.h is written against. Nothing here drives a pin.
+// A channel is a buffer that encoders write symbols into, mem_block_symbols
+// at a time like the hardware's memory block, so an encoder goes through the
+// same MEM_FULL / COMPLETE steps it would on the device. What the last
+// transmission sent is left in the channel for tests to look at.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "../esp_err.h"
+
+#ifndef __containerof
+#define __containerof(ptr, type, member) ((type*)((char*)(ptr) - offsetof(type, member)))
+#endif
+
+typedef union {
+	struct {
+		uint16_t duration0 : 15;
+		uint16_t level0 : 1;
+		uint16_t duration1 : 15;
+		uint16_t level1 : 1;
+	};
+	uint32_t val;
+} rmt_symbol_word_t;
+
+typedef struct {
+	size_t num_symbols;
+} rmt_tx_done_event_data_t;
+
+typedef struct rmt_channel_t* rmt_channel_handle_t;
+typedef bool (*rmt_tx_done_callback_t)(rmt_channel_handle_t tx_chan, const rmt_tx_done_event_data_t* edata, void* user_ctx);
+
+struct rmt_channel_t {
+	size_t mem_block_symbols;
+	size_t mem_block_used;  // Symbols written since the block was last drained
+	std::vector<rmt_symbol_word_t> symbols;  // Everything the last transmission sent
+	uint32_t transmissions;
+	rmt_tx_done_callback_t on_trans_done;
+	void* user_ctx;
+};
+
+typedef enum {
+	RMT_ENCODING_RESET = 0,
+	RMT_ENCODING_COMPLETE = (1 << 0),
+	RMT_ENCODING_MEM_FULL = (1 << 1),
+} rmt_encode_state_t;
+
+typedef struct rmt_encoder_t rmt_encoder_t;
+typedef rmt_encoder_t* rmt_encoder_handle_t;
+
+struct rmt_encoder_t {
+	size_t (*encode)(rmt_encoder_t* encoder, rmt_channel_handle_t tx_channel, const void* primary_data, size_t data_size, rmt_encode_state_t* ret_state);
+	esp_err_t (*reset)(rmt_encoder_t* encoder);
+	esp_err_t (*del)(rmt_encoder_t* encoder);
+};
+
+typedef struct {
+} rmt_copy_encoder_config_t;
+
+struct native_copy_encoder {
+	rmt_encoder_t base;
+	size_t symbols_copied;  // Of the current data, resumed after MEM_FULL
+};
+
+inline size_t native_copy_encode(rmt_encoder_t* encoder, rmt_channel_handle_t channel, const void* primary_data, size_t data_size, rmt_encode_state_t* ret_state) {
+	native_copy_encoder* copy_encoder = __containerof(encoder, native_copy_encoder, base);
+	const rmt_symbol_word_t* data = (const rmt_symbol_word_t*)primary_data;
+	size_t total_symbols = data_size / sizeof(rmt_symbol_word_t);
+
+	size_t encoded_symbols = 0;
+	while (copy_encoder->symbols_copied < total_symbols && channel->mem_block_used < channel->mem_block_symbols) {
+		channel->symbols.push_back(data[copy_encoder->symbols_copied]);
+		copy_encoder->symbols_copied++;
+		channel->mem_block_used++;
+		encoded_symbols++;
+	}
+
+	uint32_t state = RMT_ENCODING_RESET;
+	if (copy_encoder->symbols_copied == total_symbols) {
+		copy_encoder->symbols_copied = 0;
+		state |= RMT_ENCODING_COMPLETE;
+	}
+	if (channel->mem_block_used == channel->mem_block_symbols) {
+		state |= RMT_ENCODING_MEM_FULL;
+	}
+
+	*ret_state = (rmt_encode_state_t)state;
+	return encoded_symbols;
+}
+
+inline esp_err_t native_copy_encoder_reset(rmt_encoder_t* encoder) {
+	__containerof(encoder, native_copy_encoder, base)->symbols_copied = 0;
+	return ESP_OK;
+}
+
+inline esp_err_t native_copy_encoder_del(rmt_encoder_t* encoder) {
+	delete __containerof(encoder, native_copy_encoder, base);
+	return ESP_OK;
+}
+
+inline esp_err_t rmt_new_copy_encoder(const rmt_copy_encoder_config_t* config, rmt_encoder_handle_t* ret_encoder) {
+	native_copy_encoder* copy_encoder = new native_copy_encoder;
+	copy_encoder->base.encode = native_copy_encode;
+	copy_encoder->base.reset = native_copy_encoder_reset;
+	copy_encoder->base.del = native_copy_encoder_del;
+	copy_encoder->symbols_copied = 0;
+
+	*ret_encoder = &copy_encoder->base;
+	return ESP_OK;
+}
+
+inline esp_err_t rmt_encoder_reset(rmt_encoder_handle_t encoder) { return encoder->reset(encoder); }
+inline esp_err_t rmt_del_encoder(rmt_encoder_handle_t encoder) { return encoder->del(encoder); }
@@ -0,0 +1,88 @@
+// ----------------------------------------------------------------------------------
+// driver/rmt_tx.h (native_shims)
+
+#pragma once
+
+#include "rmt_encoder.h"
+
+typedef int gpio_num_t;
+
+typedef enum {
+	RMT_CLK_SRC_DEFAULT = 0,
+} rmt_clock_source_t;
+
+typedef struct {
+	gpio_num_t gpio_num;
+	rmt_clock_source_t clk_src;
+	uint32_t resolution_hz;
+	size_t mem_block_symbols;
+	size_t trans_queue_depth;
+	int intr_priority;
+	struct {
+		uint32_t invert_out : 1;
+		uint32_t with_dma : 1;
+	} flags;
+} rmt_tx_channel_config_t;
+
+typedef struct {
+	int loop_count;
+	struct {
+		uint32_t eot_level : 1;
+		uint32_t queue_nonblocking : 1;
+	} flags;
+} rmt_transmit_config_t;
+
+typedef struct {
+	rmt_tx_done_callback_t on_trans_done;
+} rmt_tx_event_callbacks_t;
+
+inline esp_err_t rmt_new_tx_channel(const rmt_tx_channel_config_t* config, rmt_channel_handle_t* ret_chan) {
+	rmt_channel_t* channel = new rmt_channel_t;
+	channel->mem_block_symbols = config->mem_block_symbols;
+	channel->mem_block_used = 0;
+	channel->transmissions = 0;
+	channel->on_trans_done = NULL;
+	channel->user_ctx = NULL;
+
+	*ret_chan = channel;
+	return ESP_OK;
+}
+
+inline esp_err_t rmt_tx_register_event_callbacks(rmt_channel_handle_t tx_channel, const rmt_tx_event_callbacks_t* cbs, void* user_data) {
+	tx_channel->on_trans_done = cbs->on_trans_done;
+	tx_channel->user_ctx = user_data;
+	return ESP_OK;
+}
+
+inline esp_err_t rmt_enable(rmt_channel_handle_t channel) { return ESP_OK; }
+
+// Runs the encoder to completion, draining the memory block whenever it
+// fills, then reports the transmission done like the TX interrupt would
+inline esp_err_t rmt_transmit(rmt_channel_handle_t tx_channel, rmt_encoder_handle_t encoder, const void* payload, size_t payload_bytes, const rmt_transmit_config_t* config) {
+	tx_channel->symbols.clear();
+	tx_channel->mem_block_used = 0;
+
+	while (true) {
+		rmt_encode_state_t state = RMT_ENCODING_RESET;
+		size_t encoded_symbols = encoder->encode(encoder, tx_channel, payload, payload_bytes, &state);
+		if (state & RMT_ENCODING_COMPLETE) {
+			break;
+		}
+		if (state & RMT_ENCODING_MEM_FULL) {
+			tx_channel->mem_block_used = 0;
+		}
+		else if (encoded_symbols == 0) {
+			return ESP_FAIL;  // Neither done nor waiting for room, it would hang on the device
+		}
+	}
+
+	tx_channel->transmissions++;
+	if (tx_channel->on_trans_done != NULL) {
+		rmt_tx_done_event_data_t event = { tx_channel->symbols.size() };
+		tx_channel->on_trans_done(tx_channel, &event, tx_channel->user_ctx);
+	}
+
+	return ESP_OK;
+}
+
+inline esp_err_t rmt_tx_wait_all_done(rmt_channel_handle_t tx_channel, int timeout_ms) { return ESP_OK; }
@@ -0,0 +1,28 @@
+// ----------------------------------------------------------------------------------
+// driver/touch_pad.h (native_shims)
+//
+// Touch pads that are never touched, unless a test sets native_touch_values[]
+
+#pragma once
+
+#include <stdint.h>
+#include "../esp_err.h"
+
+typedef int touch_pad_t;
+
+typedef enum {
+	TOUCH_FSM_MODE_TIMER = 0,
+	TOUCH_FSM_MODE_SW,
+} touch_fsm_mode_t;
+
+inline uint32_t native_touch_values[15];
+
+inline esp_err_t touch_pad_init() { return ESP_OK; }
+inline esp_err_t touch_pad_config(touch_pad_t touch_num) { return ESP_OK; }
+inline esp_err_t touch_pad_set_fsm_mode(touch_fsm_mode_t mode) { return ESP_OK; }
+inline esp_err_t touch_pad_fsm_start() { return ESP_OK; }
+
+inline esp_err_t touch_pad_read_raw_data(touch_pad_t touch_num, uint32_t* raw_data) {
+	*raw_data = native_touch_values[touch_num];
+	return ESP_OK;
+}
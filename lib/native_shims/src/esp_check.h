@@ -0,0 +1,6 @@
+// ----------------------------------------------------------------------------------
+// esp_check.h (native_shims)
+
+#pragma once
+
+#include "esp_err.h"
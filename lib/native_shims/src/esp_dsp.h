@@ -0,0 +1,125 @@
+// ----------------------------------------------------------------------------------
+// esp_dsp.h (native_shims)
+//
+// Plain C versions of the esp-dsp functions the firmware calls, following the
+// library's own *_ansi code, so results match the device to within float rounding.
+// On the device some of these are hand-written Xtensa assembly (the _ae32 ones),
+// here they're all the scalar path.
+
+#pragma once
+
+#include <math.h>
+#include "esp_err.h"
+
+inline esp_err_t dsps_mulc_f32(const float* input, float* output, int len, float C, int step_in, int step_out) {
+	for (int i = 0; i < len; i++) {
+		output[i * step_out] = input[i * step_in] * C;
+	}
+	return ESP_OK;
+}
+
+inline esp_err_t dsps_mulc_f32_ae32(const float* input, float* output, int len, float C, int step_in, int step_out) {
+	return dsps_mulc_f32(input, output, len, C, step_in, step_out);
+}
+
+inline esp_err_t dsps_add_f32(const float* input1, const float* input2, float* output, int len, int step1, int step2, int step_out) {
+	for (int i = 0; i < len; i++) {
+		output[i * step_out] = input1[i * step1] + input2[i * step2];
+	}
+	return ESP_OK;
+}
+
+inline float dsps_sqrtf_f32_ansi(float input) {
+	return sqrtf(input);
+}
+
+inline esp_err_t dsps_sqrt_f32_ansi(const float* input, float* output, int len) {
+	for (int i = 0; i < len; i++) {
+		output[i] = sqrtf(input[i]);
+	}
+	return ESP_OK;
+}
+
+// Swaps the complex values of an interleaved re/im array into bit-reversed order
+inline esp_err_t dsps_bit_rev_fc32(float* data, int N) {
+	int j = 0;
+	for (int i = 1; i < (N - 1); i++) {
+		int k = N >> 1;
+		while (k <= j) {
+			j -= k;
+			k >>= 1;
+		}
+		j += k;
+
+		if (i < j) {
+			float re = data[j * 2];
+			float im = data[j * 2 + 1];
+			data[j * 2] = data[i * 2];
+			data[j * 2 + 1] = data[i * 2 + 1];
+			data[i * 2] = re;
+			data[i * 2 + 1] = im;
+		}
+	}
+	return ESP_OK;
+}
+
+// Twiddle factors for the largest FFT asked for so far, in bit-reversed order like esp-dsp's
+inline float* dsps_fft_w_table_fc32 = NULL;
+inline int dsps_fft_w_table_size = 0;
+
+inline esp_err_t dsps_fft2r_init_fc32(float* fft_table_buff, int table_size) {
+	if (dsps_fft_w_table_fc32 != NULL) {
+		free(dsps_fft_w_table_fc32);
+	}
+
+	// Like esp-dsp we don't keep fft_table_buff, pass NULL and the table is ours
+	dsps_fft_w_table_fc32 = (float*)malloc(sizeof(float) * table_size);
+	dsps_fft_w_table_size = table_size;
+
+	float e = M_PI * 2.0 / table_size;
+	for (int i = 0; i < (table_size >> 1); i++) {
+		dsps_fft_w_table_fc32[2 * i] = cosf(i * e);
+		dsps_fft_w_table_fc32[2 * i + 1] = sinf(i * e);
+	}
+	dsps_bit_rev_fc32(dsps_fft_w_table_fc32, table_size >> 1);
+
+	return ESP_OK;
+}
+
+inline void dsps_fft2r_deinit_fc32() {
+	free(dsps_fft_w_table_fc32);
+	dsps_fft_w_table_fc32 = NULL;
+	dsps_fft_w_table_size = 0;
+}
+
+// In-place radix-2 complex FFT of N interleaved re/im values, the output is in
+// bit-reversed order until dsps_bit_rev_fc32() is run on it
+inline esp_err_t dsps_fft2r_fc32(float* data, int N) {
+	if (dsps_fft_w_table_fc32 == NULL || N > dsps_fft_w_table_size) {
+		return ESP_FAIL;
+	}
+
+	const float* w = dsps_fft_w_table_fc32;
+	int ie = 1;
+	for (int N2 = N / 2; N2 > 0; N2 >>= 1) {
+		int ia = 0;
+		for (int j = 0; j < ie; j++) {
+			float c = w[2 * j];
+			float s = w[2 * j + 1];
+			for (int i = 0; i < N2; i++) {
+				int m = ia + N2;
+				float re_temp = c * data[2 * m] + s * data[2 * m + 1];
+				float im_temp = c * data[2 * m + 1] - s * data[2 * m];
+				data[2 * m] = data[2 * ia] - re_temp;
+				data[2 * m + 1] = data[2 * ia + 1] - im_temp;
+				data[2 * ia] = data[2 * ia] + re_temp;
+				data[2 * ia + 1] = data[2 * ia + 1] + im_temp;
+				ia++;
+			}
+			ia += N2;
+		}
+		ie <<= 1;
+	}
+
+	return ESP_OK;
+}
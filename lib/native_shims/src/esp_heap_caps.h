@@ -0,0 +1,18 @@
+// ----------------------------------------------------------------------------------
+// esp_heap_caps.h (native_shims)
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define MALLOC_CAP_8BIT ( 1 << 2 )
+#define MALLOC_CAP_INTERNAL ( 1 << 11 )
+#define MALLOC_CAP_SPIRAM ( 1 << 10 )
+
+inline void* heap_caps_malloc(size_t size, uint32_t caps) { return malloc(size); }
+inline void* heap_caps_aligned_alloc(size_t alignment, size_t size, uint32_t caps) {
+	void* ptr = NULL;
+	return (posix_memalign(&ptr, alignment, size) == 0) ? ptr : NULL;
+}
+inline void heap_caps_free(void* ptr) { free(ptr); }
@@ -0,0 +1,11 @@
+// ----------------------------------------------------------------------------------
+// esp_log.h (native_shims)
+
+#pragma once
+
+#include <stdio.h>
+
+#define ESP_LOGE(tag, format, ...) printf("E %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) printf("W %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) printf("I %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) do { } while (0)
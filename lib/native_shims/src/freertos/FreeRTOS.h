@@ -0,0 +1,27 @@
+// ----------------------------------------------------------------------------------
+// freertos/FreeRTOS.h (native_shims)
+//
+// One task on one core. Critical sections are a real lock, in case a host
+// program ever runs the firmware from more than one thread.
+
+#pragma once
+
+#include <stdint.h>
+#include <mutex>
+
+typedef int32_t BaseType_t;
+typedef uint32_t UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void* TaskHandle_t;
+
+#define pdTRUE ( 1 )
+#define pdFALSE ( 0 )
+#define pdPASS ( pdTRUE )
+#define portMAX_DELAY ( (TickType_t)0xFFFFFFFF )
+#define portTICK_PERIOD_MS ( 1 )
+#define pdMS_TO_TICKS(ms) ( (TickType_t)(ms) )
+
+typedef std::recursive_mutex portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {}
+#define portENTER_CRITICAL(mux) (mux)->lock()
+#define portEXIT_CRITICAL(mux) (mux)->unlock()
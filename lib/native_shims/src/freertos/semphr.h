@@ -0,0 +1,64 @@
+// ----------------------------------------------------------------------------------
+// freertos/semphr.h (native_shims)
+//
+// Counting semaphores only. "FromISR" is the same as the task version, the
+// RMT shim calls it from whatever thread transmitted.
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include "FreeRTOS.h"
+
+struct native_semaphore {
+	std::mutex lock;
+	std::condition_variable available;
+	UBaseType_t count;
+	UBaseType_t max_count;
+};
+
+typedef native_semaphore* SemaphoreHandle_t;
+
+inline SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count) {
+	native_semaphore* semaphore = new native_semaphore;
+	semaphore->count = initial_count;
+	semaphore->max_count = max_count;
+	return semaphore;
+}
+
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+	std::unique_lock<std::mutex> guard(semaphore->lock);
+	auto has_count = [&]() { return semaphore->count > 0; };
+	if (ticks == portMAX_DELAY) {
+		semaphore->available.wait(guard, has_count);
+	}
+	else if (semaphore->available.wait_for(guard, std::chrono::milliseconds(ticks * portTICK_PERIOD_MS), has_count) == false) {
+		return pdFALSE;
+	}
+
+	semaphore->count--;
+	return pdTRUE;
+}
+
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+	std::lock_guard<std::mutex> guard(semaphore->lock);
+	if (semaphore->count >= semaphore->max_count) {
+		return pdFALSE;
+	}
+
+	semaphore->count++;
+	semaphore->available.notify_one();
+	return pdTRUE;
+}
+
+inline BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t* higher_priority_task_woken) {
+	if (higher_priority_task_woken != NULL) {
+		*higher_priority_task_woken = pdFALSE;
+	}
+	return xSemaphoreGive(semaphore);
+}
+
+inline UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t semaphore) {
+	std::lock_guard<std::mutex> guard(semaphore->lock);
+	return semaphore->count;
+}
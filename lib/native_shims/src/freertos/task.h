@@ -0,0 +1,20 @@
+// ----------------------------------------------------------------------------------
+// freertos/task.h (native_shims)
+
+#pragma once
+
+#include <chrono>
+#include <thread>
+#include "FreeRTOS.h"
+
+inline BaseType_t xPortGetCoreID() { return 0; }
+
+// Every host thread gets its own handle, so traces still show one row per thread
+inline TaskHandle_t xTaskGetCurrentTaskHandle() {
+	static thread_local char task_tag;
+	return &task_tag;
+}
+
+inline const char* pcTaskGetName(TaskHandle_t task) { return "native"; }
+
+inline void vTaskDelay(TickType_t ticks) { std::this_thread::sleep_for(std::chrono::milliseconds(ticks)); }
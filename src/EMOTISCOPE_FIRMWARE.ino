@@ -35,24 +35,31 @@
 #include "global_defines.h" // ..... Compile-time configuration
 #include "hardware_version.h" // ... Baked into the PCB are 4 pins that define the hardware version in binary
 #include "types.h" // .............. typedefs for things like CRGBFs
+#include "trace.h" // .............. Records both cores' timelines for chrome://tracing
 #include "profiler.h" // ........... Developer tools, measures the execution of functions
+#include "stage_histograms.h" // ... Latency histograms of every stage of the CPU and GPU loops
 #include "sliders.h" // ............ Handles sliders that appear in the web app
 #include "toggles.h" // ............ Handles toggles that appear in the web app
 #include "menu_toggles.h" // ....... Toggles that appear in the main menu
 #include "filesystem.h" // ......... LittleFS functions
 #include "configuration.h" // ...... Storing and retreiving your settings
 #include "utilities.h" // .......... Custom generic math functions
+#include "constexpr_math.h" // ..... Math the compiler can run, for baking DSP tables into flash
 #include "system.h" // ............. Lowest-level firmware functions
 #include "led_driver.h" // ......... Low-level LED communication, (ab)uses RMT for non-blocking output
 #include "leds.h" // ............... LED dithering, effects, filters
 #include "touch.h" // .............. Handles capacitive touch input
 #include "indicator.h" // .......... Little light bulb
 #include "ui.h" // ................. Draws UI elements to the LEDs like indicator needles
+#include "goertzel.h" // ........... GDFT or God Damn Fast Transform is implemented here
+#include "audio_source.h" // ....... Pluggable audio input: microphone, WAV file or test signals
 #include "microphone.h" // ......... For gathering audio chunks from the microphone
+#include "analysis.h" // ........... Hands each audio frame's results to the GPU core in one piece
 #include "vu.h" // ................. Tracks music loudness from moment to moment
-#include "goertzel.h" // ........... GDFT or God Damn Fast Transform is implemented here
 #include "tempo.h" // .............. Comupation of (and syncronization) to the music tempo
 #include "audio_debug.h" // ........ Print audio data over UART
+#include "kernel_benchmarks.h" // ... Hot kernels timed one at a time, esp-dsp vs. scalar
+#include "benchmarks.h" // ......... Cycle counts of old vs. new DSP code, printed at boot
 #include "screensaver.h" // ........ Colorful dots play on screen when no audio is present
 #include "standby.h" // ............ Handles sleep/wake + animations
 #include "lightshow_modes.h" // .... Definition and handling of lightshow modes
@@ -71,10 +78,16 @@
 // ############################################################################
 // ## CODE ####################################################################
 
-// One core to run audio and web server ---------------------------------------
+// One core to run audio, and the web server whenever audio is waiting -------
 void loop() {
 	run_cpu(); // (cpu_core.h)
-	run_web(); // (web_core.h)	
+}
+
+void loop_web(void *param) {
+	for (;;) {
+		run_web(); // (web_core.h)
+		vTaskDelay(1);
+	}
 }
 
 // One core to run graphics ---------------------------------------------------
@@ -89,6 +102,10 @@ void setup() {
 	// (system.h) Initialize all peripherals
 	init_system();
 
-	// Start the second core as a dedicated webserver
+	// Start the second core as a dedicated graphics processor
 	(void)xTaskCreatePinnedToCore(loop_gpu, "loop_gpu", 8192, NULL, 0, NULL, 0);
+
+	// Web server and flash writes share the audio core, but never get ahead of it
+	vTaskPrioritySet(NULL, CPU_TASK_PRIORITY);
+	(void)xTaskCreatePinnedToCore(loop_web, "loop_web", 8192, NULL, WEB_TASK_PRIORITY, NULL, 1);
 }
\ No newline at end of file
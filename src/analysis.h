@@ -0,0 +1,78 @@
+// ----------------------------------------------------------------------------------
+// analysis.h
+//
+// How the audio analysis gets from the CPU core to the GPU core. The CPU core
+// (cpu_core.h) writes spectrogram_smooth, chromagram, tempi[] and friends in place
+// while it works, so the GPU core never reads those. Instead, once per audio frame
+// run_cpu() copies what the lightshow needs into an analysis_snapshot (types.h)
+// and publishes it, and once per video frame run_gpu() takes the newest one.
+//
+// It's a triple buffer: the CPU core fills the back buffer and swaps it with the
+// middle one, the GPU core swaps the middle one with its front buffer when there's
+// something new in it. Each side only ever touches its own buffer, the swaps are a
+// single atomic exchange, so neither core waits on the other and the GPU core always
+// sees one whole audio frame, never half of two.
+
+#include <atomic>
+
+#define ANALYSIS_SNAPSHOT_FRESH ( 4 ) // Flag next to the middle buffer's index, set until the GPU core takes it
+
+static_assert(ANALYSIS_WAVEFORM_LENGTH >= NUM_LEDS + CHUNK_SIZE + 1, "The waveform modes need more samples than this");
+
+analysis_snapshot analysis_snapshots[3];
+uint8_t analysis_snapshot_back = 0;                  // Only touched by the CPU core
+std::atomic<uint32_t> analysis_snapshot_middle(1);   // Index | ANALYSIS_SNAPSHOT_FRESH
+uint8_t analysis_snapshot_front = 2;                 // Only touched by the GPU core
+uint32_t analysis_frames_published = 0;
+
+// What the GPU core reads this frame, and whether it's a new audio frame since the last one
+const analysis_snapshot* analysis = &analysis_snapshots[2];
+bool analysis_is_new = false;
+
+// CPU core, after the audio frame has been analyzed
+void publish_analysis_snapshot() {
+	extern tempo tempi[NUM_TEMPI];
+	extern volatile float vu_level;
+	extern volatile uint32_t tempo_phase_measurements;
+
+	profile_function([&]() {
+		analysis_snapshot* snapshot = &analysis_snapshots[analysis_snapshot_back];
+
+		analysis_frames_published++;
+		snapshot->frame = analysis_frames_published;
+
+		memcpy(snapshot->spectrogram, spectrogram, sizeof(float) * NUM_FREQS);
+		memcpy(snapshot->spectrogram_smooth, spectrogram_smooth, sizeof(float) * NUM_FREQS);
+		memcpy(snapshot->chromagram, chromagram, sizeof(float) * 12);
+		snapshot->vu_level = vu_level;
+		memcpy(snapshot->waveform, &sample_history[SAMPLE_HISTORY_LENGTH - ANALYSIS_WAVEFORM_LENGTH], sizeof(float) * ANALYSIS_WAVEFORM_LENGTH);
+
+		for (uint16_t i = 0; i < NUM_TEMPI; i++) {
+			snapshot->tempi_magnitude[i] = tempi[i].magnitude;
+			snapshot->tempi_phase_target[i] = tempi[i].phase_target;
+		}
+		snapshot->tempo_phase_measurements = tempo_phase_measurements;
+
+		snapshot->capture_us = sample_chunk_capture_us;
+		snapshot->publish_us = micros();
+
+		// Trade it for the middle buffer, which the GPU core either already has a copy of or skipped
+		analysis_snapshot_back = analysis_snapshot_middle.exchange(analysis_snapshot_back | ANALYSIS_SNAPSHOT_FRESH) & 3;
+	}, __func__ );
+}
+
+// GPU core, at the start of every frame. Returns false (and keeps the same
+// snapshot) if no audio frame was published since the last call
+bool acquire_analysis_snapshot() {
+	analysis_is_new = false;
+
+	if (analysis_snapshot_middle.load() & ANALYSIS_SNAPSHOT_FRESH) {
+		analysis_snapshot_front = analysis_snapshot_middle.exchange(analysis_snapshot_front) & 3;
+		analysis = &analysis_snapshots[analysis_snapshot_front];
+		analysis_is_new = true;
+
+		trace_instant(TRACE_ANALYSIS_ACQUIRED);  // (trace.h)
+	}
+
+	return analysis_is_new;
+}
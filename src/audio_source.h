@@ -0,0 +1,266 @@
+// ----------------------------------------------------------------------------------
+// audio_source.h
+//
+// Where audio chunks come from. The analysis chain (vu.h, goertzel.h, tempo.h)
+// only ever reads musical_analyzer's sample history, so any audio_source (see
+// types.h) can feed it:
+//
+// - "i2s"   The SPH0645 microphone (microphone.h), blocks until a chunk is ready
+// - "wav"   A 16-bit mono WAV file at SAMPLE_RATE, the same format the files in
+//           extras/audio_debugger/ use. Never blocks, runs faster than realtime
+// - "synth" Test tones, metronome clicks at a given BPM or white noise. Never blocks
+//
+// Only the I2S backend touches ESP-IDF, so the rest of this file also builds on Linux.
+
+#include <stdio.h>
+
+audio_source* active_audio_source = NULL;
+uint32_t sample_chunk_capture_us = 0; // When the newest chunk came out of the source, the start of its audio-to-photon latency
+
+void set_audio_source(audio_source* new_source) {
+	active_audio_source = new_source;
+	printf("AUDIO SOURCE: %s\n", new_source->name);
+}
+
+// ----------------------------------------------------------------------------------
+// WAV FILE BACKEND
+
+FILE* wav_file = NULL;
+uint32_t wav_data_start = 0;     // Byte offset of the first sample
+uint32_t wav_data_length = 0;    // In samples
+uint32_t wav_data_position = 0;  // In samples
+bool wav_loop = false;
+
+bool read_wav_chunk(float* new_samples, uint16_t num_samples) {
+	int16_t raw_samples[CHUNK_SIZE];
+	uint16_t samples_filled = 0;
+
+	while (samples_filled < num_samples) {
+		if (wav_file == NULL) {
+			break;
+		}
+
+		if (wav_data_position >= wav_data_length) {
+			if (wav_loop == false) {
+				break;
+			}
+
+			fseek(wav_file, wav_data_start, SEEK_SET);
+			wav_data_position = 0;
+		}
+
+		uint32_t samples_to_read = min(uint32_t(num_samples - samples_filled), wav_data_length - wav_data_position);
+		samples_to_read = min(samples_to_read, uint32_t(CHUNK_SIZE));
+
+		uint32_t samples_read = fread(raw_samples, sizeof(int16_t), samples_to_read, wav_file);
+		for (uint16_t i = 0; i < samples_read; i++) {
+			new_samples[samples_filled + i] = raw_samples[i] / 32768.0;
+		}
+
+		samples_filled += samples_read;
+		wav_data_position += samples_read;
+
+		if (samples_read < samples_to_read) {  // Truncated file
+			wav_data_length = wav_data_position;
+		}
+	}
+
+	// Pad with silence once the file is over
+	if (samples_filled < num_samples) {
+		memset(&new_samples[samples_filled], 0, sizeof(float) * (num_samples - samples_filled));
+		return false;
+	}
+
+	return true;
+}
+
+audio_source wav_audio_source = {"wav", read_wav_chunk};
+
+void close_wav_audio_source() {
+	if (wav_file != NULL) {
+		fclose(wav_file);
+		wav_file = NULL;
+	}
+}
+
+// Opens a RIFF/WAVE file of 16-bit mono PCM at SAMPLE_RATE and makes it the active source.
+// On the device, files in LittleFS are found under "/littlefs/"
+bool open_wav_audio_source(const char* path, bool loop) {
+	close_wav_audio_source();
+
+	wav_file = fopen(path, "rb");
+	if (wav_file == NULL) {
+		printf("WAV: Can't open %s\n", path);
+		return false;
+	}
+
+	char chunk_id[4];
+	uint32_t chunk_size;
+	char riff_format[4];
+	if (fread(chunk_id, 1, 4, wav_file) != 4 || memcmp(chunk_id, "RIFF", 4) != 0 ||
+		fread(&chunk_size, 4, 1, wav_file) != 1 ||
+		fread(riff_format, 1, 4, wav_file) != 4 || memcmp(riff_format, "WAVE", 4) != 0) {
+		printf("WAV: %s is not a RIFF/WAVE file\n", path);
+		close_wav_audio_source();
+		return false;
+	}
+
+	bool found_format = false;
+	while (fread(chunk_id, 1, 4, wav_file) == 4 && fread(&chunk_size, 4, 1, wav_file) == 1) {
+		if (memcmp(chunk_id, "fmt ", 4) == 0) {
+			uint16_t audio_format, num_channels, block_align, bits_per_sample;
+			uint32_t sample_rate, byte_rate;
+			if (chunk_size < 16 ||
+				fread(&audio_format, 2, 1, wav_file) != 1 ||
+				fread(&num_channels, 2, 1, wav_file) != 1 ||
+				fread(&sample_rate, 4, 1, wav_file) != 1 ||
+				fread(&byte_rate, 4, 1, wav_file) != 1 ||
+				fread(&block_align, 2, 1, wav_file) != 1 ||
+				fread(&bits_per_sample, 2, 1, wav_file) != 1) {
+				printf("WAV: %s has a truncated fmt chunk\n", path);
+				close_wav_audio_source();
+				return false;
+			}
+
+			if (audio_format != 1 || num_channels != 1 || bits_per_sample != 16) {
+				printf("WAV: %s must be 16-bit mono PCM (format %u, %u channels, %u bits)\n", path, audio_format, num_channels, bits_per_sample);
+				close_wav_audio_source();
+				return false;
+			}
+
+			if (sample_rate != SAMPLE_RATE) {
+				printf("WAV: %s is %luHz, expected %dHz\n", path, (unsigned long)sample_rate, SAMPLE_RATE);
+				close_wav_audio_source();
+				return false;
+			}
+
+			found_format = true;
+			fseek(wav_file, (chunk_size - 16) + (chunk_size & 1), SEEK_CUR);
+		}
+		else if (memcmp(chunk_id, "data", 4) == 0) {
+			if (found_format == false) {
+				break;
+			}
+
+			wav_data_start = ftell(wav_file);
+			wav_data_length = chunk_size / sizeof(int16_t);
+			wav_data_position = 0;
+			wav_loop = loop;
+
+			printf("WAV: Playing %s (%.2f seconds)\n", path, wav_data_length / float(SAMPLE_RATE));
+			set_audio_source(&wav_audio_source);
+			return true;
+		}
+		else {
+			// Skip chunks we don't care about (LIST, fact, ...), they're padded to even sizes
+			fseek(wav_file, chunk_size + (chunk_size & 1), SEEK_CUR);
+		}
+	}
+
+	printf("WAV: %s has no usable fmt/data chunks\n", path);
+	close_wav_audio_source();
+	return false;
+}
+
+// ----------------------------------------------------------------------------------
+// SYNTHETIC BACKEND
+
+synth_waveform synth_type = SYNTH_TONE;
+float synth_frequency_hz = 440.0;  // SYNTH_TONE pitch, also the pitch of SYNTH_CLICK bursts
+float synth_bpm = 120.0;           // SYNTH_CLICK rate
+float synth_amplitude = 0.5;
+uint32_t synth_sample_index = 0;
+uint32_t synth_noise_state = 0x12345678;  // Seeded so runs are repeatable
+
+bool read_synth_chunk(float* new_samples, uint16_t num_samples) {
+	const float click_length_samples = SAMPLE_RATE * 0.010;  // 10ms bursts
+	float samples_per_beat = (60.0 / synth_bpm) * SAMPLE_RATE;
+
+	for (uint16_t i = 0; i < num_samples; i++) {
+		float t = synth_sample_index / float(SAMPLE_RATE);
+		float sample = 0.0;
+
+		if (synth_type == SYNTH_TONE) {
+			sample = sin(2.0 * M_PI * synth_frequency_hz * t);
+		}
+		else if (synth_type == SYNTH_CLICK) {
+			float position_in_beat = fmod(float(synth_sample_index), samples_per_beat);
+			if (position_in_beat < click_length_samples) {
+				float envelope = 1.0 - (position_in_beat / click_length_samples);
+				sample = sin(2.0 * M_PI * synth_frequency_hz * (position_in_beat / SAMPLE_RATE)) * envelope * envelope;
+			}
+		}
+		else if (synth_type == SYNTH_NOISE) {
+			// xorshift32
+			synth_noise_state ^= synth_noise_state << 13;
+			synth_noise_state ^= synth_noise_state >> 17;
+			synth_noise_state ^= synth_noise_state << 5;
+			sample = (synth_noise_state / 2147483648.0) - 1.0;
+		}
+
+		new_samples[i] = sample * synth_amplitude;
+		synth_sample_index++;
+	}
+
+	return true;
+}
+
+audio_source synth_audio_source = {"synth", read_synth_chunk};
+
+void start_synth_audio_source(synth_waveform type, float frequency_hz, float bpm, float amplitude) {
+	synth_type = type;
+	synth_frequency_hz = frequency_hz;
+	synth_bpm = bpm;
+	synth_amplitude = amplitude;
+	synth_sample_index = 0;
+
+	set_audio_source(&synth_audio_source);
+}
+
+// ----------------------------------------------------------------------------------
+
+// Returns false if the active source has run out of audio (end of a WAV file)
+bool acquire_sample_chunk()
+{
+	bool source_has_audio = true;
+
+	profile_function([&]()
+					 {
+		float new_samples[CHUNK_SIZE];
+
+		// Read audio samples from the active source, but **only when emotiscope is active**
+		if( EMOTISCOPE_ACTIVE == true && active_audio_source != NULL ){
+			source_has_audio = active_audio_source->read_chunk(new_samples, CHUNK_SIZE);
+		}
+		else{
+			memset(new_samples, 0, sizeof(float) * CHUNK_SIZE);
+		}
+		sample_chunk_capture_us = micros();
+		trace_instant(TRACE_AUDIO_CHUNK);  // (trace.h)
+
+		// Add new chunk to audio history
+		musical_analyzer.write_to_sample_history(new_samples);
+
+		// If debug recording was triggered
+		if(audio_recording_live == true){
+			int16_t out_samples[CHUNK_SIZE];
+			for(uint16_t i = 0; i < CHUNK_SIZE; i += 4){
+				out_samples[i+0] = new_samples[i+0] * 32767;
+				out_samples[i+1] = new_samples[i+1] * 32767;
+				out_samples[i+2] = new_samples[i+2] * 32767;
+				out_samples[i+3] = new_samples[i+3] * 32767;
+			}
+			memcpy(&audio_debug_recording[audio_recording_index], out_samples, sizeof(int16_t)*CHUNK_SIZE);
+			audio_recording_index += CHUNK_SIZE;
+			if(audio_recording_index >= MAX_AUDIO_RECORDING_SAMPLES){
+				audio_recording_index = 0;
+				audio_recording_live = false;
+
+				extern void queue_web_job(web_job job);
+				queue_web_job(WEB_JOB_DEBUG_RECORDING_FINISHED);  // (web_core.h)
+			}
+		} },
+					 __func__);
+
+	return source_has_audio;
+}
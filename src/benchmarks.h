@@ -0,0 +1,704 @@
+// ----------------------------------------------------------------------------------
+// benchmarks.h
+//
+// Side-by-side cycle counts of the old and new implementations of hot DSP code,
+// printed over UART once at boot. Leave this disabled in production.
+
+// UNCOMMENT THIS TO ENABLE IT
+//#define BENCHMARKS_ENABLED  // Runs once at the end of init_system()
+
+#define BENCHMARK_ITERATIONS (256)  // Results are averaged over this many runs
+
+void print_benchmark_result(const char* name, uint32_t legacy_cycles, uint32_t new_cycles) {
+	int32_t saved_cycles = int32_t(legacy_cycles) - int32_t(new_cycles);
+	printf("%-32s | OLD: %7lu | NEW: %7lu | SAVED: %7li cycles/frame\n", name, (unsigned long)legacy_cycles, (unsigned long)new_cycles, (long)saved_cycles);
+}
+
+// The audio history used to be memmove()'d by CHUNK_SIZE on every audio frame,
+// now it's written to a mirrored ring buffer instead
+void benchmark_sample_history_write() {
+	static float legacy_history[SAMPLE_HISTORY_LENGTH];
+	float new_samples[CHUNK_SIZE];
+	for (uint16_t i = 0; i < CHUNK_SIZE; i++) {
+		new_samples[i] = sin(i * 0.1);
+	}
+
+	uint32_t t_start_cycles = ESP.getCycleCount();
+	for (uint16_t i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		shift_and_copy_arrays(legacy_history, SAMPLE_HISTORY_LENGTH, new_samples, CHUNK_SIZE);
+	}
+	uint32_t legacy_cycles = (ESP.getCycleCount() - t_start_cycles) / BENCHMARK_ITERATIONS;
+
+	t_start_cycles = ESP.getCycleCount();
+	for (uint16_t i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		musical_analyzer.write_to_sample_history(new_samples);
+	}
+	uint32_t new_cycles = (ESP.getCycleCount() - t_start_cycles) / BENCHMARK_ITERATIONS;
+
+	print_benchmark_result("sample_history write", legacy_cycles, new_cycles);
+
+	// Leave no trace in the real audio history
+	musical_analyzer.clear_sample_history();
+}
+
+// calculate_magnitudes() used to alternate between the odd and even bins on
+// every frame, now it computes all 64 bins every frame, GOERTZEL_LANES at a time
+void benchmark_goertzel() {
+	for (uint16_t i = 0; i < CHUNK_SIZE * 64; i += CHUNK_SIZE) {
+		float new_samples[CHUNK_SIZE];
+		for (uint16_t n = 0; n < CHUNK_SIZE; n++) {
+			new_samples[n] = sin((i + n) * 0.05) * 0.25 + sin((i + n) * 0.71) * 0.25;
+		}
+		musical_analyzer.write_to_sample_history(new_samples);
+	}
+
+	float legacy_magnitudes[NUM_FREQS];
+	float new_magnitudes[NUM_FREQS];
+
+	uint32_t t_start_cycles = ESP.getCycleCount();
+	for (uint16_t i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		for (uint16_t bin = (i % 2); bin < NUM_FREQS; bin += 2) {
+			legacy_magnitudes[bin] = musical_analyzer.calculate_magnitude_of_bin(bin);
+		}
+	}
+	uint32_t legacy_interlaced_cycles = (ESP.getCycleCount() - t_start_cycles) / BENCHMARK_ITERATIONS;
+
+	t_start_cycles = ESP.getCycleCount();
+	for (uint16_t i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		for (uint16_t bin = 0; bin < NUM_FREQS; bin++) {
+			legacy_magnitudes[bin] = musical_analyzer.calculate_magnitude_of_bin(bin);
+		}
+	}
+	uint32_t legacy_cycles = (ESP.getCycleCount() - t_start_cycles) / BENCHMARK_ITERATIONS;
+
+	t_start_cycles = ESP.getCycleCount();
+	for (uint16_t i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		for (uint16_t bin = 0; bin < NUM_FREQS; bin += GOERTZEL_LANES) {
+			musical_analyzer.calculate_magnitudes_of_bin_group(bin, &new_magnitudes[bin]);
+		}
+	}
+	uint32_t new_cycles = (ESP.getCycleCount() - t_start_cycles) / BENCHMARK_ITERATIONS;
+
+	float max_error = 0.0;
+	for (uint16_t bin = 0; bin < NUM_FREQS; bin++) {
+		max_error = max(max_error, fabsf(new_magnitudes[bin] - legacy_magnitudes[bin]) / max(legacy_magnitudes[bin], 0.000001f));
+	}
+
+	print_benchmark_result("goertzel, 32 interlaced vs 64", legacy_interlaced_cycles, new_cycles);
+	print_benchmark_result("goertzel, 64 bins", legacy_cycles, new_cycles);
+	printf("goertzel max relative error: %.6f\n", max_error);
+
+	musical_analyzer.clear_sample_history();
+}
+
+// Low bins can read the half/quarter rate histories instead of the full rate one
+void benchmark_goertzel_decimation() {
+	float magnitudes[NUM_FREQS];
+
+	musical_analyzer.decimation_enabled = false;
+	init_goertzel_constants_musical();
+
+	uint32_t t_start_cycles = ESP.getCycleCount();
+	for (uint16_t i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		for (uint16_t bin = 0; bin < NUM_FREQS; bin += GOERTZEL_LANES) {
+			musical_analyzer.calculate_magnitudes_of_bin_group(bin, &magnitudes[bin]);
+		}
+	}
+	uint32_t full_rate_cycles = (ESP.getCycleCount() - t_start_cycles) / BENCHMARK_ITERATIONS;
+
+	musical_analyzer.decimation_enabled = true;
+	init_goertzel_constants_musical();
+
+	t_start_cycles = ESP.getCycleCount();
+	for (uint16_t i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		for (uint16_t bin = 0; bin < NUM_FREQS; bin += GOERTZEL_LANES) {
+			musical_analyzer.calculate_magnitudes_of_bin_group(bin, &magnitudes[bin]);
+		}
+	}
+	uint32_t multi_rate_cycles = (ESP.getCycleCount() - t_start_cycles) / BENCHMARK_ITERATIONS;
+
+	// The decimation filters run once per chunk no matter how many bins use them
+	float new_samples[CHUNK_SIZE] = { 0.0 };
+	t_start_cycles = ESP.getCycleCount();
+	for (uint16_t i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		musical_analyzer.write_to_sample_history(new_samples);
+	}
+	uint32_t history_cycles = (ESP.getCycleCount() - t_start_cycles) / BENCHMARK_ITERATIONS;
+
+	print_benchmark_result("goertzel, full vs multi-rate", full_rate_cycles, multi_rate_cycles);
+	printf("sample_history write incl. decimation: %lu cycles/frame\n", history_cycles);
+
+	musical_analyzer.clear_sample_history();
+}
+
+// The sliding DFT engine costs the same for every bin, no matter the block size
+void benchmark_sliding_dft() {
+	float goertzel_magnitudes[NUM_FREQS];
+	float sliding_dft_magnitudes[NUM_FREQS];
+
+	uint32_t t_start_cycles = ESP.getCycleCount();
+	for (uint16_t i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		for (uint16_t bin = 0; bin < NUM_FREQS; bin += GOERTZEL_LANES) {
+			musical_analyzer.calculate_magnitudes_of_bin_group(bin, &goertzel_magnitudes[bin]);
+		}
+	}
+	uint32_t goertzel_cycles = (ESP.getCycleCount() - t_start_cycles) / BENCHMARK_ITERATIONS;
+
+	t_start_cycles = ESP.getCycleCount();
+	for (uint16_t i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		for (uint16_t bin = 0; bin < NUM_FREQS; bin++) {
+			sliding_dft_magnitudes[bin] = musical_analyzer.calculate_magnitude_of_bin_sliding_dft(bin);
+		}
+	}
+	uint32_t sliding_dft_cycles = (ESP.getCycleCount() - t_start_cycles) / BENCHMARK_ITERATIONS;
+
+	print_benchmark_result("goertzel vs. sliding dft", goertzel_cycles, sliding_dft_cycles);
+
+	// Sliding DFT state is only valid if it saw every chunk, start over
+	musical_analyzer.init_sliding_dft();
+}
+
+// One FFT + sparse kernels vs. the Goertzel, and how closely their output matches
+void benchmark_fft_constant_q() {
+	for (uint16_t i = 0; i < CHUNK_SIZE * 64; i += CHUNK_SIZE) {
+		float new_samples[CHUNK_SIZE];
+		for (uint16_t n = 0; n < CHUNK_SIZE; n++) {
+			new_samples[n] = sin((i + n) * 0.05) * 0.25 + sin((i + n) * 0.71) * 0.25;
+		}
+		musical_analyzer.write_to_sample_history(new_samples);
+	}
+
+	if (musical_analyzer.init_fft_constant_q() == false) {
+		return;
+	}
+
+	float goertzel_magnitudes[NUM_FREQS];
+	float fft_magnitudes[NUM_FREQS];
+
+	uint32_t t_start_cycles = ESP.getCycleCount();
+	for (uint16_t i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		for (uint16_t bin = 0; bin < NUM_FREQS; bin += GOERTZEL_LANES) {
+			musical_analyzer.calculate_magnitudes_of_bin_group(bin, &goertzel_magnitudes[bin]);
+		}
+	}
+	uint32_t goertzel_cycles = (ESP.getCycleCount() - t_start_cycles) / BENCHMARK_ITERATIONS;
+
+	t_start_cycles = ESP.getCycleCount();
+	for (uint16_t i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		musical_analyzer.calculate_magnitudes_fft_constant_q(fft_magnitudes);
+	}
+	uint32_t fft_cycles = (ESP.getCycleCount() - t_start_cycles) / BENCHMARK_ITERATIONS;
+
+	float error_sum = 0.0;
+	float reference_sum = 0.0;
+	for (uint16_t bin = 0; bin < NUM_FREQS; bin++) {
+		float error = fft_magnitudes[bin] - goertzel_magnitudes[bin];
+		error_sum += error * error;
+		reference_sum += goertzel_magnitudes[bin] * goertzel_magnitudes[bin];
+	}
+
+	print_benchmark_result("goertzel vs. fft constant-q", goertzel_cycles, fft_cycles);
+	printf("fft constant-q relative RMS error: %.4f (%u kernel values)\n", sqrt(error_sum / max(reference_sum, 0.000001f)), musical_analyzer.fft_constant_q->kernel_start[NUM_FREQS]);
+
+	if (musical_analyzer.engine != SPECTRAL_ENGINE_FFT_CONSTANT_Q) {
+		musical_analyzer.free_fft_constant_q();
+	}
+	musical_analyzer.clear_sample_history();
+}
+
+// The novelty and VU curves used to be shifted by one on every log, and the
+// novelty curve was rescanned for its max and rescaled on every frame
+void benchmark_novelty_history() {
+	static float legacy_novelty_curve[NOVELTY_HISTORY_LENGTH];
+	static float legacy_novelty_curve_normalized[NOVELTY_HISTORY_LENGTH];
+	static float legacy_vu_curve[NOVELTY_HISTORY_LENGTH];
+
+	uint32_t t_start_cycles = ESP.getCycleCount();
+	for (uint16_t i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		shift_array_left(legacy_novelty_curve, NOVELTY_HISTORY_LENGTH, 1);
+		legacy_novelty_curve[NOVELTY_HISTORY_LENGTH - 1] = i * 0.001;
+		shift_array_left(legacy_vu_curve, NOVELTY_HISTORY_LENGTH, 1);
+		legacy_vu_curve[NOVELTY_HISTORY_LENGTH - 1] = i * 0.001;
+
+		float max_val = 0.00001;
+		for (uint16_t n = 0; n < NOVELTY_HISTORY_LENGTH; n++) {
+			max_val = max(max_val, legacy_novelty_curve[n]);
+		}
+		dsps_mulc_f32(legacy_novelty_curve, legacy_novelty_curve_normalized, NOVELTY_HISTORY_LENGTH, 1.0 / max_val, 1, 1);
+	}
+	uint32_t legacy_cycles = (ESP.getCycleCount() - t_start_cycles) / BENCHMARK_ITERATIONS;
+
+	t_start_cycles = ESP.getCycleCount();
+	for (uint16_t i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		log_novelty(i * 0.001);
+		log_vu(i * 0.001);
+		normalize_novelty_curve();
+	}
+	uint32_t new_cycles = (ESP.getCycleCount() - t_start_cycles) / BENCHMARK_ITERATIONS;
+
+	print_benchmark_result("novelty log + normalize", legacy_cycles, new_cycles);
+
+	// Leave no trace in the real novelty history
+	clear_tempo_history();
+}
+
+// reduce_tempo_history() used to rescale all of both rings on every novelty tick
+// during silence, now it only updates tempo_history_decay (and the CPU core folds
+// it in once it gets too small, which is included here)
+void benchmark_silence_decay() {
+	uint32_t t_start_cycles = ESP.getCycleCount();
+	for (uint16_t i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		for (uint16_t n = 0; n < NOVELTY_HISTORY_LENGTH * 2; n++) {
+			novelty_curve_ring[n] = max(novelty_curve_ring[n] * 0.9f, float(TEMPO_HISTORY_FLOOR));
+			vu_curve_ring[n]      = max(     vu_curve_ring[n] * 0.9f, float(TEMPO_HISTORY_FLOOR));
+		}
+		novelty_curve_max.rebuild(novelty_curve);
+	}
+	uint32_t legacy_cycles = (ESP.getCycleCount() - t_start_cycles) / BENCHMARK_ITERATIONS;
+
+	t_start_cycles = ESP.getCycleCount();
+	for (uint16_t i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		reduce_tempo_history(0.10);
+		fold_tempo_history_if_requested();
+	}
+	uint32_t new_cycles = (ESP.getCycleCount() - t_start_cycles) / BENCHMARK_ITERATIONS;
+
+	print_benchmark_result("silence decay", legacy_cycles, new_cycles);
+
+	clear_tempo_history();
+}
+
+// The GPU core used to read the CPU core's arrays in place, halfway through being
+// written or not. Now run_cpu() copies them into a snapshot once per audio frame
+// and run_gpu() swaps it in, so this is what consistency costs, nothing to save
+void benchmark_analysis_snapshot() {
+	uint32_t t_start_cycles = ESP.getCycleCount();
+	for (uint16_t i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		publish_analysis_snapshot();
+	}
+	uint32_t publish_cycles = (ESP.getCycleCount() - t_start_cycles) / BENCHMARK_ITERATIONS;
+
+	uint32_t acquire_cycles_total = 0;
+	for (uint16_t i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		publish_analysis_snapshot();
+
+		t_start_cycles = ESP.getCycleCount();
+		acquire_analysis_snapshot();
+		acquire_cycles_total += ESP.getCycleCount() - t_start_cycles;
+	}
+	uint32_t acquire_cycles = acquire_cycles_total / BENCHMARK_ITERATIONS;
+
+	print_benchmark_result("analysis snapshot publish", 0, publish_cycles);
+	print_benchmark_result("analysis snapshot acquire", 0, acquire_cycles);
+}
+
+// Feeds metronome clicks through the whole audio chain faster than realtime, like
+// run_cpu() and run_gpu() would minus the LEDs. Finds how many milliseconds of audio
+// it took for the strongest tempo bin to land on (or next to) the right one and
+// stay there for a second, then how far the beat (the peaks of get_tempo_beat()) was
+// from the clicks from there on, on average and from click to click
+void measure_tempo_tracking(float bpm, uint32_t* lock_ms, float* beat_offset_ms, float* beat_jitter_ms) {
+	const uint32_t max_audio_ms = 12000;
+	const uint32_t hold_ms = 1000;
+	const uint16_t target_bin = find_closest_tempo_bin(bpm);
+	const float samples_per_beat = (60.0 / bpm) * SAMPLE_RATE;
+	const float delta = AUDIO_FRAME_INTERVAL_MS / (1000.0 / REFERENCE_FPS);
+
+	musical_analyzer.clear_sample_history();
+	t_now_us = 0;
+	clear_tempo_history();
+	start_synth_audio_source(SYNTH_CLICK, 1000.0, bpm, 0.5);
+
+	*lock_ms = max_audio_ms;  // Never locked
+	uint32_t locked_since_ms = 0;
+	bool locked = false;
+
+	float offset_sin_sum = 0.0;
+	float offset_cos_sum = 0.0;
+	uint16_t num_clicks = 0;
+
+	for (uint32_t frame = 0; frame * AUDIO_FRAME_INTERVAL_MS < max_audio_ms; frame++) {
+		uint32_t audio_ms = frame * AUDIO_FRAME_INTERVAL_MS;
+
+		acquire_sample_chunk();
+		calculate_magnitudes();
+		run_vu();
+		update_tempo();
+		publish_analysis_snapshot();
+
+		t_now_us = audio_ms * 1000;
+		acquire_analysis_snapshot();
+		update_novelty();
+		update_tempi_phase(delta);
+
+		uint16_t strongest_bin = 0;
+		for (uint16_t i = 1; i < NUM_TEMPI; i++) {
+			if (tempi[i].magnitude > tempi[strongest_bin].magnitude) {
+				strongest_bin = i;
+			}
+		}
+
+		bool on_target = (tempi[strongest_bin].magnitude > 0.0 && abs(int16_t(strongest_bin) - int16_t(target_bin)) <= 1);
+		if (on_target == false) {
+			locked = false;
+		}
+		else if (locked == false) {
+			locked = true;
+			locked_since_ms = audio_ms;
+		}
+		else if (audio_ms - locked_since_ms >= hold_ms && *lock_ms == max_audio_ms) {
+			*lock_ms = locked_since_ms;
+		}
+
+		// Did a click start in this chunk?
+		uint32_t chunk_start = frame * CHUNK_SIZE;
+		bool click = (ceil(chunk_start / samples_per_beat) * samples_per_beat) < (chunk_start + CHUNK_SIZE);
+		if (click && *lock_ms != max_audio_ms) {
+			float offset_radians = get_tempo_phase(target_bin) - (PI / 2.0);  // sin(phase) peaks at PI / 2
+			offset_sin_sum += sin(offset_radians);
+			offset_cos_sum += cos(offset_radians);
+			num_clicks++;
+		}
+	}
+
+	*beat_offset_ms = 0.0;
+	*beat_jitter_ms = 0.0;
+	if (num_clicks > 0) {
+		// Circular mean and standard deviation, since the offset wraps around every beat
+		float radians_to_ms = 1000.0 / (2.0 * PI * tempi[target_bin].target_tempo_hz);
+		float mean_resultant_length = sqrt(offset_sin_sum * offset_sin_sum + offset_cos_sum * offset_cos_sum) / num_clicks;
+		*beat_offset_ms = atan2(offset_sin_sum, offset_cos_sum) * radians_to_ms;
+		*beat_jitter_ms = sqrt(-2.0 * log(max(mean_resultant_length, 0.000001f))) * radians_to_ms;
+	}
+}
+
+// Back to the microphone, with no trace of the clicks
+void end_tempo_benchmark() {
+	tempogram_legacy_schedule = false;
+	set_tempo_engine(DEFAULT_TEMPO_ENGINE);
+
+	set_audio_source(&i2s_audio_source);
+	musical_analyzer.clear_sample_history();
+	t_now_us = micros();
+	clear_tempo_history();
+}
+
+// update_tempi_phase() used to advance and sin() all NUM_TEMPI phases on every GPU
+// frame. Now phases are advanced when asked for, and only when a new measurement
+// comes in (every few frames here) does the phase tracker run. The other new
+// numbers add the beats Hype asks for (tempi above HYPE_MIN_BEAT_CONTRIBUTION),
+// the phases of the dots Metronome draws, and what Debug costs by asking for
+// every bin's. Runs on the tempogram 120 BPM clicks leave, so the modes see as
+// many tempi as they would with music. Handing the measurements over through
+// analysis.h happens either way, so it's left out of the timing
+void benchmark_tempo_phase() {
+	static float legacy_phase[NUM_TEMPI];
+	static float legacy_beat[NUM_TEMPI];
+	static float legacy_smooth[NUM_TEMPI];
+	const float delta = 1.0;
+
+	uint32_t lock_ms;
+	float beat_offset_ms, beat_jitter_ms;
+	measure_tempo_tracking(120.0, &lock_ms, &beat_offset_ms, &beat_jitter_ms);
+
+	uint32_t t_start_cycles = ESP.getCycleCount();
+	for (uint16_t i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		float power_sum = 0.00000001;
+		for (uint16_t tempo_bin = 0; tempo_bin < NUM_TEMPI; tempo_bin++) {
+			legacy_smooth[tempo_bin] = legacy_smooth[tempo_bin] * 0.975 + tempi[tempo_bin].magnitude * 0.025;
+			power_sum += legacy_smooth[tempo_bin];
+
+			legacy_phase[tempo_bin] += tempi[tempo_bin].phase_radians_per_reference_frame * delta;
+			if (legacy_phase[tempo_bin] > PI) {
+				legacy_phase[tempo_bin] -= (2 * PI);
+			}
+			legacy_beat[tempo_bin] = sin(legacy_phase[tempo_bin]);
+		}
+
+		float max_contribution = 0.000001;
+		for (uint16_t tempo_bin = 0; tempo_bin < NUM_TEMPI; tempo_bin++) {
+			max_contribution = max(legacy_smooth[tempo_bin] / power_sum, max_contribution);
+		}
+		tempo_confidence = max_contribution;
+	}
+	uint32_t legacy_cycles = (ESP.getCycleCount() - t_start_cycles) / BENCHMARK_ITERATIONS;
+
+	// Modes read the beats, or the compiler would be free to skip the sin() calls
+	float beat_sum = 0.0;
+	for (uint16_t tempo_bin = 0; tempo_bin < NUM_TEMPI; tempo_bin++) {
+		beat_sum += legacy_beat[tempo_bin];
+	}
+
+	// 0: phase bookkeeping only, 1: + Hype's beats, 2: + Metronome's phases, 3: + every bin's beat
+	uint32_t new_cycles[4] = { 0, 0, 0, 0 };
+	uint16_t bins_asked[4] = { 0, 0, 0, 0 };
+	for (uint8_t beats = 0; beats < 4; beats++) {
+		for (uint16_t i = 0; i < BENCHMARK_ITERATIONS; i++) {
+			if (i % 4 == 0) {
+				tempo_phase_measurements++;
+				publish_analysis_snapshot();
+			}
+			acquire_analysis_snapshot();
+
+			t_start_cycles = ESP.getCycleCount();
+			update_tempi_phase(delta);
+			for (uint16_t tempo_bin = 0; tempo_bin < NUM_TEMPI && beats > 0; tempo_bin++) {
+				float tempi_magnitude = tempi_smooth[tempo_bin];
+				bool asks = true;
+				if (beats == 1) {  // Same test as draw_hype()
+					asks = ((tempi_magnitude * tempi_magnitude) / tempi_power_sum) * tempi_magnitude > 0.0001;
+				}
+				else if (beats == 2) {  // Same dots as draw_metronome(), minus the sqrt() it needs for opacity anyway
+					asks = (tempi_magnitude / tempi_power_sum) * tempi_magnitude > (0.0001 * 0.0001);
+				}
+
+				if (asks == true) {
+					beat_sum += get_tempo_beat(tempo_bin);
+					if (i == 0) { bins_asked[beats]++; }
+				}
+			}
+			new_cycles[beats] += ESP.getCycleCount() - t_start_cycles;
+		}
+		new_cycles[beats] /= BENCHMARK_ITERATIONS;
+	}
+
+	print_benchmark_result("tempo phase bookkeeping", legacy_cycles, new_cycles[0]);
+	print_benchmark_result("  + Hype's beats", legacy_cycles, new_cycles[1]);
+	print_benchmark_result("  + Metronome's phases", legacy_cycles, new_cycles[2]);
+	print_benchmark_result("  + every bin's beat", legacy_cycles, new_cycles[3]);
+	printf("(Hype asked for %u beats, Metronome for %u of %u)\n", bins_asked[1], bins_asked[2], NUM_TEMPI);
+	kernel_benchmark_sink = beat_sum;
+
+	end_tempo_benchmark();
+}
+
+// update_tempo() used to refresh two tempo bins every other frame, so the whole
+// tempogram took ~320ms to catch up. Now every bin is refreshed for every new
+// novelty value. The cycle counts are per frame, averaged over a full pass
+void benchmark_tempo_lock() {
+	uint32_t lock_ms[2];
+	uint32_t cycles[2];
+	float beat_offset_ms, beat_jitter_ms;
+
+	set_tempo_engine(TEMPO_ENGINE_GOERTZEL);
+	for (uint8_t legacy = 0; legacy < 2; legacy++) {
+		tempogram_legacy_schedule = (legacy == 0);
+		measure_tempo_tracking(120.0, &lock_ms[legacy], &beat_offset_ms, &beat_jitter_ms);
+
+		uint32_t t_start_cycles = ESP.getCycleCount();
+		for (uint16_t i = 0; i < BENCHMARK_ITERATIONS; i++) {
+			if (i % 4 == 0) {
+				log_novelty(i * 0.001);  // Once every 4 frames, like update_novelty() at 50Hz
+			}
+			update_tempo();
+		}
+		cycles[legacy] = (ESP.getCycleCount() - t_start_cycles) / BENCHMARK_ITERATIONS;
+	}
+
+	print_benchmark_result("tempo update", cycles[0], cycles[1]);
+	printf("time to lock onto 120 BPM clicks | OLD: %5lums | NEW: %5lums\n", lock_ms[0], lock_ms[1]);
+
+	end_tempo_benchmark();
+}
+
+// NUM_TEMPI Goertzels vs. one FFT autocorrelation, each refreshing every tempo bin
+// once, and how well each of them follows clicks at a few tempos
+void benchmark_tempo_engines() {
+	for (uint16_t i = 0; i < NOVELTY_HISTORY_LENGTH; i++) {
+		log_novelty(fabs(sin(i * 0.25)));
+	}
+	normalize_novelty_curve();
+	if (init_tempo_autocorrelation() == false) {
+		return;
+	}
+
+	uint32_t t_start_cycles = ESP.getCycleCount();
+	for (uint16_t i = 0; i < BENCHMARK_ITERATIONS / 16; i++) {
+		calculate_tempi_magnitudes();
+	}
+	uint32_t goertzel_cycles = (ESP.getCycleCount() - t_start_cycles) / (BENCHMARK_ITERATIONS / 16);
+
+	t_start_cycles = ESP.getCycleCount();
+	for (uint16_t i = 0; i < BENCHMARK_ITERATIONS / 16; i++) {
+		calculate_tempi_autocorrelation();
+	}
+	uint32_t autocorrelation_cycles = (ESP.getCycleCount() - t_start_cycles) / (BENCHMARK_ITERATIONS / 16);
+
+	print_benchmark_result("tempo goertzel vs. autocorr.", goertzel_cycles, autocorrelation_cycles);
+
+	const float test_bpm[3] = { 90.0, 120.0, 140.0 };
+	const tempo_engine engines[2] = { TEMPO_ENGINE_GOERTZEL, TEMPO_ENGINE_AUTOCORRELATION };
+	const char* engine_names[2] = { "goertzel", "autocorr." };
+	for (uint8_t b = 0; b < 3; b++) {
+		for (uint8_t e = 0; e < 2; e++) {
+			uint32_t lock_ms;
+			float beat_offset_ms, beat_jitter_ms;
+
+			set_tempo_engine(engines[e]);
+			measure_tempo_tracking(test_bpm[b], &lock_ms, &beat_offset_ms, &beat_jitter_ms);
+			printf("%3.0f BPM clicks, %-9s | LOCK: %5lums | BEAT OFFSET: %6.1fms | JITTER: %5.1fms\n", test_bpm[b], engine_names[e], lock_ms, beat_offset_ms, beat_jitter_ms);
+		}
+	}
+
+	end_tempo_benchmark();
+}
+
+// Where test_audio_latency() writes its click, the host build can point this elsewhere
+#ifndef LATENCY_TEST_WAV_PATH
+	#define LATENCY_TEST_WAV_PATH "/littlefs/latency_test.wav"
+#endif
+
+#define LATENCY_TEST_CLICK_SAMPLE ( SAMPLE_RATE + 17 ) // A second in, not on a chunk boundary
+#define LATENCY_TEST_MAX_PROCESSING_US ( AUDIO_FRAME_INTERVAL_MS * 1000 ) // Has to keep up with the audio
+#define LATENCY_TEST_DETECTION_LEVEL ( 0.1 ) // Loudest spectrogram bin that counts as the click, silence reads 0.0
+
+// 16-bit mono WAV at SAMPLE_RATE, silent but for one short 1kHz click
+bool write_click_wav(const char* path, uint32_t num_samples, uint32_t click_sample) {
+	FILE* file = fopen(path, "wb");
+	if (file == NULL) {
+		return false;
+	}
+
+	uint32_t data_size = num_samples * sizeof(int16_t);
+	uint32_t riff_size = 36 + data_size;
+	uint32_t fmt_size = 16;
+	uint16_t audio_format = 1, num_channels = 1, block_align = 2, bits_per_sample = 16;
+	uint32_t sample_rate = SAMPLE_RATE, byte_rate = SAMPLE_RATE * 2;
+
+	fwrite("RIFF", 1, 4, file); fwrite(&riff_size, 4, 1, file); fwrite("WAVE", 1, 4, file);
+	fwrite("fmt ", 1, 4, file); fwrite(&fmt_size, 4, 1, file);
+	fwrite(&audio_format, 2, 1, file); fwrite(&num_channels, 2, 1, file);
+	fwrite(&sample_rate, 4, 1, file); fwrite(&byte_rate, 4, 1, file);
+	fwrite(&block_align, 2, 1, file); fwrite(&bits_per_sample, 2, 1, file);
+	fwrite("data", 1, 4, file); fwrite(&data_size, 4, 1, file);
+
+	const uint32_t click_length = SAMPLE_RATE / 100;  // 10ms
+	for (uint32_t i = 0; i < num_samples; i++) {
+		int16_t sample = 0;
+		if (i >= click_sample && i < click_sample + click_length) {
+			float envelope = 1.0 - float(i - click_sample) / click_length;
+			sample = sin(2.0 * M_PI * 1000.0 * (i - click_sample) / SAMPLE_RATE) * envelope * 16000;
+		}
+		fwrite(&sample, 2, 1, file);
+	}
+
+	fclose(file);
+	return true;
+}
+
+// Plays a click through the WAV backend and the whole analysis chain, like run_cpu()
+// and run_gpu() would. Checks that it shows up within a chunk's worth of samples of
+// where it starts, and that no chunk took longer than an audio frame from being read
+// to being published. Time on the GPU core isn't included, that's measured live.
+// The Goertzel window tapers off toward the newest samples, so a click that starts
+// late in a chunk barely registers until the next one
+bool test_audio_latency() {
+	bool passed = false;
+	uint32_t max_processing_us = 0;
+	int32_t detected_chunk = -1;
+	const uint32_t click_chunk = LATENCY_TEST_CLICK_SAMPLE / CHUNK_SIZE;
+	const uint32_t last_allowed_chunk = (LATENCY_TEST_CLICK_SAMPLE + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+	if (write_click_wav(LATENCY_TEST_WAV_PATH, SAMPLE_RATE * 2, LATENCY_TEST_CLICK_SAMPLE) == true && open_wav_audio_source(LATENCY_TEST_WAV_PATH, false) == true) {
+		for (uint32_t chunk = 0; acquire_sample_chunk() == true; chunk++) {
+			calculate_magnitudes();
+			get_chromagram();
+			run_vu();
+			update_tempo();
+			publish_analysis_snapshot();
+
+			acquire_analysis_snapshot();
+			max_processing_us = max(max_processing_us, analysis->publish_us - analysis->capture_us);
+
+			float loudest_bin = 0.0;
+			for (uint16_t i = 0; i < NUM_FREQS; i++) {
+				loudest_bin = max(loudest_bin, analysis->spectrogram[i]);
+			}
+
+			if (detected_chunk == -1 && loudest_bin > LATENCY_TEST_DETECTION_LEVEL) {
+				detected_chunk = chunk;
+			}
+		}
+
+		passed = (detected_chunk >= int32_t(click_chunk)) && (detected_chunk <= int32_t(last_allowed_chunk)) && (max_processing_us <= LATENCY_TEST_MAX_PROCESSING_US);
+	}
+
+	close_wav_audio_source();
+	remove(LATENCY_TEST_WAV_PATH);
+	end_tempo_benchmark();
+
+	printf("%-32s | %s (click in chunk %lu, seen in %li, %luus max processing)\n", "audio latency", passed ? "PASS" : "FAIL", (unsigned long)click_chunk, (long)detected_chunk, (unsigned long)max_processing_us);
+	return passed;
+}
+
+bool compare_dsp_table(const char* name, const void* baked, const void* run_time, size_t size_bytes) {
+	bool match = (memcmp(baked, run_time, size_bytes) == 0);
+	printf("%-32s | %s\n", name, match ? "MATCH" : "MISMATCH");
+	return match;
+}
+
+// The DSP tables are baked into flash at compile time (constexpr_math.h), this
+// runs the same generators with libm like init used to, and checks that every
+// value came out bit-for-bit identical
+bool verify_dsp_tables() {
+	bool all_match = true;
+
+	window_lookup_table* window = new window_lookup_table;
+	generate_window_lookup<run_time_math>(*window);
+	all_match &= compare_dsp_table("window_lookup", window_lookup_baked.values, window->values, sizeof(window->values));
+	delete window;
+
+	sine_lookup_table* sine = new sine_lookup_table;
+	generate_sine_lookup<run_time_math>(*sine);
+	all_match &= compare_dsp_table("sine_lookup", sine_lookup_baked.values, sine->values, sizeof(sine->values));
+	delete sine;
+
+	const goertzel_constants<NUM_FREQS>* baked_tables[2] = { &musical_spectral_analyzer::constants_multi_rate, &musical_spectral_analyzer::constants_full_rate };
+	for (uint8_t t = 0; t < 2; t++) {
+		goertzel_constants<NUM_FREQS>* run_time = new goertzel_constants<NUM_FREQS>(build_goertzel_constants<run_time_math, NUM_FREQS, SAMPLE_RATE, SAMPLE_HISTORY_LENGTH>(t == 0));
+		const goertzel_constants<NUM_FREQS>* baked = baked_tables[t];
+
+		all_match &= compare_dsp_table("goertzel target_freq", baked->target_freq, run_time->target_freq, sizeof(run_time->target_freq));
+		all_match &= compare_dsp_table("goertzel coeff", baked->coeff, run_time->coeff, sizeof(run_time->coeff));
+		all_match &= compare_dsp_table("goertzel window_step", baked->window_step, run_time->window_step, sizeof(run_time->window_step));
+		all_match &= compare_dsp_table("goertzel window_step_fixed", baked->window_step_fixed, run_time->window_step_fixed, sizeof(run_time->window_step_fixed));
+		all_match &= compare_dsp_table("goertzel output_scale", baked->output_scale, run_time->output_scale, sizeof(run_time->output_scale));
+		all_match &= compare_dsp_table("goertzel block_size", baked->block_size, run_time->block_size, sizeof(run_time->block_size));
+		all_match &= compare_dsp_table("goertzel rate_level", baked->rate_level, run_time->rate_level, sizeof(run_time->rate_level));
+		delete run_time;
+	}
+
+	tempo_constants* tempo_run_time = new tempo_constants(build_tempo_constants<run_time_math>());
+	const tempo_constants* tempo_baked = &tempo_constants_baked;
+	all_match &= compare_dsp_table("tempo target_tempo_hz", tempo_baked->target_tempo_hz, tempo_run_time->target_tempo_hz, sizeof(tempo_run_time->target_tempo_hz));
+	all_match &= compare_dsp_table("tempo coeff", tempo_baked->coeff, tempo_run_time->coeff, sizeof(tempo_run_time->coeff));
+	all_match &= compare_dsp_table("tempo sine", tempo_baked->sine, tempo_run_time->sine, sizeof(tempo_run_time->sine));
+	all_match &= compare_dsp_table("tempo cosine", tempo_baked->cosine, tempo_run_time->cosine, sizeof(tempo_run_time->cosine));
+	all_match &= compare_dsp_table("tempo window_step", tempo_baked->window_step, tempo_run_time->window_step, sizeof(tempo_run_time->window_step));
+	all_match &= compare_dsp_table("tempo phase_radians_per_frame", tempo_baked->phase_radians_per_reference_frame, tempo_run_time->phase_radians_per_reference_frame, sizeof(tempo_run_time->phase_radians_per_reference_frame));
+	all_match &= compare_dsp_table("tempo block_size", tempo_baked->block_size, tempo_run_time->block_size, sizeof(tempo_run_time->block_size));
+	delete tempo_run_time;
+
+	return all_match;
+}
+
+void run_benchmarks() {
+	#ifdef BENCHMARKS_ENABLED
+		printf("# BENCHMARKS #####################\n");
+		verify_dsp_tables();
+		benchmark_sample_history_write();
+		benchmark_goertzel();
+		benchmark_goertzel_decimation();
+		benchmark_sliding_dft();
+		benchmark_fft_constant_q();
+		benchmark_novelty_history();
+		benchmark_silence_decay();
+		benchmark_analysis_snapshot();
+		benchmark_tempo_phase();
+		benchmark_tempo_lock();
+		benchmark_tempo_engines();
+		test_audio_latency();
+		printf("##################################\n\n");
+		run_kernel_benchmarks();  // (kernel_benchmarks.h)
+	#endif
+}
@@ -11,6 +11,7 @@ extern float clip_float(float input);
 extern int16_t set_lightshow_mode_by_name(char* name);
 extern void transmit_to_client_in_slot(char* message, uint8_t client_slot);
 extern void reboot_into_wifi_config_mode();
+extern void queue_audio_job(audio_job job);
 
 // Function to return the selected index as a null-terminated string with custom delimiter
 // The result is stored in the provided buffer
@@ -291,7 +292,7 @@ void parse_command(uint32_t t_now_ms, command com) {
 		reboot_into_wifi_config_mode();
 	}
 	else if (fastcmp(substring, "noise_cal")) {
-		start_noise_calibration();
+		queue_audio_job(AUDIO_JOB_START_NOISE_CALIBRATION);
 	}
 	else if (fastcmp(substring, "button_tap")) {
 		printf("REMOTE TAP TRIGGER\n");
@@ -338,9 +339,7 @@ void parse_command(uint32_t t_now_ms, command com) {
 		perform_update(com.origin_client_slot);
 	}
 	else if (fastcmp(substring, "start_debug_recording")) {
-		audio_recording_index = 0;
-		memset(audio_debug_recording, 0, sizeof(int16_t)*MAX_AUDIO_RECORDING_SAMPLES);
-		audio_recording_live = true;
+		queue_audio_job(AUDIO_JOB_START_DEBUG_RECORDING);
 	}
 	else{
 		unrecognized_command_error(substring);
@@ -360,6 +359,7 @@ void process_command_queue() {
 bool queue_command(char* command, uint8_t length, uint8_t client_slot) {
 	if (length < MAX_COMMAND_LENGTH) {
 		if (commands_queued < COMMAND_QUEUE_SLOTS - 1) {
+			trace_instant(TRACE_COMMAND);  // (trace.h)
 			memcpy(command_queue[commands_queued].command, command, length);
 			command_queue[commands_queued].origin_client_slot = client_slot;
 			commands_queued += 1;
@@ -0,0 +1,114 @@
+// ----------------------------------------------------------------------------------
+// constexpr_math.h
+//
+// exp(), sin() and cos() that the compiler can evaluate while building, so DSP
+// tables like the Goertzel window can be baked into flash instead of being
+// computed into RAM at boot. Everything is done in double precision and only
+// rounded to float by the tables, which (almost) always lands on the same float
+// that libm would have given. verify_dsp_tables() in benchmarks.h checks this.
+//
+// Table generators are templates that take one of the two structs at the bottom,
+// so the baked tables and the runtime versions they're checked against share code.
+
+#define CONSTEXPR_LN2_HI  ( 6.93147180369123816490e-01 ) // ln(2) split in two, the high half
+#define CONSTEXPR_LN2_LO  ( 1.90821492927058770002e-10 ) // has few enough bits that k * LN2_HI is exact
+#define CONSTEXPR_PIO2_HI ( 1.57079632673412561417e+00 ) // Same for PI / 2
+#define CONSTEXPR_PIO2_LO ( 6.07710050650619224932e-11 )
+
+template <typename T>
+constexpr T constexpr_max(T a, T b) {
+	return (a > b) ? a : b;
+}
+
+template <typename T>
+constexpr T constexpr_next_power_of_two(T x) {
+	T power = 1;
+	while (power < x) { power *= 2; }
+	return power;
+}
+
+constexpr double constexpr_fabs(double x) {
+	return (x < 0.0) ? -x : x;
+}
+
+constexpr long long constexpr_round(double x) {
+	return (long long)(x + ((x < 0.0) ? -0.5 : 0.5));
+}
+
+constexpr double constexpr_exp(double x) {
+	// exp(x) = 2^k * exp(r), with |r| <= ln(2) / 2
+	long long k = constexpr_round(x / (CONSTEXPR_LN2_HI + CONSTEXPR_LN2_LO));
+	double r = (x - k * CONSTEXPR_LN2_HI) - k * CONSTEXPR_LN2_LO;
+
+	double term = 1.0;
+	double sum = 1.0;
+	for (uint8_t n = 1; n < 24; n++) {
+		term *= r / n;
+		sum += term;
+	}
+
+	for (; k > 0; k--) { sum *= 2.0; }
+	for (; k < 0; k++) { sum *= 0.5; }
+
+	return sum;
+}
+
+// Taylor series, only used for |x| <= PI / 4
+constexpr double constexpr_sin_kernel(double x) {
+	double term = x;
+	double sum = x;
+	for (uint8_t n = 1; n < 12; n++) {
+		term *= -(x * x) / ((2 * n) * (2 * n + 1));
+		sum += term;
+	}
+	return sum;
+}
+
+constexpr double constexpr_cos_kernel(double x) {
+	double term = 1.0;
+	double sum = 1.0;
+	for (uint8_t n = 1; n < 12; n++) {
+		term *= -(x * x) / ((2 * n - 1) * (2 * n));
+		sum += term;
+	}
+	return sum;
+}
+
+constexpr double constexpr_sin(double x) {
+	// Fold x into [-PI/4, PI/4] and pick the right kernel for the quadrant
+	long long quadrant = constexpr_round(x / (CONSTEXPR_PIO2_HI + CONSTEXPR_PIO2_LO));
+	double r = (x - quadrant * CONSTEXPR_PIO2_HI) - quadrant * CONSTEXPR_PIO2_LO;
+
+	switch (quadrant & 3) {
+		case 0:  return  constexpr_sin_kernel(r);
+		case 1:  return  constexpr_cos_kernel(r);
+		case 2:  return -constexpr_sin_kernel(r);
+		default: return -constexpr_cos_kernel(r);
+	}
+}
+
+constexpr double constexpr_cos(double x) {
+	long long quadrant = constexpr_round(x / (CONSTEXPR_PIO2_HI + CONSTEXPR_PIO2_LO));
+	double r = (x - quadrant * CONSTEXPR_PIO2_HI) - quadrant * CONSTEXPR_PIO2_LO;
+
+	switch (quadrant & 3) {
+		case 0:  return  constexpr_cos_kernel(r);
+		case 1:  return -constexpr_sin_kernel(r);
+		case 2:  return -constexpr_cos_kernel(r);
+		default: return  constexpr_sin_kernel(r);
+	}
+}
+
+// Math for table generators evaluated at compile time
+struct compile_time_math {
+	static constexpr double exp(double x) { return constexpr_exp(x); }
+	static constexpr double sin(double x) { return constexpr_sin(x); }
+	static constexpr double cos(double x) { return constexpr_cos(x); }
+};
+
+// Math for the same table generators running at boot, like they used to
+struct run_time_math {
+	static double exp(double x) { return ::exp(x); }
+	static double sin(double x) { return ::sin(x); }
+	static double cos(double x) { return ::cos(x); }
+};
@@ -18,32 +18,56 @@ void run_cpu() {
 		static uint32_t iter = 0;
 		iter++;
 
+		static uint32_t last_chunk_us = 0;
+		uint32_t chunk_request_us = micros();
+
 		//------------------------------------------------------------------------------------------
 		// AUDIO CALCULATIONS
 		// ----------------------------------------------------------------------
 
-		// Get new audio chunk from the I2S microphone
-		acquire_sample_chunk();	 // (microphone.h)
+		// Get new audio chunk from the active audio source
+		time_stage(STAGE_ACQUIRE_SAMPLE_CHUNK, [&]() {
+			acquire_sample_chunk();	 // (audio_source.h)
+		});
 
 		uint32_t processing_start_us = micros();
+		uint32_t processing_start_cycles = ESP.getCycleCount();
+
+		// Track the worst case, anything the loop does besides waiting for audio
+		// eats into the I2S DMA buffers' headroom (printed by print_system_info())
+		if (last_chunk_us != 0) {
+			uint32_t stall_us = chunk_request_us - last_chunk_us;
+			uint32_t interval_us = processing_start_us - last_chunk_us;
+			if (stall_us > CPU_MAX_STALL_US) { CPU_MAX_STALL_US = stall_us; }
+			if (interval_us > CPU_MAX_INTERVAL_US) { CPU_MAX_INTERVAL_US = interval_us; }
+		}
+		last_chunk_us = processing_start_us;
+
+		// Commands from the app that change audio state (web_core.h)
+		extern void run_audio_jobs();
+		run_audio_jobs();
 
 		// Calculate the magnitudes of the currently studied frequency set
-		calculate_magnitudes();  // (goertzel.h)
+		time_stage(STAGE_CALCULATE_MAGNITUDES, [&]() {
+			calculate_magnitudes();  // (goertzel.h)
+		});
 		get_chromagram();
 
 		run_vu();
 
 		//printf("update_tempo() = %.4fus\n", measure_execution([&]() {
 		// Log novelty and calculate the most probable tempi
-		update_tempo();	 // (tempo.h)
+		time_stage(STAGE_UPDATE_TEMPO, [&]() {
+			update_tempo();	 // (tempo.h)
+		});
 		//}));
 
+		// Hand it all to the GPU core
+		publish_analysis_snapshot();  // (analysis.h)
+
 		// Update the FPS_CPU variable
 		watch_cpu_fps();  // (system.h)
 
-		// Occasionally print the average frame rate
-		print_system_info();
-
 		// print_audio_data();
 
 		read_touch();
@@ -53,7 +77,11 @@ void run_cpu() {
 		//------------------------------------------------------------------------------------------
 		// WIFI
 		// ------------------------------------------------------------------------------------
-		//run_wireless();	 // (wireless.h)
+		// Runs in loop_web() (web_core.h) whenever this loop waits on the microphone. Other
+		// audio sources and standby never wait, so give it a turn here instead
+		if (EMOTISCOPE_ACTIVE == false || active_audio_source != &i2s_audio_source) {
+			vTaskDelay(1);
+		}
 
 		//------------------------------------------------------------------------------------------
 		// TESTING AREA, SHOULD BE BLANK IN PRODUCTION
@@ -70,6 +98,7 @@ void run_cpu() {
 		// CPU USAGE CALCULATION
 		// -------------------------------------------------------------------
 		uint32_t processing_end_us = micros();
+		record_stage_cycles(STAGE_CPU_FRAME, ESP.getCycleCount() - processing_start_cycles);
 		uint32_t processing_us_spent = processing_end_us - processing_start_us;
 		uint32_t audio_core_us_per_loop = 1000000.0 / FPS_CPU;
 		float audio_frame_to_processing_ratio = processing_us_spent / float(audio_core_us_per_loop);
@@ -1,6 +1,17 @@
+// The firmware's spectral_analyzer (goertzel.h), other sizes can be built next to it
 #define NUM_FREQS ( 64 ) // Number of Goertzel instances running in parallel
+#define CHUNK_SIZE ( 64 ) // New samples per audio frame
+#define SAMPLE_RATE ( 12800 )
+#define SAMPLE_HISTORY_LENGTH ( 4096 )
+#define AUDIO_FRAME_INTERVAL_MS ( (CHUNK_SIZE * 1000.0) / SAMPLE_RATE ) // 5ms between chunks
+#define ANALYSIS_WAVEFORM_LENGTH ( 256 ) // Newest samples the GPU core gets with every analysis_snapshot (analysis.h)
+
+#define NUM_TEMPI ( 64 ) // Number of tempo Goertzel instances
 #define MAX_WEBSOCKET_CLIENTS ( 4 ) // Max simultaneous remote controls allowed at one time
 
+#define CPU_TASK_PRIORITY ( 2 ) // loop(), above the web task on the same core
+#define WEB_TASK_PRIORITY ( 1 ) // loop_web(), only runs while loop() waits on the microphone
+
 uint8_t HARDWARE_VERSION = 0;
 
 char wifi_ssid[64] = { 0 };
@@ -17,12 +17,31 @@
 
 #define NOISE_CALIBRATION_FRAMES 512
 
-#define BOTTOM_NOTE 24	// THESE ARE IN QUARTER-STEPS, NOT HALF-STEPS! That's 24 notes to an octave
-#define NOTE_STEP 2 // Use half-steps anyways
+// Which engine computes the musical bins, picked by init_goertzel_constants_musical()
+#define DEFAULT_SPECTRAL_ENGINE ( SPECTRAL_ENGINE_GOERTZEL ) // or SPECTRAL_ENGINE_SLIDING_DFT, SPECTRAL_ENGINE_FFT_CONSTANT_Q
+
+#define SLIDING_DFT_DAMPING ( 0.99999 ) // Keeps float rounding errors from piling up forever
+
+// Smoothing of the spectrogram, in milliseconds so it doesn't depend on the audio frame rate
+#define MAGNITUDE_ATTACK_MS ( 12.5 )         // Raw magnitudes, before auto-ranging
+#define MAGNITUDE_RELEASE_MS ( 12.5 )
+#define SPECTROGRAM_SMOOTH_ATTACK_MS ( 17.5 ) // spectrogram_smooth[], after auto-ranging
+#define SPECTROGRAM_SMOOTH_RELEASE_MS ( 17.5 )
+#define AUTORANGER_TIME_CONSTANT_MS ( 1000.0 )
 
-uint32_t noise_calibration_active_frames_remaining = 0;
+#define FFT_CONSTANT_Q_THRESHOLD ( 0.03 )            // Spectral kernel values under this fraction of their peak are dropped
+#define FFT_CONSTANT_Q_KERNEL_SPACE ( 7 )  // Kernel values per point of the FFT, shared by all bins. 64 bins need 5929 of 7168, 32 need 3429 of 3584
+
+// Half and quarter rate copies of the sample history are low-passed before
+// decimation so they're free of aliasing. Low frequency bins can use these to look
+// at the same span of time with 2x or 4x fewer samples
+#define MAX_DECIMATION_LEVEL 2     // 0 = sample_rate, 1 = sample_rate / 2, 2 = sample_rate / 4
+#define DECIMATION_FILTER_TAPS 31  // Half-band lowpass, delays its output by 15 input samples
+
+#define BOTTOM_NOTE 24	// THESE ARE IN QUARTER-STEPS, NOT HALF-STEPS! That's 24 notes to an octave
+#define NOTE_RANGE 128  // Quarter-steps covered by every analyzer: 32 bins are whole steps, 64 half steps, 128 quarter steps
 
-const float notes[] = {
+constexpr float notes[] = {
 	55.0, 56.635235, 58.27047, 60.00294, 61.73541, 63.5709, 65.40639, 67.351025, 69.29566, 71.355925, 73.41619, 75.59897, 77.78175, 80.09432, 82.40689, 84.856975, 87.30706, 89.902835, 92.49861, 95.248735, 97.99886, 100.91253, 103.8262, 106.9131, 110.0, 113.27045, 116.5409, 120.00585, 123.4708, 127.1418, 130.8128, 134.70205, 138.5913, 142.71185, 146.8324, 151.19795, 155.5635, 160.18865, 164.8138, 169.71395, 174.6141, 179.80565, 184.9972, 190.49745, 195.9977, 201.825, 207.6523, 213.82615, 220.0, 226.54095, 233.0819, 240.0118, 246.9417, 254.28365, 261.6256, 269.4041, 277.1826, 285.4237, 293.6648, 302.3959, 311.127, 320.3773, 329.6276, 339.4279, 349.2282, 359.6113, 369.9944, 380.9949, 391.9954, 403.65005, 415.3047, 427.65235, 440.0, 453.0819, 466.1638, 480.02355, 493.8833, 508.5672, 523.2511, 538.8082, 554.3653, 570.8474, 587.3295, 604.79175, 622.254, 640.75455, 659.2551, 678.8558, 698.4565, 719.22265, 739.9888, 761.98985, 783.9909, 807.30015, 830.6094, 855.3047, 880.0, 906.16375, 932.3275, 960.04705, 987.7666, 1017.1343, 1046.502, 1077.6165, 1108.731, 1141.695, 1174.659, 1209.5835, 1244.508, 1281.509, 1318.51, 1357.7115, 1396.913, 1438.4455, 1479.978, 1523.98, 1567.982, 1614.6005, 1661.219, 1710.6095, 1760.0, 1812.3275, 1864.655, 1920.094, 1975.533, 2034.269, 2093.005, 2155.233, 2217.461, 2283.3895, 2349.318, 2419.167, 2489.016, 2563.018, 2637.02, 2715.4225, 2793.825, 2876.8905, 2959.956, 3047.96, 3135.964, 3229.2005, 3322.437, 3421.2185, 3520.0, 3624.655, 3729.31, 3840.1875, 3951.065, 4068.537, 4186.009, 4310.4655, 4434.922, 4566.779, 4698.636, 4838.334, 4978.032, 5126.0365, 5274.041, 5430.8465, 5587.652, 5753.7815, 5919.911, 6095.919, 6271.927, 6458.401, 6644.875, 6842.4375, 7040.0, 7249.31, 7458.62, 7680.375, 7902.13, 8137.074, 8372.018, 8620.931, 8869.844, 9133.558, 9397.272, 9676.668, 9956.064, 10252.072, 10548.08, 10861.69, 11175.3, 11507.56, 11839.82, 12191.835, 12543.85, 12916.8, 13289.75, 13684.875, 14080.0, 14498.62, 14917.24, 15360.75, 15804.26, 16274.145, 16744.03, 17241.855, 17739.68, 18267.11, 18794.54, 19353.36, 19912.18, 20504.17, 21096.16, 21723.38, 22350.6, 23015.12, 23679.64, 24383.67, 25087.7, 25833.6, 26579.5, 27369.75, 28160.0, 28997.24, 29834.48, 30721.5, 31608.52, 32548.295, 33488.07, 34483.72, 35479.37, 36534.225, 37589.08, 38706.665, 39824.25, 41008.285, 42192.32, 43446.76, 44701.2, 46030.24, 47359.28, 48767.34, 50175.4, 51667.2};
 
 float full_spectrum_frequencies[64] = {
@@ -35,63 +54,68 @@ float full_spectrum_frequencies[64] = {
 	4888.10, 4988.89, 5089.68, 5190.48, 5291.27, 5392.06, 5492.86, 5593.65,
 	5694.44, 5795.24, 5896.03, 5996.83, 6097.62, 6198.41, 6299.21, 6400.0};
 
-float window_lookup[4096];
+#define GOERTZEL_LANES 4  // Neighboring bins advanced in lockstep by calculate_magnitudes_of_bin_group()
 
-freq frequencies_musical[NUM_FREQS];
-uint16_t max_goertzel_block_size = 0;
+// Fills in place, a 16KB table is too big to return by value on the stack at runtime
+template <typename math>
+constexpr void generate_window_lookup(window_lookup_table& table) {
+	float sigma = 0.8; // For gaussian window
 
-volatile bool magnitudes_locked = false;
+	for (uint16_t i = 0; i < 2048; i++) {
+		float n_minus_halfN = i - 2048 / 2;
+		float x = n_minus_halfN / (sigma * 2048 / 2);
+		float gaussian_weighing_factor = math::exp(-0.5 * (double(x) * double(x)));
 
-float spectrogram[NUM_FREQS];
-float chromagram[12];
+		// Hamming window
+		//float weighing_factor = 0.54 * (1.0 - cos(TWOPI * ratio));
 
-const uint8_t NUM_SPECTROGRAM_AVERAGE_SAMPLES = 8;
-float spectrogram_smooth[NUM_FREQS] = { 0.0 };
-float spectrogram_average[NUM_SPECTROGRAM_AVERAGE_SAMPLES][NUM_FREQS];
-uint8_t spectrogram_average_index = 0;
+		// Blackman-Harris window
+		//float weighing_factor = 0.3635819 - (0.4891775 * cos(TWOPI * ratio)) + (0.1365995 * cos(FOURPI * ratio)) - (0.0106411 * cos(SIXPI * ratio));
 
-void init_goertzel(uint16_t frequency_slot, float frequency, float bandwidth) {
-	// Calculate the block size based on the desired bandwidth
-	frequencies_musical[frequency_slot].block_size = SAMPLE_RATE / (bandwidth);
+		// Gaussian window
+		float weighing_factor = gaussian_weighing_factor;
 
-	// Adjust the block size to be divisible by 4
-	while (frequencies_musical[frequency_slot].block_size % 4 != 0) {
-		frequencies_musical[frequency_slot].block_size -= 1;
+		table.values[i] = weighing_factor;
+		table.values[4095 - i] = weighing_factor; // Mirror the value for the second half
 	}
+}
 
-	// Limit the block size to the maximum sample history length
-	if (frequencies_musical[frequency_slot].block_size > SAMPLE_HISTORY_LENGTH - 1) {
-		frequencies_musical[frequency_slot].block_size = SAMPLE_HISTORY_LENGTH - 1;
-	}
+constexpr window_lookup_table bake_window_lookup() {
+	window_lookup_table table;
+	generate_window_lookup<compile_time_math>(table);
+	return table;
+}
 
-	// Update the maximum goertzel block size
-	max_goertzel_block_size = max(max_goertzel_block_size, frequencies_musical[frequency_slot].block_size);
+// Baked into flash at compile time (see constexpr_math.h), shared by every analyzer
+constexpr window_lookup_table window_lookup_baked = bake_window_lookup();
+constexpr const float* window_lookup = window_lookup_baked.values;
 
-	// Calculate the window step size
-	frequencies_musical[frequency_slot].window_step = 4096.0 / frequencies_musical[frequency_slot].block_size;
+// Goertzel constants are kept as a structure of arrays (instead of inside freq)
+// so that GOERTZEL_LANES neighboring bins can be loaded side by side
+template <typename math, uint16_t num_bins, uint32_t sample_rate, uint16_t history_length>
+constexpr goertzel_constants<num_bins> build_goertzel_constants(bool decimation_enabled) {
+	goertzel_constants<num_bins> table;
 
-	// Calculate the coefficients for the goertzel algorithm
-	float k = (int)(0.5 + ((frequencies_musical[frequency_slot].block_size * frequencies_musical[frequency_slot].target_freq) / SAMPLE_RATE));
-	float w = (2.0 * PI * k) / frequencies_musical[frequency_slot].block_size;
-	float cosine = cos(w);
-	float sine = sin(w);
-	frequencies_musical[frequency_slot].coeff = 2.0 * cosine;
-}
+	const uint16_t note_step = NOTE_RANGE / num_bins;
+	const uint16_t last_note = (sizeof(notes) / sizeof(notes[0])) - 1;
 
-void init_goertzel_constants_musical() {
-	for (uint16_t i = 0; i < NUM_FREQS; i++) {
+	for (uint16_t i = 0; i < num_bins; i++) {
 		// INIT MUSICAL FREQS
-		uint16_t note = BOTTOM_NOTE + (i * NOTE_STEP);
-		frequencies_musical[i].target_freq = notes[note];
+		uint16_t note = BOTTOM_NOTE + (i * note_step);
+		table.target_freq[i] = notes[note];
+	}
+
+	for (uint16_t i = 0; i < num_bins; i++) {
+		uint16_t note = BOTTOM_NOTE + (i * note_step);
 
-		float neighbor_left;
-		float neighbor_right;
+		float neighbor_left = 0.0;
+		float neighbor_right = 0.0;
 
 		if (note == 0) {
 			neighbor_left = notes[note];
 			neighbor_right = notes[note + 1];
 		}
-		else if (note == NUM_FREQS - 1) {
+		else if (note == last_note) {
 			neighbor_left = notes[note - 1];
 			neighbor_right = notes[note];
 		}
@@ -100,35 +124,112 @@ void init_goertzel_constants_musical() {
 			neighbor_right = notes[note + 1];
 		}
 
-		float neighbor_distance_hz = max(
-			fabs(frequencies_musical[i].target_freq - neighbor_left),
-			fabs(frequencies_musical[i].target_freq - neighbor_right));
+		float neighbor_distance_hz = constexpr_max(
+			constexpr_fabs(table.target_freq[i] - neighbor_left),
+			constexpr_fabs(table.target_freq[i] - neighbor_right));
+
+		// Every bin in a group of GOERTZEL_LANES has to read the same history, so the
+		// group's highest frequency decides the lowest rate they can all use. That's
+		// the one where it's still under half of the Nyquist frequency, leaving room
+		// for the anti-aliasing filter's transition band
+		uint8_t rate_level = 0;
+		if (decimation_enabled == true) {
+			uint16_t highest_bin_in_group = (i - (i % GOERTZEL_LANES)) + (GOERTZEL_LANES - 1);
+			float highest_freq_in_group = table.target_freq[highest_bin_in_group];
+
+			while (rate_level < MAX_DECIMATION_LEVEL && highest_freq_in_group < (sample_rate >> (rate_level + 1)) / 4.0) {
+				rate_level++;
+			}
+		}
+
+		// Calculate the block size based on the desired bandwidth, which is as
+		// wide as two bins (neighbor_distance_hz is a quarter-step)
+		float bandwidth = neighbor_distance_hz * 2.0 * note_step;
+		uint16_t block_size = sample_rate / (bandwidth);
+
+		// Adjust the block size to be divisible by 4
+		while (block_size % 4 != 0) {
+			block_size -= 1;
+		}
+
+		// Limit the block size to the maximum sample history length
+		if (block_size > history_length - 1) {
+			block_size = history_length - 1;
+		}
+
+		// Update the maximum goertzel block size
+		table.max_block_size = constexpr_max(table.max_block_size, block_size);
 
-		init_goertzel(i, frequencies_musical[i].target_freq, neighbor_distance_hz * 4.0);
+		// The same span of time at a lower sample rate takes fewer samples, (block sizes
+		// are divisible by 4, so this is exact down to a quarter of sample_rate)
+		const float level_sample_rate = sample_rate >> rate_level;
+		block_size >>= rate_level;
+
+		table.block_size[i] = block_size;
+		table.rate_level[i] = rate_level;
+
+		// Calculate the window step size
+		table.window_step[i] = 4096.0 / block_size;
+		table.window_step_fixed[i] = (4096 << 16) / block_size; // Rounded down so we never read past window_lookup[4095]
+
+		// Calculate the coefficients for the goertzel algorithm
+		float k = (int)(0.5 + ((block_size * table.target_freq[i]) / level_sample_rate));
+		float w = (2.0 * PI * k) / block_size;
+		float cosine = math::cos(w);
+		table.coeff[i] = 2.0 * cosine;
+
+		// Boost higher frequencies, and normalize by block size
+		float progress = float(i) / num_bins;
+		progress *= progress;
+		progress *= progress;
+		float scale = (progress * 0.995) + 0.005;
+
+		// A decimated bin sums up (1 << rate_level) times fewer samples, scale it back up to
+		// read the same as it would at the full rate
+		table.output_scale[i] = (scale * (1 << rate_level)) / (block_size / 2.0);
 	}
+
+	return table;
 }
 
-void init_window_lookup() {
-    float sigma = 0.8; // For gaussian window
+float decimation_filter[DECIMATION_FILTER_TAPS];
 
-    for (uint16_t i = 0; i < 2048; i++) {
-        float ratio = i / 2047.0;
+// Blackman-windowed sinc with its cutoff at a quarter of the input rate
+void init_decimation_filter() {
+	const int16_t center = DECIMATION_FILTER_TAPS / 2;
 
-        float n_minus_halfN = i - 2048 / 2;
-        float gaussian_weighing_factor = exp(-0.5 * pow((n_minus_halfN / (sigma * 2048 / 2)), 2));
+	float sum = 0.0;
+	for (int16_t i = 0; i < DECIMATION_FILTER_TAPS; i++) {
+		float x = (i - center) / 2.0;
+		float sinc = (i == center) ? 1.0 : sin(M_PI * x) / (M_PI * x);
+		float ratio = i / float(DECIMATION_FILTER_TAPS - 1);
+		float blackman = 0.42 - 0.5 * cos(2.0 * M_PI * ratio) + 0.08 * cos(4.0 * M_PI * ratio);
 
-        // Hamming window
-        //float weighing_factor = 0.54 * (1.0 - cos(TWOPI * ratio));
+		decimation_filter[i] = sinc * blackman;
+		sum += decimation_filter[i];
+	}
 
-        // Blackman-Harris window
-        //float weighing_factor = 0.3635819 - (0.4891775 * cos(TWOPI * ratio)) + (0.1365995 * cos(FOURPI * ratio)) - (0.0106411 * cos(SIXPI * ratio));
+	// Unity gain at DC
+	for (uint16_t i = 0; i < DECIMATION_FILTER_TAPS; i++) {
+		decimation_filter[i] /= sum;
+	}
+}
 
-        // Gaussian window
-        float weighing_factor = gaussian_weighing_factor;
+// Filters and keeps every other one of the num_new_samples newest samples of a
+// history, ending on the newest one. The filter's past inputs are read straight
+// out of the history, so no other state needs to be carried between chunks
+void decimate_newest_samples(const float* history, uint16_t history_length, uint16_t num_new_samples, float output[]) {
+	const float* newest_samples = &history[history_length - num_new_samples];
 
-        window_lookup[i] = weighing_factor;
-        window_lookup[4095 - i] = weighing_factor; // Mirror the value for the second half
-    }
+	for (uint16_t i = 0; i < num_new_samples / 2; i++) {
+		const float* input = &newest_samples[(i * 2) + 1];
+
+		float sum = 0.0;
+		for (uint16_t t = 0; t < DECIMATION_FILTER_TAPS; t++) {
+			sum += decimation_filter[t] * input[-t];
+		}
+		output[i] = sum;
+	}
 }
 
 // Function to find the median in a small array of floats
@@ -171,192 +272,668 @@ void median_filter(float* spectrogram_column) {
 	memcpy(spectrogram_column, output, sizeof(output));
 }
 
-float calculate_magnitude_of_bin(uint16_t bin_number) {
-	float normalized_magnitude;
-	float scale;
+// esp-dsp keeps a single twiddle table for all FFTs, and a table made for one size
+// works for every smaller size. The spectral analyzers and the tempo engine each ask
+// for the size they need, and the table only ever grows.
+uint16_t fft_table_size = 0;
 
-	profile_function([&]() {
-		float q0 = 0;
-		float q1 = 0;
-		float q2 = 0;
-		float window_pos = 0.0;
+void init_fft_tables(uint16_t fft_size) {
+	if (fft_size <= fft_table_size) {
+		return;
+	}
 
-		const uint16_t block_size = frequencies_musical[bin_number].block_size;
+	if (fft_table_size > 0) {
+		dsps_fft2r_deinit_fc32();
+	}
 
-		float coeff = frequencies_musical[bin_number].coeff;
-		float window_step = frequencies_musical[bin_number].window_step;
+	dsps_fft2r_init_fc32(NULL, fft_size);
+	fft_table_size = fft_size;
+}
 
-		float* sample_ptr = &sample_history[(SAMPLE_HISTORY_LENGTH - 1) - block_size];
+// Runs the Goertzel recurrence of num_active_lanes bins over the same samples.
+// The lanes don't depend on each other, so the FPU pipeline stays full instead of
+// stalling on one q1/q2 chain, and each sample is loaded once for all of them.
+template <uint8_t num_active_lanes>
+inline void IRAM_ATTR advance_goertzel_lanes(const float* samples, uint16_t num_samples, const float coeff[], float q1[], float q2[], const uint32_t window_step[], uint32_t window_pos[]) {
+	for (uint16_t n = 0; n < num_samples; n++) {
+		const float sample = samples[n];
+		for (uint8_t lane = 0; lane < num_active_lanes; lane++) {
+			float q0 = coeff[lane] * q1[lane] - q2[lane] + sample * window_lookup[window_pos[lane] >> 16];
+			q2[lane] = q1[lane];
+			q1[lane] = q0;
+
+			window_pos[lane] += window_step[lane];
+		}
+	}
+}
 
-		for (uint16_t i = 0; i < block_size; i++) {
-			float windowed_sample = sample_ptr[i] * window_lookup[uint32_t(window_pos)];
-			q0 = coeff * q1 - q2 + windowed_sample;
-			q2 = q1;
-			q1 = q0;
+// ----------------------------------------------------------------------------------
+// SPECTRAL ANALYZER
+//
+// Everything between a chunk of new samples and the spectrogram/chromagram: the
+// sample history, the three spectral engines, noise removal, smoothing and
+// auto-ranging. The sizes are template parameters, so every loop bound and table
+// is known at compile time and each size gets its own fully unrolled code. The
+// firmware runs one of these (musical_analyzer below), but any number of them
+// with different sizes can run side by side:
+//
+//   spectral_analyzer<128, 64, 12800, 4096> quarter_tones;  // Finer, and twice the work
+//   spectral_analyzer<32, 64, 12800, 4096> whole_tones;     // Cheap
+//
+// Every size covers the same NOTE_RANGE from notes[BOTTOM_NOTE], more bins only
+// means they're closer together (and have longer blocks to tell them apart).
+
+template <uint16_t num_bins, uint16_t chunk_size, uint32_t sample_rate, uint16_t history_length>
+struct spectral_analyzer {
+	static_assert(num_bins % GOERTZEL_LANES == 0, "Bins are computed GOERTZEL_LANES at a time");
+	static_assert(num_bins <= NOTE_RANGE && NOTE_RANGE % num_bins == 0, "Bins must be a whole number of quarter-steps apart");
+	static_assert(chunk_size % (1 << MAX_DECIMATION_LEVEL) == 0, "Chunks have to decimate evenly");
+	static_assert(history_length % (1 << MAX_DECIMATION_LEVEL) == 0, "Histories have to decimate evenly");
+
+	static constexpr uint16_t note_step = NOTE_RANGE / num_bins;  // In quarter-steps
+	static constexpr float frame_interval_ms = (chunk_size * 1000.0) / sample_rate;
+
+	// Baked into flash at compile time (see constexpr_math.h)
+	static constexpr goertzel_constants<num_bins> constants_multi_rate = build_goertzel_constants<compile_time_math, num_bins, sample_rate, history_length>(true);
+	static constexpr goertzel_constants<num_bins> constants_full_rate = build_goertzel_constants<compile_time_math, num_bins, sample_rate, history_length>(false);
+
+	static constexpr uint16_t fft_constant_q_size = constexpr_next_power_of_two(constants_full_rate.max_block_size);  // At least as long as the longest full rate block
+	static constexpr uint16_t fft_constant_q_max_kernel_values = fft_constant_q_size * FFT_CONSTANT_Q_KERNEL_SPACE;
+	static_assert(fft_constant_q_size < history_length, "The FFT has to fit in the sample history");
+
+	bool decimation_enabled = true;  // Lets low bins read the half/quarter rate histories
+	spectral_engine engine = DEFAULT_SPECTRAL_ENGINE;
+	const goertzel_constants<num_bins>* constants = &constants_multi_rate;
+
+	// The sample history is a mirrored ring buffer (see write_to_mirrored_ring() in utilities.h)
+	// sample_history always points at the last history_length samples, oldest first,
+	// so it can be read just like a regular array. The half and quarter rate copies work the same way
+	float sample_history_ring[history_length * 2] = {};
+	uint16_t sample_history_index = 0;
+	float* sample_history = sample_history_ring;
+
+	float sample_history_half_ring[(history_length / 2) * 2] = {};
+	uint16_t sample_history_half_index = 0;
+	float* sample_history_half = sample_history_half_ring;
+
+	float sample_history_quarter_ring[(history_length / 4) * 2] = {};
+	uint16_t sample_history_quarter_index = 0;
+	float* sample_history_quarter = sample_history_quarter_ring;
+
+	// Sliding DFT state: three resonators per bin (DFT bins k-1, k and k+1 of a
+	// block_size long window) that get combined into one windowed bin
+	float sliding_dft_real[num_bins][3];
+	float sliding_dft_imag[num_bins][3];
+	float sliding_dft_rotation_real[num_bins][3];
+	float sliding_dft_rotation_imag[num_bins][3];
+	float sliding_dft_comb_gain[num_bins];  // SLIDING_DFT_DAMPING ^ block_size
+	float sliding_dft_window_center = 0.5;  // The window is (center + 2 * side * cos(2*PI*t)),
+	float sliding_dft_window_side = -0.25;  // fitted to window_lookup by init_sliding_dft()
+
+	// FFT constant-Q state: every bin's windowed complex exponential, transformed
+	// into the frequency domain ahead of time, keeping only the few values that matter
+	// (Brown & Puckette, "An efficient algorithm for the calculation of a constant Q transform")
+	struct fft_constant_q_state {
+		float buffer[fft_constant_q_size * 2] __attribute__((aligned(16)));  // Interleaved complex
+		uint16_t kernel_index[fft_constant_q_max_kernel_values];
+		float kernel_real[fft_constant_q_max_kernel_values];
+		float kernel_imag[fft_constant_q_max_kernel_values];
+		uint16_t kernel_start[num_bins + 1];  // Bin i owns kernel values [start[i], start[i+1])
+		float output_scale[num_bins];
+	};
+
+	// Tens of KB, so it's only allocated while SPECTRAL_ENGINE_FFT_CONSTANT_Q is in use
+	fft_constant_q_state* fft_constant_q = NULL;
+
+	// num_bins long, owned by whoever persists it (configuration.h for the firmware).
+	// Left NULL, noise is neither calibrated nor removed
+	float* noise_spectrum = NULL;
+	uint32_t noise_calibration_frames_remaining = 0;
+
+
+	freq bins[num_bins];
+	float spectrogram[num_bins] = { 0.0 };
+	float spectrogram_smooth[num_bins] = { 0.0 };
+	float chromagram[12] = { 0.0 };
+
+	float magnitudes_raw[num_bins] = { 0.0 };
+	float magnitudes_smooth[num_bins] = { 0.0 };
+	float max_val_smooth = 0.0;
+
+	// Set by init_spectral_smoothing() from the *_MS time constants at the top of goertzel.h
+	float magnitude_attack_coefficient;
+	float magnitude_release_coefficient;
+	float spectrogram_smooth_attack_coefficient;
+	float spectrogram_smooth_release_coefficient;
+	float autoranger_coefficient;
+
+	// rate_level 0 is the full rate sample_history, each level above that halves
+	// the sample rate and the length: (history_length >> rate_level)
+	float* get_sample_history(uint8_t rate_level) {
+		if (rate_level == 2) { return sample_history_quarter; }
+		if (rate_level == 1) { return sample_history_half; }
+		return sample_history;
+	}
+
+	// O(chunk_size) instead of memmove()-ing the entire history every frame
+	void write_to_sample_history(const float new_samples[chunk_size]) {
+		write_to_mirrored_ring(sample_history_ring, history_length, &sample_history_index, new_samples, chunk_size);
+		sample_history = &sample_history_ring[sample_history_index];
+
+		float half_rate_samples[chunk_size / 2];
+		decimate_newest_samples(sample_history, history_length, chunk_size, half_rate_samples);
+		write_to_mirrored_ring(sample_history_half_ring, history_length / 2, &sample_history_half_index, half_rate_samples, chunk_size / 2);
+		sample_history_half = &sample_history_half_ring[sample_history_half_index];
+
+		float quarter_rate_samples[chunk_size / 4];
+		decimate_newest_samples(sample_history_half, history_length / 2, chunk_size / 2, quarter_rate_samples);
+		write_to_mirrored_ring(sample_history_quarter_ring, history_length / 4, &sample_history_quarter_index, quarter_rate_samples, chunk_size / 4);
+		sample_history_quarter = &sample_history_quarter_ring[sample_history_quarter_index];
+	}
+
+	void clear_sample_history() {
+		memset(sample_history_ring, 0, sizeof(sample_history_ring));
+		sample_history_index = 0;
+		sample_history = sample_history_ring;
+
+		memset(sample_history_half_ring, 0, sizeof(sample_history_half_ring));
+		sample_history_half_index = 0;
+		sample_history_half = sample_history_half_ring;
+
+		memset(sample_history_quarter_ring, 0, sizeof(sample_history_quarter_ring));
+		sample_history_quarter_index = 0;
+		sample_history_quarter = sample_history_quarter_ring;
+	}
 
-			window_pos += window_step;
+	// Must run after init() has picked the constants
+	void init_sliding_dft() {
+		// A sliding DFT can only apply a window as a mix of neighboring bins, so we
+		// use the first two cosine terms of the Goertzel's gaussian window. This keeps
+		// its gain and about the same mainlobe width (a Hann window would be wider)
+		float window_sum = 0.0;
+		float window_cosine_sum = 0.0;
+		for (uint16_t i = 0; i < 4096; i++) {
+			window_sum += window_lookup[i];
+			window_cosine_sum += window_lookup[i] * cos((TWOPI * i) / 4096.0);
 		}
+		sliding_dft_window_center = window_sum / 4096.0;
+		sliding_dft_window_side = window_cosine_sum / 4096.0; // Half of the cosine term's amplitude
+
+		for (uint16_t i = 0; i < num_bins; i++) {
+			uint16_t block_size = constants->block_size[i];
+			float level_sample_rate = sample_rate >> constants->rate_level[i];
+			float k = (int)(0.5 + ((block_size * bins[i].target_freq) / level_sample_rate));
+
+			for (uint8_t r = 0; r < 3; r++) {
+				float w = (2.0 * PI * (k - 1 + r)) / block_size;
+				sliding_dft_rotation_real[i][r] = SLIDING_DFT_DAMPING * cos(w);
+				sliding_dft_rotation_imag[i][r] = SLIDING_DFT_DAMPING * sin(w);
+				sliding_dft_real[i][r] = 0.0;
+				sliding_dft_imag[i][r] = 0.0;
+			}
 
-		float magnitude_squared = (q1 * q1) + (q2 * q2) - q1 * q2 * coeff;
-		float magnitude = sqrt(magnitude_squared);
-		normalized_magnitude = magnitude_squared / (block_size / 2.0);
+			sliding_dft_comb_gain[i] = pow(SLIDING_DFT_DAMPING, block_size);
+		}
+	}
 
-		float progress = float(bin_number) / NUM_FREQS;
-		progress *= progress;
-		progress *= progress;
-		scale = (progress * 0.995) + 0.005;
+	// Must run after init() has picked the constants. Returns false if there's no memory for it
+	bool init_fft_constant_q() {
+		if (fft_constant_q == NULL) {
+			fft_constant_q = (fft_constant_q_state*)allocate_engine_buffer(sizeof(fft_constant_q_state));
+			if (fft_constant_q == NULL) {
+				printf("FFT CONSTANT Q: Can't allocate %u bytes!\n", (unsigned)sizeof(fft_constant_q_state));
+				return false;
+			}
+		}
 
-	}, __func__ );
+		init_fft_tables(fft_constant_q_size);
+
+		uint16_t num_kernel_values = 0;
+		for (uint16_t i = 0; i < num_bins; i++) {
+			fft_constant_q->kernel_start[i] = num_kernel_values;
+
+			// Kernels are always built at the full sample rate, with the same block, window
+			// and k as an undecimated Goertzel bin, and end on the same sample it does
+			uint8_t rate_level = constants->rate_level[i];
+			uint16_t block_size = constants->block_size[i] << rate_level;
+			float window_step = 4096.0 / block_size;
+			float k = (int)(0.5 + ((block_size * bins[i].target_freq) / sample_rate));
+			float w = (2.0 * PI * k) / block_size;
+
+			memset(fft_constant_q->buffer, 0, sizeof(fft_constant_q->buffer));
+			uint16_t block_start = fft_constant_q_size - block_size;
+			float window_pos = 0.0;
+			for (uint16_t n = 0; n < block_size; n++) {
+				float window = window_lookup[uint32_t(window_pos)];
+				fft_constant_q->buffer[(block_start + n) * 2 + 0] = window * cos(w * n);
+				fft_constant_q->buffer[(block_start + n) * 2 + 1] = window * sin(w * n);
+				window_pos += window_step;
+			}
 
-	return normalized_magnitude * scale;
-}
+			dsps_fft2r_fc32(fft_constant_q->buffer, fft_constant_q_size);
+			dsps_bit_rev_fc32(fft_constant_q->buffer, fft_constant_q_size);
 
-float collect_and_filter_noise(float input_magnitude, uint16_t bin) {
-	if (noise_calibration_active_frames_remaining == 0) {
-		float output_magnitude = input_magnitude - noise_spectrum[bin];
-		if (output_magnitude < 0.0) {
-			output_magnitude = 0.0;
+			float max_value = 0.0;
+			for (uint16_t f = 0; f < fft_constant_q_size; f++) {
+				float re = fft_constant_q->buffer[f * 2 + 0];
+				float im = fft_constant_q->buffer[f * 2 + 1];
+				max_value = max(max_value, re * re + im * im);
+			}
+
+			// Store conj(kernel) / fft_constant_q_size, so that by Parseval's theorem the sum of
+			// (spectrum * stored kernel) is the same as the Goertzel's windowed sum in time
+			float threshold = max_value * (FFT_CONSTANT_Q_THRESHOLD * FFT_CONSTANT_Q_THRESHOLD);
+			for (uint16_t f = 0; f < fft_constant_q_size; f++) {
+				float re = fft_constant_q->buffer[f * 2 + 0];
+				float im = fft_constant_q->buffer[f * 2 + 1];
+				if (re * re + im * im >= threshold) {
+					if (num_kernel_values >= fft_constant_q_max_kernel_values) {
+						printf("FFT CONSTANT Q: Out of kernel space at bin %u!\n", i);
+						break;
+					}
+
+					fft_constant_q->kernel_index[num_kernel_values] = f;
+					fft_constant_q->kernel_real[num_kernel_values] = re / fft_constant_q_size;
+					fft_constant_q->kernel_imag[num_kernel_values] = -im / fft_constant_q_size;
+					num_kernel_values++;
+				}
+			}
+
+			// Same scaling as an undecimated Goertzel bin
+			fft_constant_q->output_scale[i] = constants->output_scale[i] / float((1 << rate_level) * (1 << rate_level));
 		}
 
-		return output_magnitude;
+		fft_constant_q->kernel_start[num_bins] = num_kernel_values;
+		return true;
+	}
+
+	void free_fft_constant_q() {
+		heap_caps_free(fft_constant_q);
+		fft_constant_q = NULL;
 	}
-	else {
-		if (input_magnitude > noise_spectrum[bin]) {
-			noise_spectrum[bin] = input_magnitude*0.75;
+
+	// Switches calculate_magnitudes() to another engine, setting up whatever state it needs
+	void set_spectral_engine(spectral_engine new_engine) {
+		engine = new_engine;
+
+		if (engine != SPECTRAL_ENGINE_FFT_CONSTANT_Q) {
+			free_fft_constant_q();
 		}
 
-		return input_magnitude;
+		if (engine == SPECTRAL_ENGINE_SLIDING_DFT) {
+			init_sliding_dft();
+		}
+		else if (engine == SPECTRAL_ENGINE_FFT_CONSTANT_Q) {
+			if (init_fft_constant_q() == false) {
+				engine = SPECTRAL_ENGINE_GOERTZEL;
+			}
+		}
 	}
-}
 
-void calculate_magnitudes() {
-	profile_function([&]() {
-		magnitudes_locked = true;
+	void init_spectral_smoothing() {
+		magnitude_attack_coefficient = time_constant_to_coefficient(MAGNITUDE_ATTACK_MS, frame_interval_ms);
+		magnitude_release_coefficient = time_constant_to_coefficient(MAGNITUDE_RELEASE_MS, frame_interval_ms);
+		spectrogram_smooth_attack_coefficient = time_constant_to_coefficient(SPECTROGRAM_SMOOTH_ATTACK_MS, frame_interval_ms);
+		spectrogram_smooth_release_coefficient = time_constant_to_coefficient(SPECTROGRAM_SMOOTH_RELEASE_MS, frame_interval_ms);
+		autoranger_coefficient = time_constant_to_coefficient(AUTORANGER_TIME_CONSTANT_MS, frame_interval_ms);
+	}
 
-		const uint16_t NUM_AVERAGE_SAMPLES = 6;
+	// Picks the constants for decimation_enabled and (re)starts the engine
+	void init() {
+		if (decimation_enabled == true) {
+			constants = &constants_multi_rate;
+		}
+		else {
+			constants = &constants_full_rate;
+		}
 
-		static bool interlacing_frame_field = 0;
-		static float magnitudes_raw[NUM_FREQS];
-		static float magnitudes_avg[NUM_AVERAGE_SAMPLES][NUM_FREQS];
-		static float magnitudes_smooth[NUM_FREQS];
-		static float max_val_smooth = 0.0;
+		for (uint16_t i = 0; i < num_bins; i++) {
+			bins[i].target_freq = constants->target_freq[i];
+		}
 
-		static uint32_t iter = 0;
-		iter++;
+		// Block sizes may have changed, rebuild the active engine's state
+		set_spectral_engine(engine);
 
-		interlacing_frame_field = !interlacing_frame_field;
+		init_spectral_smoothing();
 
-		float max_val = 0.0;
-		// Iterate over all target frequencies
-		for (uint16_t i = 0; i < NUM_FREQS; i++) {
-			bool interlace_line = i % 2;
-			if (interlace_line == interlacing_frame_field) {
-				// Get raw magnitude of frequency
-				magnitudes_raw[i] = calculate_magnitude_of_bin(i);  // fast_mode enabled (downsampled audio)
-				magnitudes_raw[i] = collect_and_filter_noise(magnitudes_raw[i], i);
+		// calculate_magnitudes_of_bin_group() expects the bins of a group to have
+		// the same or shrinking block sizes, which is always true for rising frequencies
+		for (uint16_t i = 1; i < num_bins; i++) {
+			if (i % GOERTZEL_LANES != 0 && constants->block_size[i] > constants->block_size[i - 1]) {
+				printf("GOERTZEL: bin %u has a larger block size than bin %u!\n", i, i - 1);
+			}
+		}
+	}
+
+	// Original one-bin-at-a-time Goertzel, kept as the reference for calculate_magnitudes_of_bin_group()
+	float calculate_magnitude_of_bin(uint16_t bin_number) {
+		float normalized_magnitude;
+		float scale;
+
+		profile_function([&]() {
+			float q0 = 0;
+			float q1 = 0;
+			float q2 = 0;
+			float window_pos = 0.0;
+
+			const uint16_t block_size = constants->block_size[bin_number];
+			const uint16_t level_history_length = history_length >> constants->rate_level[bin_number];
+
+			float coeff = constants->coeff[bin_number];
+			float window_step = constants->window_step[bin_number];
+
+			float* sample_ptr = &get_sample_history(constants->rate_level[bin_number])[(level_history_length - 1) - block_size];
+
+			for (uint16_t i = 0; i < block_size; i++) {
+				float windowed_sample = sample_ptr[i] * window_lookup[uint32_t(window_pos)];
+				q0 = coeff * q1 - q2 + windowed_sample;
+				q2 = q1;
+				q1 = q0;
+
+				window_pos += window_step;
 			}
 
-			// Store raw magnitude
-			frequencies_musical[i].magnitude_full_scale = magnitudes_raw[i];
+			float magnitude_squared = (q1 * q1) + (q2 * q2) - q1 * q2 * coeff;
+			normalized_magnitude = (magnitude_squared * (1 << constants->rate_level[bin_number])) / (block_size / 2.0);
+
+			float progress = float(bin_number) / num_bins;
+			progress *= progress;
+			progress *= progress;
+			scale = (progress * 0.995) + 0.005;
 
-			// Add raw magnitude to moving average array
-			magnitudes_avg[iter % NUM_AVERAGE_SAMPLES][i] = magnitudes_raw[i];
+		}, __func__ );
+
+		return normalized_magnitude * scale;
+	}
 
-			// Sum up current moving average and divide
-			float magnitudes_avg_result = 0.0;
-			for (uint8_t a = 0; a < NUM_AVERAGE_SAMPLES; a++) {
-				magnitudes_avg_result += magnitudes_avg[a][i];
+	// Computes GOERTZEL_LANES neighboring bins at once, starting at first_bin.
+	// Every bin ends on the newest sample but longer blocks start earlier, so lanes
+	// join in one at a time as we reach the start of their block:
+	//
+	//   lane 0: |=========================|
+	//   lane 1:        |==================|
+	//   lane 2:            |==============|
+	//   lane 3:               |===========|
+	void calculate_magnitudes_of_bin_group(uint16_t first_bin, float magnitudes_out[GOERTZEL_LANES]) {
+		profile_function([&]() {
+			float coeff[GOERTZEL_LANES];
+			float q1[GOERTZEL_LANES] = { 0.0 };
+			float q2[GOERTZEL_LANES] = { 0.0 };
+			uint32_t window_step[GOERTZEL_LANES];
+			uint32_t window_pos[GOERTZEL_LANES] = { 0 };
+			uint16_t lane_start[GOERTZEL_LANES + 1];
+
+			// All lanes share a rate level
+			const float* history = get_sample_history(constants->rate_level[first_bin]);
+			const uint16_t level_history_length = history_length >> constants->rate_level[first_bin];
+
+			for (uint8_t lane = 0; lane < GOERTZEL_LANES; lane++) {
+				coeff[lane] = constants->coeff[first_bin + lane];
+				window_step[lane] = constants->window_step_fixed[first_bin + lane];
+				lane_start[lane] = (level_history_length - 1) - constants->block_size[first_bin + lane];
 			}
-			magnitudes_avg_result /= NUM_AVERAGE_SAMPLES;
+			lane_start[GOERTZEL_LANES] = level_history_length - 1;
 
-			// Store averaged value
-			magnitudes_smooth[i] = magnitudes_avg_result;
+			// Unrolled by hand for GOERTZEL_LANES == 4
+			advance_goertzel_lanes<1>(&history[lane_start[0]], lane_start[1] - lane_start[0], coeff, q1, q2, window_step, window_pos);
+			advance_goertzel_lanes<2>(&history[lane_start[1]], lane_start[2] - lane_start[1], coeff, q1, q2, window_step, window_pos);
+			advance_goertzel_lanes<3>(&history[lane_start[2]], lane_start[3] - lane_start[2], coeff, q1, q2, window_step, window_pos);
+			advance_goertzel_lanes<4>(&history[lane_start[3]], lane_start[4] - lane_start[3], coeff, q1, q2, window_step, window_pos);
 
-			// Accumulate maximum magnitude of all bins
-			if (magnitudes_smooth[i] > max_val) {
-				max_val = magnitudes_smooth[i];
+			for (uint8_t lane = 0; lane < GOERTZEL_LANES; lane++) {
+				float magnitude_squared = (q1[lane] * q1[lane]) + (q2[lane] * q2[lane]) - q1[lane] * q2[lane] * coeff[lane];
+				magnitudes_out[lane] = magnitude_squared * constants->output_scale[first_bin + lane];
 			}
-		}
+		}, __func__ );
+	}
+
+	// Slides a bin's window forward by the newest chunk of samples: each one is
+	// added while the sample that's now block_size old is removed. This costs the
+	// same for every bin no matter how long its window is, but it has to be called
+	// exactly once for every new chunk to stay in sync with the sample history.
+	float calculate_magnitude_of_bin_sliding_dft(uint16_t bin_number) {
+		float magnitude_squared;
+
+		profile_function([&]() {
+			const uint16_t block_size = constants->block_size[bin_number];
+			const float comb_gain = sliding_dft_comb_gain[bin_number];
+
+			// Decimated bins get fewer new samples per chunk
+			const uint8_t rate_level = constants->rate_level[bin_number];
+			const uint16_t num_new_samples = chunk_size >> rate_level;
+			const uint16_t level_history_length = history_length >> rate_level;
+
+			const float* newest_samples = &get_sample_history(rate_level)[level_history_length - num_new_samples];
+			const float* oldest_samples = newest_samples - block_size;
+
+			float real[3], imag[3], rotation_real[3], rotation_imag[3];
+			for (uint8_t r = 0; r < 3; r++) {
+				real[r] = sliding_dft_real[bin_number][r];
+				imag[r] = sliding_dft_imag[bin_number][r];
+				rotation_real[r] = sliding_dft_rotation_real[bin_number][r];
+				rotation_imag[r] = sliding_dft_rotation_imag[bin_number][r];
+			}
+
+			for (uint16_t n = 0; n < num_new_samples; n++) {
+				// Comb section, shared by all three resonators
+				float comb = newest_samples[n] - comb_gain * oldest_samples[n];
+
+				for (uint8_t r = 0; r < 3; r++) {
+					float new_real = comb + rotation_real[r] * real[r] - rotation_imag[r] * imag[r];
+					float new_imag = rotation_real[r] * imag[r] + rotation_imag[r] * real[r];
+					real[r] = new_real;
+					imag[r] = new_imag;
+				}
+			}
+
+			for (uint8_t r = 0; r < 3; r++) {
+				sliding_dft_real[bin_number][r] = real[r];
+				sliding_dft_imag[bin_number][r] = imag[r];
+			}
+
+			// Window applied in the frequency domain
+			float windowed_real = sliding_dft_window_center * real[1] + sliding_dft_window_side * (real[0] + real[2]);
+			float windowed_imag = sliding_dft_window_center * imag[1] + sliding_dft_window_side * (imag[0] + imag[2]);
 
-		if(noise_calibration_active_frames_remaining > 0){
-			// Not done yet? Decrement...
-			noise_calibration_active_frames_remaining -= 1;
-
-			// If background noise calibration just finished
-			if(noise_calibration_active_frames_remaining == 0){
-				// Let the UI know
-				broadcast("noise_cal_ready");
-				save_config();
-				save_noise_spectrum();
-				
+			magnitude_squared = (windowed_real * windowed_real) + (windowed_imag * windowed_imag);
+		}, __func__ );
+
+		return magnitude_squared * constants->output_scale[bin_number];
+	}
+
+	// One FFT of the newest fft_constant_q_size samples, then each bin is a short
+	// dot product of that spectrum with its sparse kernel
+	void calculate_magnitudes_fft_constant_q(float magnitudes_out[num_bins]) {
+		profile_function([&]() {
+			// Same samples as the Goertzel sees, the newest one is left out
+			const float* samples = &sample_history[(history_length - 1) - fft_constant_q_size];
+			for (uint16_t n = 0; n < fft_constant_q_size; n++) {
+				fft_constant_q->buffer[n * 2 + 0] = samples[n];
+				fft_constant_q->buffer[n * 2 + 1] = 0.0;
 			}
+
+			dsps_fft2r_fc32(fft_constant_q->buffer, fft_constant_q_size);
+			dsps_bit_rev_fc32(fft_constant_q->buffer, fft_constant_q_size);
+
+			for (uint16_t i = 0; i < num_bins; i++) {
+				float sum_real = 0.0;
+				float sum_imag = 0.0;
+				for (uint16_t v = fft_constant_q->kernel_start[i]; v < fft_constant_q->kernel_start[i + 1]; v++) {
+					const float* spectrum = &fft_constant_q->buffer[fft_constant_q->kernel_index[v] * 2];
+					sum_real += spectrum[0] * fft_constant_q->kernel_real[v] - spectrum[1] * fft_constant_q->kernel_imag[v];
+					sum_imag += spectrum[0] * fft_constant_q->kernel_imag[v] + spectrum[1] * fft_constant_q->kernel_real[v];
+				}
+
+				float magnitude_squared = (sum_real * sum_real) + (sum_imag * sum_imag);
+				magnitudes_out[i] = magnitude_squared * fft_constant_q->output_scale[i];
+			}
+		}, __func__ );
+	}
+
+	float collect_and_filter_noise(float input_magnitude, uint16_t bin) {
+		if (noise_spectrum == NULL) {
+			return input_magnitude;
 		}
 
-		// Smooth max_val with different speed limits for increases vs. decreases
-		if (max_val > max_val_smooth) {
-			float delta = max_val - max_val_smooth;
-			max_val_smooth += delta * 0.005;
+		if (noise_calibration_frames_remaining == 0) {
+			float output_magnitude = input_magnitude - noise_spectrum[bin];
+			if (output_magnitude < 0.0) {
+				output_magnitude = 0.0;
+			}
+
+			return output_magnitude;
 		}
-		if (max_val < max_val_smooth) {
-			float delta = max_val_smooth - max_val;
-			max_val_smooth -= delta * 0.005;
+		else {
+			if (input_magnitude > noise_spectrum[bin]) {
+				noise_spectrum[bin] = input_magnitude*0.75;
+			}
+
+			return input_magnitude;
 		}
+	}
 
-		// Set a minimum "floor" to auto-range for, below this we don't auto-range anymore
-		if (max_val_smooth < 0.000001) {
-			max_val_smooth = 0.000001;
+	void start_noise_calibration() {
+		if (noise_spectrum != NULL) {
+			memset(noise_spectrum, 0, sizeof(float) * num_bins);
+			noise_calibration_frames_remaining = NOISE_CALIBRATION_FRAMES;
 		}
+	}
 
-		// Calculate auto-ranging scale
-		float autoranger_scale = 1.0 / (max_val_smooth);
+	// Returns true on the frame that noise calibration finishes
+	bool calculate_magnitudes() {
+		bool noise_calibration_finished = false;
 
-		// Iterate over all frequencies
-		for (uint16_t i = 0; i < NUM_FREQS; i++) {
-			// Apply the auto-scaler
-			frequencies_musical[i].magnitude = clip_float(magnitudes_smooth[i] * autoranger_scale);
-			spectrogram[i] = frequencies_musical[i].magnitude;
-		}
+		profile_function([&]() {
 
-		spectrogram_average_index++;
-		if(spectrogram_average_index >= NUM_SPECTROGRAM_AVERAGE_SAMPLES){
-			spectrogram_average_index = 0;
-		}
+			// Get raw magnitudes of all frequencies
+			if (engine == SPECTRAL_ENGINE_SLIDING_DFT) {
+				for (uint16_t i = 0; i < num_bins; i++) {
+					magnitudes_raw[i] = calculate_magnitude_of_bin_sliding_dft(i);
+				}
+			}
+			else if (engine == SPECTRAL_ENGINE_FFT_CONSTANT_Q) {
+				calculate_magnitudes_fft_constant_q(magnitudes_raw);
+			}
+			else {
+				// GOERTZEL_LANES at a time
+				for (uint16_t i = 0; i < num_bins; i += GOERTZEL_LANES) {
+					calculate_magnitudes_of_bin_group(i, &magnitudes_raw[i]);
+				}
+			}
 
-		for(uint16_t i = 0; i < NUM_FREQS; i++){
-			spectrogram_average[spectrogram_average_index][i] = spectrogram[i];
+			float max_val = 0.0;
+			// Iterate over all target frequencies
+			for (uint16_t i = 0; i < num_bins; i++) {
+				magnitudes_raw[i] = collect_and_filter_noise(magnitudes_raw[i], i);
+
+				// Store raw magnitude
+				bins[i].magnitude_full_scale = magnitudes_raw[i];
+
+				// Smooth raw magnitude
+				magnitudes_smooth[i] = smooth_attack_release(magnitudes_smooth[i], magnitudes_raw[i], magnitude_attack_coefficient, magnitude_release_coefficient);
+
+				// Accumulate maximum magnitude of all bins
+				if (magnitudes_smooth[i] > max_val) {
+					max_val = magnitudes_smooth[i];
+				}
+			}
+
+			if(noise_calibration_frames_remaining > 0){
+				// Not done yet? Decrement...
+				noise_calibration_frames_remaining -= 1;
+				noise_calibration_finished = (noise_calibration_frames_remaining == 0);
+			}
+
+			// Smooth max_val
+			max_val_smooth = smooth_attack_release(max_val_smooth, max_val, autoranger_coefficient, autoranger_coefficient);
+
+			// Set a minimum "floor" to auto-range for, below this we don't auto-range anymore
+			if (max_val_smooth < 0.000001) {
+				max_val_smooth = 0.000001;
+			}
+
+			// Calculate auto-ranging scale
+			float autoranger_scale = 1.0 / (max_val_smooth);
 
-			spectrogram_smooth[i] = 0;
-			for(uint16_t a = 0; a < NUM_SPECTROGRAM_AVERAGE_SAMPLES; a++){
-				spectrogram_smooth[i] += spectrogram_average[a][i];
+			// Iterate over all frequencies
+			for (uint16_t i = 0; i < num_bins; i++) {
+				// Apply the auto-scaler
+				bins[i].magnitude = clip_float(magnitudes_smooth[i] * autoranger_scale);
+				spectrogram[i] = bins[i].magnitude;
 			}
-			spectrogram_smooth[i] /= float(NUM_SPECTROGRAM_AVERAGE_SAMPLES);
+
+			for(uint16_t i = 0; i < num_bins; i++){
+				spectrogram_smooth[i] = smooth_attack_release(spectrogram_smooth[i], spectrogram[i], spectrogram_smooth_attack_coefficient, spectrogram_smooth_release_coefficient);
+			}
+
+		}, __func__ );
+
+		return noise_calibration_finished;
+	}
+
+	// Folds the bins of every whole octave into 12 pitch classes. With quarter-steps
+	// every pitch class gets two bins per octave, with whole steps only every other
+	// pitch class gets any
+	void get_chromagram(){
+		static constexpr uint16_t bins_per_octave = 24 / note_step;
+		static constexpr uint16_t num_octaves = num_bins / bins_per_octave;
+		static constexpr float bins_per_pitch_class = num_octaves * constexpr_max(1, bins_per_octave / 12);
+
+		memset(chromagram, 0, sizeof(float) * 12);
+
+		float max_val = 0.2;
+		for(uint16_t i = 0; i < num_octaves * bins_per_octave; i++){
+			uint16_t pitch_class = ((i * note_step) / 2) % 12;
+			chromagram[ pitch_class ] += (spectrogram_smooth[i] / bins_per_pitch_class);
+
+			max_val = max(max_val, chromagram[ pitch_class ]);
 		}
 
-		magnitudes_locked = false;
-	}, __func__ );
+		float auto_scale = 1.0 / max_val;
+
+		for(uint16_t i = 0; i < 12; i++){
+			chromagram[i] *= auto_scale;
+		}
+	}
+};
+
+// ----------------------------------------------------------------------------------
+// The firmware's own analyzer, and the names the rest of the firmware knows its parts by
+
+typedef spectral_analyzer<NUM_FREQS, CHUNK_SIZE, SAMPLE_RATE, SAMPLE_HISTORY_LENGTH> musical_spectral_analyzer;
+musical_spectral_analyzer musical_analyzer;
+
+freq (&frequencies_musical)[NUM_FREQS] = musical_analyzer.bins;
+float (&spectrogram)[NUM_FREQS] = musical_analyzer.spectrogram;
+float (&spectrogram_smooth)[NUM_FREQS] = musical_analyzer.spectrogram_smooth;
+float (&chromagram)[12] = musical_analyzer.chromagram;
+float*& sample_history = musical_analyzer.sample_history;
+uint32_t& noise_calibration_active_frames_remaining = musical_analyzer.noise_calibration_frames_remaining;
+
+void init_goertzel_constants_musical() {
+	musical_analyzer.noise_spectrum = noise_spectrum;
+	musical_analyzer.init();
+}
+
+void calculate_magnitudes() {
+	bool noise_calibration_finished = musical_analyzer.calculate_magnitudes();
+
+	// If background noise calibration just finished, let the UI know and save it
+	// (from the web task, flash writes can take longer than an audio frame)
+	if (noise_calibration_finished == true) {
+		extern void queue_web_job(web_job job);
+		queue_web_job(WEB_JOB_NOISE_CALIBRATION_FINISHED);  // (web_core.h)
+	}
+
 	___();
 }
 
 void start_noise_calibration() {
 	Serial.println("Starting noise cal...");
-	memset(noise_spectrum, 0, sizeof(float) * NUM_FREQS);
 	configuration.vu_floor = 0.0;
-	noise_calibration_active_frames_remaining = NOISE_CALIBRATION_FRAMES;
+	musical_analyzer.start_noise_calibration();
 }
 
 void get_chromagram(){
-	memset(chromagram, 0, sizeof(float) * 12);
-
-	float max_val = 0.2;
-	for(uint16_t i = 0; i < 60; i++){
-		chromagram[ i % 12 ] += (spectrogram_smooth[i] / 5.0);
-
-		max_val = max(max_val, chromagram[ i % 12 ]);
-	}
-
-	float auto_scale = 1.0 / max_val;
-
-	for(uint16_t i = 0; i < 12; i++){
-		chromagram[i] *= auto_scale;
-	}
-}
\ No newline at end of file
+	musical_analyzer.get_chromagram();
+}
@@ -29,6 +29,9 @@ void run_gpu() {
 	// Save the current timestamp for next loop
 	t_last_us = t_now_us;
 
+	// Take the newest audio frame's results, if there's one
+	acquire_analysis_snapshot();  // (analysis.h)
+
 	// Update the novelty curve
 	update_novelty();  // (tempo.h)
 
@@ -39,24 +42,25 @@ void run_gpu() {
 	// ------------------------------------------------------------
 
 	clear_display();
-	lightshow_modes[configuration.current_mode].draw();
+	uint16_t current_mode = configuration.current_mode;
+	time_stage(NUM_PIPELINE_STAGES + current_mode, [&]() {
+		lightshow_modes[current_mode].draw();
+	}, lightshow_modes[current_mode].name);
 
 	// If silence is detected, show a blue debug LED
 	// leds[NUM_LEDS - 1] = add(leds[NUM_LEDS - 1], {0.0, 0.0, silence_level});
 
 	apply_background();
 
-	// Apply an incandescent LUT to reduce harsh blue tones
-	apply_blue_light_filter(configuration.blue_filter);  // (leds.h)
-
 	if( EMOTISCOPE_ACTIVE == true && configuration.screensaver == true){
 		run_screensaver();
 	}
 
-	// Restrict CRGBF values to 0.0-1.0 range
-	clip_leds();  // (leds.h)
-
-	apply_brightness();
+	// Apply an incandescent LUT to reduce harsh blue tones, restrict CRGBF
+	// values to 0.0-1.0 range and apply brightness, all in one pass
+	time_stage(STAGE_APPLY_COLOR_GRADE, [&]() {
+		apply_color_grade(configuration.blue_filter);  // (leds.h)
+	});
 
 	run_indicator_light();
 
@@ -86,20 +90,16 @@ void run_gpu() {
 	// The DMA and SIMD-style stuff inside the ESP32-S3 is some pretty crazy shit.
 	float lpf_cutoff_frequency = 0.5 + (1.0-(sqrt(configuration.softness)))*14.5;
 	lpf_cutoff_frequency = lpf_cutoff_frequency * (1.0 - lpf_drag) + 0.5 * lpf_drag;
-	apply_image_lpf(lpf_cutoff_frequency);
-
-	clip_leds();  // (leds.h)
-
-	// Apply white balance
-	multiply_CRGBF_array_by_LUT( leds, WHITE_BALANCE, NUM_LEDS );
 
-	// Quantize the image buffer with dithering, 
+	// Low pass filter, clip, white balance and quantize in one pass,
 	// output to the 8-bit LED strand
-	transmit_leds();
+	time_stage(STAGE_TRANSMIT_LEDS, [&]() {
+		transmit_leds(lpf_cutoff_frequency);  // (led_driver.h)
+	});
 
 	// Update the FPS_GPU variable
 	watch_gpu_fps();  // (system.h)
 
 	uint32_t t_end_cycles = ESP.getCycleCount();
-	volatile uint32_t gpu_total_cycles = t_end_cycles - t_start_cycles;
+	record_stage_cycles(STAGE_GPU_FRAME, t_end_cycles - t_start_cycles);
 }
\ No newline at end of file
@@ -0,0 +1,455 @@
+// ----------------------------------------------------------------------------------
+// kernel_benchmarks.h
+//
+// Times the hot kernels of the audio and LED pipelines one at a time, on the same
+// input for every run, and prints how the cycles per call are spread. Where a
+// kernel goes through esp-dsp, a plain scalar version of the same math is timed
+// next to it and the two outputs are checked against each other.
+//
+// On the device this runs at the end of run_benchmarks() (benchmarks.h). The same
+// suite is the env:native program in platformio.ini (src/native/), where dsps_*()
+// come from lib/native_shims and a "cycle" is a nanosecond.
+
+#define KERNEL_BENCHMARK_WARMUP ( 16 )        // Untimed runs first, so the caches have seen the code and data
+#define KERNEL_BENCHMARK_REPETITIONS ( 256 )  // Timed runs, one sample each
+
+uint32_t kernel_benchmark_samples[KERNEL_BENCHMARK_REPETITIONS];
+volatile float kernel_benchmark_sink = 0.0;  // Results land here so the compiler can't skip the work
+
+// Only kernel() is timed, setup() runs before every call to give it fresh input
+template <typename SetupFunc, typename KernelFunc>
+kernel_benchmark_stats time_kernel(const char* name, const char* path, SetupFunc setup, KernelFunc kernel, uint16_t repetitions = KERNEL_BENCHMARK_REPETITIONS) {
+	repetitions = min(repetitions, uint16_t(KERNEL_BENCHMARK_REPETITIONS));
+
+	for (uint16_t i = 0; i < KERNEL_BENCHMARK_WARMUP; i++) {
+		setup();
+		kernel();
+	}
+
+	uint64_t total_cycles = 0;
+	for (uint16_t i = 0; i < repetitions; i++) {
+		setup();
+		uint32_t t_start_cycles = ESP.getCycleCount();
+		kernel();
+		kernel_benchmark_samples[i] = ESP.getCycleCount() - t_start_cycles;
+		total_cycles += kernel_benchmark_samples[i];
+	}
+
+	qsort(kernel_benchmark_samples, repetitions, sizeof(uint32_t), compare_uint32);  // (stage_histograms.h)
+
+	kernel_benchmark_stats stats;
+	stats.min_cycles = kernel_benchmark_samples[0];
+	stats.median_cycles = kernel_benchmark_samples[(repetitions - 1) / 2];
+	stats.mean_cycles = float(total_cycles) / repetitions;
+	stats.p99_cycles = kernel_benchmark_samples[((repetitions - 1) * 99) / 100];
+	stats.max_cycles = kernel_benchmark_samples[repetitions - 1];
+
+	printf("%-38s %-7s | %8lu | %8lu | %10.1f | %8lu | %8lu | %9.2f\n", name, path, (unsigned long)stats.min_cycles, (unsigned long)stats.median_cycles, stats.mean_cycles, (unsigned long)stats.p99_cycles, (unsigned long)stats.max_cycles, stats.median_cycles / float(getCpuFrequencyMhz()));
+
+	return stats;
+}
+
+// Speed of a faster path relative to the reference, by their medians
+void print_kernel_comparison(const char* path, kernel_benchmark_stats reference, kernel_benchmark_stats candidate, const char* error_name, float error) {
+	printf("  -> %-7s %6.2fx the speed of the reference", path, reference.median_cycles / float(max(candidate.median_cycles, uint32_t(1))));
+	if (error_name != NULL) {
+		printf(", %s %.6f", error_name, error);
+	}
+	printf("\n");
+}
+
+float get_max_relative_error(const float* reference, const float* candidate, uint16_t length) {
+	float max_error = 0.0;
+	for (uint16_t i = 0; i < length; i++) {
+		max_error = max(max_error, fabsf(candidate[i] - reference[i]) / max(fabsf(reference[i]), 0.000001f));
+	}
+	return max_error;
+}
+
+// A fixed image with every channel somewhere in 0.0-1.0, different in every pixel
+void fill_kernel_benchmark_image(CRGBF* pixels, uint16_t num_pixels, uint8_t seed) {
+	for (uint16_t i = 0; i < num_pixels; i++) {
+		pixels[i].r = ((i * 7 + seed) % 17) / 16.0;
+		pixels[i].g = ((i * 11 + seed) % 23) / 22.0;
+		pixels[i].b = ((i * 13 + seed) % 29) / 28.0;
+	}
+}
+
+// ----------------------------------------------------------------------------------
+// SCALAR REFERENCES
+//
+// The esp-dsp kernels in leds.h written out as plain loops, the LED
+// post-processing as separate passes, like it was before it was fused, and
+// the RMT encoding a bit at a time, like the bytes encoder it replaced
+
+void multiply_CRGBF_array_by_LUT_scalar(CRGBF* input, CRGBF LUT, uint16_t array_length) {
+	for (uint16_t i = 0; i < array_length; i++) {
+		input[i].r *= LUT.r;
+		input[i].g *= LUT.g;
+		input[i].b *= LUT.b;
+	}
+}
+
+// One pass, where apply_image_lpf() makes two scales, an add and a copy
+void apply_image_lpf_scalar(float cutoff_frequency) {
+	float alpha = 1.0 - expf(-6.28318530718 * cutoff_frequency / FPS_GPU);
+	float alpha_inv = 1.0 - alpha;
+
+	for (uint16_t i = 0; i < NUM_LEDS; i++) {
+		leds[i].r = leds[i].r * alpha + leds_last[i].r * alpha_inv;
+		leds[i].g = leds[i].g * alpha + leds_last[i].g * alpha_inv;
+		leds[i].b = leds[i].b * alpha + leds_last[i].b * alpha_inv;
+	}
+
+	memcpy(leds_last, leds, sizeof(CRGBF) * NUM_LEDS);
+}
+
+// What run_gpu() (gpu_core.h) did with the image before apply_color_grade() and
+// post_process_leds(), one full pass over leds[] at a time
+void post_process_leds_unfused(float blue_filter_mix, float lpf_cutoff_frequency, bool temporal_dithering) {
+	apply_blue_light_filter(blue_filter_mix);
+	clip_leds();
+	apply_brightness();
+	apply_image_lpf(lpf_cutoff_frequency);
+	clip_leds();
+	multiply_CRGBF_array_by_LUT(leds, WHITE_BALANCE, NUM_LEDS);
+	quantize_color(temporal_dithering);
+}
+
+void expand_led_bytes_bitwise(const uint8_t* bytes, size_t num_bytes, rmt_symbol_word_t* symbols, rmt_symbol_word_t bit0, rmt_symbol_word_t bit1) {
+	for (size_t i = 0; i < num_bytes; i++) {
+		for (uint8_t bit = 0; bit < 8; bit++) {
+			if (bytes[i] & (0x80 >> bit)) {
+				symbols[(i << 3) + bit] = bit1;
+			}
+			else {
+				symbols[(i << 3) + bit] = bit0;
+			}
+		}
+	}
+}
+
+uint8_t get_max_byte_error(const uint8_t* reference, const uint8_t* candidate, uint16_t length) {
+	uint8_t max_error = 0;
+	for (uint16_t i = 0; i < length; i++) {
+		max_error = max(max_error, uint8_t(abs(int16_t(candidate[i]) - int16_t(reference[i]))));
+	}
+	return max_error;
+}
+
+// ----------------------------------------------------------------------------------
+// AUDIO KERNELS
+
+void benchmark_spectrum_kernels() {
+	for (uint16_t i = 0; i < CHUNK_SIZE * 64; i += CHUNK_SIZE) {
+		float new_samples[CHUNK_SIZE];
+		for (uint16_t n = 0; n < CHUNK_SIZE; n++) {
+			new_samples[n] = sin((i + n) * 0.05) * 0.25 + sin((i + n) * 0.71) * 0.25;
+		}
+		musical_analyzer.write_to_sample_history(new_samples);
+	}
+	if (musical_analyzer.init_fft_constant_q() == false) {
+		return;
+	}
+
+	float scalar_magnitudes[NUM_FREQS];
+	float lane_magnitudes[NUM_FREQS];
+	float fft_magnitudes[NUM_FREQS];
+
+	kernel_benchmark_stats scalar = time_kernel("calculate_magnitude_of_bin x64", "scalar", [](){}, [&]() {
+		for (uint16_t bin = 0; bin < NUM_FREQS; bin++) {
+			scalar_magnitudes[bin] = musical_analyzer.calculate_magnitude_of_bin(bin);
+		}
+	});
+
+	kernel_benchmark_stats lanes = time_kernel("calculate_magnitudes_of_bin_group x16", "lanes", [](){}, [&]() {
+		for (uint16_t bin = 0; bin < NUM_FREQS; bin += GOERTZEL_LANES) {
+			musical_analyzer.calculate_magnitudes_of_bin_group(bin, &lane_magnitudes[bin]);
+		}
+	});
+
+	kernel_benchmark_stats fft = time_kernel("calculate_magnitudes_fft_constant_q", "esp-dsp", [](){}, [&]() {
+		musical_analyzer.calculate_magnitudes_fft_constant_q(fft_magnitudes);
+	});
+
+	// The FFT's bins are only close to the Goertzel's, so they're compared as a whole
+	float error_sum = 0.0;
+	float reference_sum = 0.0;
+	for (uint16_t bin = 0; bin < NUM_FREQS; bin++) {
+		float error = fft_magnitudes[bin] - scalar_magnitudes[bin];
+		error_sum += error * error;
+		reference_sum += scalar_magnitudes[bin] * scalar_magnitudes[bin];
+	}
+
+	print_kernel_comparison("lanes", scalar, lanes, "max relative error", get_max_relative_error(scalar_magnitudes, lane_magnitudes, NUM_FREQS));
+	print_kernel_comparison("esp-dsp", scalar, fft, "relative RMS error", sqrt(error_sum / max(reference_sum, 0.000001f)));
+
+	if (musical_analyzer.engine != SPECTRAL_ENGINE_FFT_CONSTANT_Q) {
+		musical_analyzer.free_fft_constant_q();
+	}
+	musical_analyzer.clear_sample_history();
+}
+
+void benchmark_tempo_kernels() {
+	for (uint16_t i = 0; i < NOVELTY_HISTORY_LENGTH; i++) {
+		log_novelty(fabs(sin(i * 0.25)));
+		log_vu(fabs(sin(i * 0.25)));
+	}
+	normalize_novelty_curve();
+	if (init_tempo_autocorrelation() == false) {
+		return;
+	}
+
+	// A whole tempogram per call, so fewer runs
+	kernel_benchmark_stats scalar = time_kernel("calculate_magnitude_of_tempo x64", "scalar", [](){}, [&]() {
+		float magnitude_sum = 0.0;
+		for (uint16_t bin = 0; bin < NUM_TEMPI; bin++) {
+			magnitude_sum += calculate_magnitude_of_tempo(bin);
+		}
+		kernel_benchmark_sink = magnitude_sum;
+	}, KERNEL_BENCHMARK_REPETITIONS / 8);
+
+	kernel_benchmark_stats autocorrelation = time_kernel("calculate_tempi_autocorrelation", "esp-dsp", [](){}, [&]() {
+		calculate_tempi_autocorrelation();
+	}, KERNEL_BENCHMARK_REPETITIONS / 8);
+
+	// Different estimators of the same thing, there's nothing to check them against
+	print_kernel_comparison("esp-dsp", scalar, autocorrelation, NULL, 0.0);
+
+	if (active_tempo_engine != TEMPO_ENGINE_AUTOCORRELATION) {
+		free_tempo_autocorrelation();
+	}
+	clear_tempo_history();
+}
+
+void benchmark_median_filter() {
+	float column[NUM_FREQS];
+	float filtered[NUM_FREQS];
+	for (uint16_t i = 0; i < NUM_FREQS; i++) {
+		column[i] = fabs(sin(i * 0.9) * sin(i * 0.13));
+	}
+
+	time_kernel("median_filter", "scalar", [&]() {
+		memcpy(filtered, column, sizeof(column));
+	}, [&]() {
+		median_filter(filtered);
+	});
+}
+
+// ----------------------------------------------------------------------------------
+// LED KERNELS
+
+void benchmark_hsv() {
+	CRGBF reference[NUM_LEDS];
+	CRGBF colors[NUM_LEDS];
+
+	kernel_benchmark_stats scalar = time_kernel("hsv x128", "scalar", [](){}, [&]() {
+		for (uint16_t i = 0; i < NUM_LEDS; i++) {
+			float progress = float(i) / NUM_LEDS;
+			reference[i] = hsv(0.1 + progress * 0.7, 0.85, progress);
+		}
+	});
+
+	// The same gradient, as modes draw it now
+	config saved_configuration = configuration;
+	configuration.color = 0.1;
+	configuration.color_range = 0.7;
+	configuration.saturation = 0.85;
+	configuration.mirror_mode = false;
+
+	kernel_benchmark_stats cached = time_kernel("get_palette_color x128", "palette", [](){}, [&]() {
+		const color_palette* palette = get_palette();
+		for (uint16_t i = 0; i < NUM_LEDS; i++) {
+			colors[i] = get_palette_color(palette, i, float(i) / NUM_LEDS);
+		}
+	});
+
+	print_kernel_comparison("palette", scalar, cached, "max relative error", get_max_relative_error((float*)reference, (float*)colors, NUM_LEDS * 3));
+
+	// What a settings change costs, once
+	time_kernel("get_palette, rebuilt", "palette", [&]() {
+		palette_cache.built = false;
+	}, [&]() {
+		get_palette();
+	});
+
+	configuration = saved_configuration;
+}
+
+void benchmark_apply_box_blur() {
+	time_kernel("apply_box_blur, kernel 13", "scalar", [&]() {
+		fill_kernel_benchmark_image(leds, NUM_LEDS, 0);
+	}, [&]() {
+		apply_box_blur(leds, NUM_LEDS, 13);
+	});
+}
+
+void benchmark_quantize_color() {
+	time_kernel("quantize_color, temporal dithering", "scalar", [&]() {
+		fill_kernel_benchmark_image(leds, NUM_LEDS, 0);
+	}, [&]() {
+		quantize_color(true);
+	});
+
+	time_kernel("quantize_color", "scalar", [&]() {
+		fill_kernel_benchmark_image(leds, NUM_LEDS, 0);
+	}, [&]() {
+		quantize_color(false);
+	});
+}
+
+void benchmark_multiply_CRGBF_array_by_LUT() {
+	CRGBF reference[NUM_LEDS];
+	CRGBF pixels[NUM_LEDS];
+
+	kernel_benchmark_stats scalar = time_kernel("multiply_CRGBF_array_by_LUT", "scalar", [&]() {
+		fill_kernel_benchmark_image(reference, NUM_LEDS, 0);
+	}, [&]() {
+		multiply_CRGBF_array_by_LUT_scalar(reference, WHITE_BALANCE, NUM_LEDS);
+	});
+
+	kernel_benchmark_stats dsp = time_kernel("multiply_CRGBF_array_by_LUT", "esp-dsp", [&]() {
+		fill_kernel_benchmark_image(pixels, NUM_LEDS, 0);
+	}, [&]() {
+		multiply_CRGBF_array_by_LUT(pixels, WHITE_BALANCE, NUM_LEDS);
+	});
+
+	print_kernel_comparison("esp-dsp", scalar, dsp, "max relative error", get_max_relative_error((float*)reference, (float*)pixels, NUM_LEDS * 3));
+}
+
+void benchmark_apply_image_lpf() {
+	// It's in terms of the GPU frame rate, which nothing has measured yet at boot
+	float fps_gpu = FPS_GPU;
+	FPS_GPU = REFERENCE_FPS;
+
+	const float cutoff_frequency = 5.0;
+	CRGBF reference[NUM_LEDS];
+
+	kernel_benchmark_stats scalar = time_kernel("apply_image_lpf", "scalar", [&]() {
+		fill_kernel_benchmark_image(leds, NUM_LEDS, 0);
+		fill_kernel_benchmark_image(leds_last, NUM_LEDS, 5);
+	}, [&]() {
+		apply_image_lpf_scalar(cutoff_frequency);
+	});
+	memcpy(reference, leds, sizeof(CRGBF) * NUM_LEDS);
+
+	kernel_benchmark_stats dsp = time_kernel("apply_image_lpf", "esp-dsp", [&]() {
+		fill_kernel_benchmark_image(leds, NUM_LEDS, 0);
+		fill_kernel_benchmark_image(leds_last, NUM_LEDS, 5);
+	}, [&]() {
+		apply_image_lpf(cutoff_frequency);
+	});
+
+	print_kernel_comparison("esp-dsp", scalar, dsp, "max relative error", get_max_relative_error((float*)reference, (float*)leds, NUM_LEDS * 3));
+
+	FPS_GPU = fps_gpu;
+}
+
+void benchmark_led_post_processing() {
+	float fps_gpu = FPS_GPU;
+	FPS_GPU = REFERENCE_FPS;
+
+	const float blue_filter_mix = 0.5;
+	const float cutoff_frequency = 5.0;
+	uint8_t reference[NUM_LEDS * 3];
+
+	// Overexposed, so both clips have something to do
+	auto setup = [&]() {
+		fill_kernel_benchmark_image(leds, NUM_LEDS, 0);
+		scale_CRGBF_array_by_constant(leds, 1.5, NUM_LEDS);
+		fill_kernel_benchmark_image(leds_last, NUM_LEDS, 5);
+		dither_step = 0;
+	};
+
+	kernel_benchmark_stats unfused = time_kernel("LED post-processing", "passes", setup, [&]() {
+		post_process_leds_unfused(blue_filter_mix, cutoff_frequency, true);
+	});
+	memcpy(reference, raw_led_data, NUM_LEDS * 3);
+
+	kernel_benchmark_stats fused = time_kernel("LED post-processing", "fused", setup, [&]() {
+		apply_color_grade(blue_filter_mix);
+		post_process_leds(cutoff_frequency, true);
+	});
+
+	print_kernel_comparison("fused", unfused, fused, "max 8-bit error", get_max_byte_error(reference, raw_led_data, NUM_LEDS * 3));
+
+	FPS_GPU = fps_gpu;
+}
+
+// One channel's half of a frame, bytes to RMT symbols
+void benchmark_led_encoder() {
+	const size_t num_bytes = (NUM_LEDS >> 1) * 3;
+	static uint8_t bytes[num_bytes];
+	static rmt_symbol_word_t reference[num_bytes * 8];
+	static rmt_symbol_word_t symbols[num_bytes * 8];
+
+	for (size_t i = 0; i < num_bytes; i++) {
+		bytes[i] = uint8_t(i * 37 + 11);
+	}
+
+	kernel_benchmark_stats bitwise = time_kernel("expand_led_bytes", "bitwise", [](){}, [&]() {
+		expand_led_bytes_bitwise(bytes, num_bytes, reference, led_nibble_symbols[0][0], led_nibble_symbols[15][0]);
+	});
+
+	kernel_benchmark_stats table = time_kernel("expand_led_bytes", "table", [](){}, [&]() {
+		expand_led_bytes(bytes, num_bytes, symbols);
+	});
+
+	uint16_t wrong_symbols = 0;
+	for (size_t i = 0; i < num_bytes * 8; i++) {
+		wrong_symbols += (symbols[i].val != reference[i].val);
+	}
+	print_kernel_comparison("table", bitwise, table, "wrong symbols", wrong_symbols);
+}
+
+// ----------------------------------------------------------------------------------
+// LIGHTSHOW MODES
+
+// Every mode's whole draw(), on whatever analysis_snapshot is current
+void benchmark_lightshow_modes() {
+	extern const uint16_t NUM_LIGHTSHOW_MODES;  // (lightshow_modes.h)
+	bool mirror_mode = configuration.mirror_mode;
+
+	for (uint8_t mirrored = 0; mirrored < 2; mirrored++) {
+		configuration.mirror_mode = mirrored;
+		for (uint16_t mode = 0; mode < NUM_LIGHTSHOW_MODES; mode++) {
+			char name[40];
+			snprintf(name, 40, "draw_%s", lightshow_modes[mode].name);
+
+			time_kernel(name, (mirrored == true) ? "mirror" : "plain", [](){
+				clear_display();
+			}, [&]() {
+				lightshow_modes[mode].draw();
+			});
+		}
+	}
+
+	configuration.mirror_mode = mirror_mode;
+}
+
+// ----------------------------------------------------------------------------------
+
+void run_kernel_benchmarks() {
+	printf("# KERNEL BENCHMARKS ##############\n");
+	printf("%u warmup + %u timed runs each, cycles per call at %luMHz\n", KERNEL_BENCHMARK_WARMUP, KERNEL_BENCHMARK_REPETITIONS, (unsigned long)getCpuFrequencyMhz());
+	printf("%-38s %-7s | %8s | %8s | %10s | %8s | %8s | %9s\n", "KERNEL", "PATH", "MIN", "MEDIAN", "MEAN", "P99", "MAX", "MEDIAN US");
+
+	benchmark_spectrum_kernels();
+	benchmark_tempo_kernels();
+	benchmark_median_filter();
+	benchmark_hsv();
+	benchmark_apply_box_blur();
+	benchmark_quantize_color();
+	benchmark_multiply_CRGBF_array_by_LUT();
+	benchmark_apply_image_lpf();
+	benchmark_led_post_processing();
+	benchmark_led_encoder();
+	benchmark_lightshow_modes();
+
+	// Leave a black screen behind
+	memset(leds, 0, sizeof(CRGBF) * NUM_LEDS);
+	memset(leds_last, 0, sizeof(CRGBF) * NUM_LEDS);
+	memset(led_output_buffers, 0, sizeof(led_output_buffers));
+
+	printf("##################################\n\n");
+}
@@ -1,5 +1,6 @@
 #include <driver/rmt_tx.h>
 #include <driver/rmt_encoder.h>
+#include <freertos/semphr.h>
 #include <esp_check.h>
 #include <esp_log.h>
 
@@ -9,11 +10,35 @@
 // It won't void any kind of stupid warranty, but things will *definitely* break at this point if you change this number.
 #define NUM_LEDS ( 128 )
 
+// How many frames of 8-bit output can be in flight. With 2, one is on the wire
+// while the next is quantized, and transmit_leds() only waits if the RMT is a
+// whole frame behind. 1 is how it used to be: wait until the last frame is out.
+#define LED_OUTPUT_BUFFERS ( 2 )
+#define LED_DONE_HISTORY ( 4 ) // Frame completion times kept per channel, for the single buffer wait
+
+static_assert(LED_OUTPUT_BUFFERS >= 1 && LED_OUTPUT_BUFFERS < LED_DONE_HISTORY, "LED_OUTPUT_BUFFERS must be 1 to 3");
+
+// WS2812 bits plus the reset code, for half of the LEDs
+#define LED_SYMBOLS_PER_CHANNEL ( (NUM_LEDS >> 1) * 24 + 1 )
+
 // 32-bit color input
 extern CRGBF leds[NUM_LEDS];
+extern CRGBF leds_last[NUM_LEDS];
+extern CRGBF WHITE_BALANCE;
 
 // 8-bit color output
-static uint8_t raw_led_data[NUM_LEDS*3];
+static uint8_t led_output_buffers[LED_OUTPUT_BUFFERS][NUM_LEDS*3];
+uint8_t* raw_led_data = led_output_buffers[0];  // The one post_process_leds() writes next
+uint32_t led_frames_queued = 0;
+
+// One count per output buffer each channel is done with, given back by
+// on_led_frame_done() as the RMT finishes sending it
+SemaphoreHandle_t led_buffers_free[2];
+volatile uint32_t led_frames_done[2] = { 0, 0 };
+volatile uint32_t led_frame_done_us[2][LED_DONE_HISTORY];
+
+// Every nibble as the four symbols it's sent as, most significant bit first
+rmt_symbol_word_t led_nibble_symbols[16][4];
 
 rmt_channel_handle_t tx_chan_a = NULL;
 rmt_channel_handle_t tx_chan_b = NULL;
@@ -22,10 +47,10 @@ rmt_encoder_handle_t led_encoder_b = NULL;
 
 typedef struct {
     rmt_encoder_t base;
-    rmt_encoder_t *bytes_encoder;
     rmt_encoder_t *copy_encoder;
     int state;
-    rmt_symbol_word_t reset_code;
+    size_t num_symbols;
+    rmt_symbol_word_t symbols[LED_SYMBOLS_PER_CHANNEL];  // This channel's frame, reset code included
 } rmt_led_strip_encoder_t;
 
 rmt_led_strip_encoder_t strip_encoder_a;
@@ -42,27 +67,34 @@ typedef struct {
 
 static const char *TAG = "led_encoder";
 
+// Two table lookups per byte, where the bytes encoder tests and branches on all 8 bits
+IRAM_ATTR void expand_led_bytes(const uint8_t* bytes, size_t num_bytes, rmt_symbol_word_t* symbols) {
+	for (size_t i = 0; i < num_bytes; i++) {
+		memcpy(symbols,     led_nibble_symbols[bytes[i] >> 4],   sizeof(led_nibble_symbols[0]));
+		memcpy(symbols + 4, led_nibble_symbols[bytes[i] & 0x0F], sizeof(led_nibble_symbols[0]));
+		symbols += 8;
+	}
+}
+
+// The whole frame is expanded into symbols up front, then fed to the RMT
+// memory block by the copy encoder, a block at a time
 IRAM_ATTR static size_t rmt_encode_led_strip(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data, size_t data_size, rmt_encode_state_t *ret_state){
     rmt_led_strip_encoder_t *led_encoder = __containerof(encoder, rmt_led_strip_encoder_t, base);
-    rmt_encoder_handle_t bytes_encoder = led_encoder->bytes_encoder;
     rmt_encoder_handle_t copy_encoder = led_encoder->copy_encoder;
     rmt_encode_state_t session_state = RMT_ENCODING_RESET;
     rmt_encode_state_t state = RMT_ENCODING_RESET;
     size_t encoded_symbols = 0;
     switch (led_encoder->state) {
-    case 0: // send RGB data
-        encoded_symbols += bytes_encoder->encode(bytes_encoder, channel, primary_data, data_size, &session_state);
-        if (session_state & RMT_ENCODING_COMPLETE) {
-            led_encoder->state = 1; // switch to next state when current encoding session finished
-        }
-        if (session_state & RMT_ENCODING_MEM_FULL) {
-            state = (rmt_encode_state_t)(state | (uint32_t)RMT_ENCODING_MEM_FULL);
-            goto out; // yield if there's no free space for encoding artifacts
-        }
+    case 0: // expand RGB data, reset code is already at the end
+        data_size = min(data_size, size_t(LED_SYMBOLS_PER_CHANNEL - 1) >> 3);
+        expand_led_bytes((const uint8_t*)primary_data, data_size, led_encoder->symbols);
+        led_encoder->symbols[data_size << 3] = led_encoder->symbols[LED_SYMBOLS_PER_CHANNEL - 1];
+        led_encoder->num_symbols = (data_size << 3) + 1;
+        led_encoder->state = 1;
     // fall-through
-    case 1: // send reset code
-        encoded_symbols += copy_encoder->encode(copy_encoder, channel, &led_encoder->reset_code,
-                                                sizeof(led_encoder->reset_code), &session_state);
+    case 1: // send symbols
+        encoded_symbols += copy_encoder->encode(copy_encoder, channel, led_encoder->symbols,
+                                                led_encoder->num_symbols * sizeof(rmt_symbol_word_t), &session_state);
         if (session_state & RMT_ENCODING_COMPLETE) {
             led_encoder->state = RMT_ENCODING_RESET; // back to the initial encoding session
 			state = (rmt_encode_state_t)(state | (uint32_t)RMT_ENCODING_COMPLETE);
@@ -79,15 +111,12 @@ out:
 
 static esp_err_t rmt_del_led_strip_encoder(rmt_encoder_t *encoder){
     rmt_led_strip_encoder_t *led_encoder = __containerof(encoder, rmt_led_strip_encoder_t, base);
-    rmt_del_encoder(led_encoder->bytes_encoder);
     rmt_del_encoder(led_encoder->copy_encoder);
-    free(led_encoder);
     return ESP_OK;
 }
 
 static esp_err_t rmt_led_strip_encoder_reset(rmt_encoder_t *encoder){
     rmt_led_strip_encoder_t *led_encoder = __containerof(encoder, rmt_led_strip_encoder_t, base);
-    rmt_encoder_reset(led_encoder->bytes_encoder);
     rmt_encoder_reset(led_encoder->copy_encoder);
     led_encoder->state = RMT_ENCODING_RESET;
     return ESP_OK;
@@ -105,26 +134,40 @@ esp_err_t rmt_new_led_strip_encoder(const led_strip_encoder_config_t *config, rm
     strip_encoder_b.base.reset  = rmt_led_strip_encoder_reset;
 
     // different led strip might have its own timing requirements, following parameter is for WS2812
-    rmt_bytes_encoder_config_t bytes_encoder_config = {
-        .bit0 = { 4, 1, 6, 0 },
-        .bit1 = { 7, 1, 6, 0 },
-		.flags = { .msb_first = 1 }
-    };
-    
-	rmt_new_bytes_encoder(&bytes_encoder_config, &strip_encoder_a.bytes_encoder);
-	rmt_new_bytes_encoder(&bytes_encoder_config, &strip_encoder_b.bytes_encoder);
+    rmt_symbol_word_t bit0 = { 4, 1, 6, 0 };
+    rmt_symbol_word_t bit1 = { 7, 1, 6, 0 };
+    for (uint8_t nibble = 0; nibble < 16; nibble++) {
+        for (uint8_t bit = 0; bit < 4; bit++) {
+            led_nibble_symbols[nibble][bit] = (nibble & (0x08 >> bit)) ? bit1 : bit0;
+        }
+    }
+
     rmt_copy_encoder_config_t copy_encoder_config = {};
     rmt_new_copy_encoder(&copy_encoder_config, &strip_encoder_a.copy_encoder);
 	rmt_new_copy_encoder(&copy_encoder_config, &strip_encoder_b.copy_encoder);
 
-    strip_encoder_a.reset_code = (rmt_symbol_word_t) { 250, 0, 250, 0 };
-    strip_encoder_b.reset_code = (rmt_symbol_word_t) { 250, 0, 250, 0 };
+    strip_encoder_a.symbols[LED_SYMBOLS_PER_CHANNEL - 1] = (rmt_symbol_word_t) { 250, 0, 250, 0 };
+    strip_encoder_b.symbols[LED_SYMBOLS_PER_CHANNEL - 1] = (rmt_symbol_word_t) { 250, 0, 250, 0 };
+    strip_encoder_a.state = RMT_ENCODING_RESET;
+    strip_encoder_b.state = RMT_ENCODING_RESET;
 
     *ret_encoder_a = &strip_encoder_a.base;
     *ret_encoder_b = &strip_encoder_b.base;
     return ESP_OK;
 }
 
+// A channel finished sending a frame, so it's done with that output buffer
+IRAM_ATTR static bool on_led_frame_done(rmt_channel_handle_t channel, const rmt_tx_done_event_data_t* event, void* user_ctx) {
+	uint8_t channel_index = (uint8_t)(uintptr_t)user_ctx;
+	uint32_t frame = led_frames_done[channel_index];
+	led_frame_done_us[channel_index][frame % LED_DONE_HISTORY] = micros();
+	led_frames_done[channel_index] = frame + 1;
+
+	BaseType_t task_woken = pdFALSE;
+	xSemaphoreGiveFromISR(led_buffers_free[channel_index], &task_woken);
+	return (task_woken == pdTRUE);
+}
+
 void init_rmt_driver() {
 	printf("init_rmt_driver\n");
 	rmt_tx_channel_config_t tx_chan_a_config = {
@@ -153,6 +196,15 @@ void init_rmt_driver() {
 	ESP_ERROR_CHECK(rmt_new_tx_channel(&tx_chan_a_config, &tx_chan_a));
 	ESP_ERROR_CHECK(rmt_new_tx_channel(&tx_chan_b_config, &tx_chan_b));
 
+	led_buffers_free[0] = xSemaphoreCreateCounting(LED_OUTPUT_BUFFERS, LED_OUTPUT_BUFFERS);
+	led_buffers_free[1] = xSemaphoreCreateCounting(LED_OUTPUT_BUFFERS, LED_OUTPUT_BUFFERS);
+
+	rmt_tx_event_callbacks_t tx_callbacks = {
+		.on_trans_done = on_led_frame_done,
+	};
+	ESP_ERROR_CHECK(rmt_tx_register_event_callbacks(tx_chan_a, &tx_callbacks, (void*)0));
+	ESP_ERROR_CHECK(rmt_tx_register_event_callbacks(tx_chan_b, &tx_callbacks, (void*)1));
+
 	ESP_LOGI(TAG, "Install led strip encoder");
     led_strip_encoder_config_t encoder_config = {
         .resolution = 10000000,
@@ -165,10 +217,11 @@ void init_rmt_driver() {
 	ESP_ERROR_CHECK(rmt_enable(tx_chan_b));
 }
 
+const float dither_table[4] = {0.25, 0.50, 0.75, 1.00};
+uint8_t dither_step = 0;
+
 void quantize_color(bool temporal_dithering) {
 	if(temporal_dithering == true){
-		const float dither_table[4] = {0.25, 0.50, 0.75, 1.00};
-		static uint8_t dither_step = 0;
 		dither_step++;
 
 		float decimal_r; float decimal_g; float decimal_b;
@@ -204,24 +257,126 @@ void quantize_color(bool temporal_dithering) {
 	}
 }
 
-IRAM_ATTR void transmit_leds() {
-	// Wait here if previous frame transmission has not yet completed
-	rmt_tx_wait_all_done(tx_chan_a, portMAX_DELAY);
-	rmt_tx_wait_all_done(tx_chan_b, portMAX_DELAY);
+// apply_image_lpf(), clip_leds(), white balance and quantize_color() in one pass
+// over leds[], straight into raw_led_data. leds_last keeps the filtered image
+// from before clipping, like apply_image_lpf() left it.
+//
+// Without dithering quantize_color() truncates, which is a threshold of 1.0
+// that no fraction reaches, so both cases share the same loop.
+IRAM_ATTR void post_process_leds(float lpf_cutoff_frequency, bool temporal_dithering) {
+	float alpha = 1.0 - expf(-6.28318530718 * lpf_cutoff_frequency / FPS_GPU);
+	float alpha_inv = 1.0 - alpha;
+
+	float full_scale = 255.0;
+	float dither_threshold = 1.0;
+	if(temporal_dithering == true){
+		dither_step++;
+		full_scale = 254.0;
+		dither_threshold = dither_table[dither_step % 4];
+	}
+
+	for (uint16_t i = 0; i < NUM_LEDS; i++) {
+		CRGBF filtered = {
+			leds[i].r * alpha + leds_last[i].r * alpha_inv,
+			leds[i].g * alpha + leds_last[i].g * alpha_inv,
+			leds[i].b * alpha + leds_last[i].b * alpha_inv,
+		};
+		leds_last[i] = filtered;
+
+		float decimal_r = clip_float(filtered.r) * WHITE_BALANCE.r * full_scale;
+		float decimal_g = clip_float(filtered.g) * WHITE_BALANCE.g * full_scale;
+		float decimal_b = clip_float(filtered.b) * WHITE_BALANCE.b * full_scale;
+
+		uint8_t whole_r = decimal_r;
+		uint8_t whole_g = decimal_g;
+		uint8_t whole_b = decimal_b;
+
+		raw_led_data[3*i+1] = whole_r + ((decimal_r - whole_r) >= dither_threshold);
+		raw_led_data[3*i+0] = whole_g + ((decimal_g - whole_g) >= dither_threshold);
+		raw_led_data[3*i+2] = whole_b + ((decimal_b - whole_b) >= dither_threshold);
+	}
+}
+
+// What transmit_leds() would have waited with one output buffer: from getting
+// here until the last frame was out on both channels. That's only known once
+// it is, which can be a frame or two later, so a frame whose wait is still
+// open when the next one arrives goes unmeasured.
+bool single_buffer_wait_open = false;
+uint32_t single_buffer_wait_frame;     // Waiting on the frame before this one
+uint32_t single_buffer_wait_start_us;
+
+bool led_frame_is_out(uint32_t frame) {
+	return led_frames_done[0] > frame && led_frames_done[1] > frame;
+}
+
+void close_single_buffer_wait() {
+	if (single_buffer_wait_open == true && led_frame_is_out(single_buffer_wait_frame - 1) == true) {
+		uint32_t slot = (single_buffer_wait_frame - 1) % LED_DONE_HISTORY;
+		int32_t wait_us = max(
+			int32_t(led_frame_done_us[0][slot] - single_buffer_wait_start_us),
+			int32_t(led_frame_done_us[1][slot] - single_buffer_wait_start_us)
+		);
+		record_stage_cycles(STAGE_SINGLE_BUFFER_WAIT, max(wait_us, int32_t(0)) * getCpuFrequencyMhz());  // (stage_histograms.h)
+		single_buffer_wait_open = false;
+	}
+}
+
+void measure_single_buffer_wait(bool last_frame_was_out, uint32_t start_us) {
+	close_single_buffer_wait();  // An earlier frame's
+
+	if (single_buffer_wait_open == false && led_frames_queued > 0) {
+		if (last_frame_was_out == true) {
+			record_stage_cycles(STAGE_SINGLE_BUFFER_WAIT, 0);
+		}
+		else {
+			single_buffer_wait_open = true;
+			single_buffer_wait_frame = led_frames_queued;
+			single_buffer_wait_start_us = start_us;
+		}
+	}
+
+	close_single_buffer_wait();  // This one's, if waiting for a free buffer took that long anyway
+}
+
+IRAM_ATTR void transmit_leds(float lpf_cutoff_frequency) {
+	uint32_t t_arrived_us = micros();
+	bool last_frame_was_out = (led_frames_queued == 0) || led_frame_is_out(led_frames_queued - 1);
 
-	// Clear the 8-bit buffer	
-	memset(raw_led_data, 0, NUM_LEDS*3);
+	// Wait here until both channels are done with the output buffer this frame goes into
+	time_stage(STAGE_WAIT_FOR_LEDS, [&]() {
+		xSemaphoreTake(led_buffers_free[0], portMAX_DELAY);
+		xSemaphoreTake(led_buffers_free[1], portMAX_DELAY);
+	});
+	measure_single_buffer_wait(last_frame_was_out, t_arrived_us);
 
-	// Quantize the floating point color to 8-bit with dithering
+	raw_led_data = led_output_buffers[led_frames_queued % LED_OUTPUT_BUFFERS];
+
+	// Low pass filter, white balance and quantize the floating point color to 8-bit with dithering
 	//
 	// This allows the 8-bit LEDs to emulate the look of a higher bit-depth using persistence of vision tricks
 	// The contents of the floating point CRGBF "leds" array are downsampled into the in alternating ways hundreds of
 	// time 
-	quantize_color(configuration.temporal_dithering);
+	time_stage(STAGE_POST_PROCESS_LEDS, [&]() {
+		post_process_leds(lpf_cutoff_frequency, configuration.temporal_dithering);
+	});
 
 	// Get to safety, THE PHOTONS ARE COMING!!!
 	if(filesystem_ready == true){
-		rmt_transmit(tx_chan_a, led_encoder_a, raw_led_data, (sizeof(raw_led_data) >> 1), &tx_config);
-		rmt_transmit(tx_chan_b, led_encoder_b, raw_led_data+((NUM_LEDS>>1)*3), (sizeof(raw_led_data) >> 1), &tx_config);
+		rmt_transmit(tx_chan_a, led_encoder_a, raw_led_data, ((NUM_LEDS*3) >> 1), &tx_config);
+		rmt_transmit(tx_chan_b, led_encoder_b, raw_led_data+((NUM_LEDS>>1)*3), ((NUM_LEDS*3) >> 1), &tx_config);
+		led_frames_queued++;
+		trace_instant(TRACE_LED_TRANSMIT);  // (trace.h)
+
+		// First frame to show this audio frame, that's how long it took (stage_histograms.h)
+		extern bool analysis_is_new;
+		extern const analysis_snapshot* analysis;
+		if(analysis_is_new == true){
+			record_audio_latency(analysis->capture_us, analysis->publish_us, micros());
+		}
 	}
-}
\ No newline at end of file
+	else{
+		// Nothing sent, so nothing will give the buffer back
+		xSemaphoreGive(led_buffers_free[0]);
+		xSemaphoreGive(led_buffers_free[1]);
+	}
+}
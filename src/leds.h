@@ -110,9 +110,10 @@ void load_leds_from_temp() {
 // These dsps_***() functions are from the ESP-DSP Espressif library which seem to
 // multiply arrays of floats faster than otherwise possible.
 //
-// There's a hardware accelerated FFT function in there that I'm not even using
-// because the current method of having 128 instances of the Goertzel algorithm at once
-// is still more flexible for getting good spectral shows.
+// There's a hardware accelerated FFT function in there that's only used by the
+// optional SPECTRAL_ENGINE_FFT_CONSTANT_Q in goertzel.h, because the current method
+// of having 128 instances of the Goertzel algorithm at once is still more flexible
+// for getting good spectral shows.
 //
 // (64 are musical notes, the other 64 are tempi)
 //
@@ -235,6 +236,55 @@ CRGBF hsv(float h, float s, float v) {
     return col;
 }
 
+// The gradient most modes draw with only depends on configuration.color,
+// color_range, saturation and mirror_mode, never on the audio. hsv() scales
+// the looked up color by v and desaturate() is linear, so hsv(h, s, v) is
+// hsv(h, s, 1.0) * v. The gradient is kept at full brightness and only
+// rebuilt when those settings change, modes scale it by their magnitudes.
+// They branch on its mirror_mode rather than configuration's, which can have
+// changed since, so the ramp they index is always the one that was built
+struct color_palette {
+	CRGBF colors[NUM_LEDS];  // One per pixel of the ramp: NUM_LEDS, or NUM_LEDS >> 1 in mirror mode
+	float color;             // The settings it was built from
+	float color_range;
+	float saturation;
+	bool mirror_mode;
+	bool built = false;
+};
+
+color_palette palette_cache;
+
+const color_palette* get_palette() {
+	// The web task can change these at any time, the gradient is built from one copy
+	float color = configuration.color;
+	float color_range = configuration.color_range;
+	float saturation = configuration.saturation;
+	bool mirror_mode = configuration.mirror_mode;
+
+	if (palette_cache.built == false || palette_cache.color != color || palette_cache.color_range != color_range ||
+		palette_cache.saturation != saturation || palette_cache.mirror_mode != mirror_mode) {
+		uint16_t ramp_length = (mirror_mode == true) ? (NUM_LEDS >> 1) : NUM_LEDS;
+		for (uint16_t i = 0; i < ramp_length; i++) {
+			float progress = float(i) / ramp_length;
+			palette_cache.colors[i] = hsv(color + (progress * color_range), saturation, 1.0);
+		}
+
+		palette_cache.color = color;
+		palette_cache.color_range = color_range;
+		palette_cache.saturation = saturation;
+		palette_cache.mirror_mode = mirror_mode;
+		palette_cache.built = true;
+	}
+
+	return &palette_cache;
+}
+
+// What hsv() would give for that pixel of the ramp, v is clipped the same way
+inline CRGBF get_palette_color(const color_palette* palette, uint16_t index, float v) {
+	v = clip_float(v);
+	return { palette->colors[index].r * v, palette->colors[index].g * v, palette->colors[index].b * v };
+}
+
 void apply_blue_light_filter(float mix) {
 	uint32_t t_start_cycles = ESP.getCycleCount();
 
@@ -515,15 +565,35 @@ void apply_brightness() {
 	scale_CRGBF_array_by_constant(leds, brightness_val*brightness_val, NUM_LEDS);
 }
 
+// apply_blue_light_filter(), clip_leds() and apply_brightness() in one pass.
+// Mixing each pixel with itself times incandescent_lookup is the same as
+// scaling each channel, so the whole filter is one gain per channel
+void apply_color_grade(float blue_filter_mix) {
+	CRGBF filter_gain = {
+		(1.0f - blue_filter_mix) + incandescent_lookup.r * blue_filter_mix,
+		(1.0f - blue_filter_mix) + incandescent_lookup.g * blue_filter_mix,
+		(1.0f - blue_filter_mix) + incandescent_lookup.b * blue_filter_mix,
+	};
+
+	float brightness_val = 0.25+configuration.brightness*0.75;
+	float brightness_scale = brightness_val*brightness_val;
+
+	for (uint16_t i = 0; i < NUM_LEDS; i++) {
+		leds[i].r = clip_float(leds[i].r * filter_gain.r) * brightness_scale;
+		leds[i].g = clip_float(leds[i].g * filter_gain.g) * brightness_scale;
+		leds[i].b = clip_float(leds[i].b * filter_gain.b) * brightness_scale;
+	}
+}
+
 void apply_background(){
 	if(configuration.background > 0.01){
 		float background_level = configuration.background * 0.20; // Max 20% brightness
+		const color_palette* palette = get_palette();
 
-		if(configuration.mirror_mode == false){
+		if(palette->mirror_mode == false){
 			float background_inv = (1.0-background_level);
 			for(uint16_t i = 0; i < NUM_LEDS; i++){
-				float progress = float(i) / NUM_LEDS;
-				CRGBF background_color = hsv(configuration.color + (configuration.color_range * progress), configuration.saturation, background_level*background_level);
+				CRGBF background_color = get_palette_color(palette, i, background_level*background_level);
 				leds[i].r = leds[i].r * background_inv + background_color.r;
 				leds[i].g = leds[i].g * background_inv + background_color.g;
 				leds[i].b = leds[i].b * background_inv + background_color.b;
@@ -532,8 +602,7 @@ void apply_background(){
 		else{
 			float background_inv = (1.0-background_level);
 			for(uint16_t i = 0; i < (NUM_LEDS >> 1); i++){
-				float progress = float(i) / (NUM_LEDS>>1);
-				CRGBF background_color = hsv(configuration.color + (configuration.color_range * progress), configuration.saturation, background_level*background_level);
+				CRGBF background_color = get_palette_color(palette, i, background_level*background_level);
 				
 				int16_t left_index = 63-i;
 				int16_t right_index = 64+i;
@@ -40,6 +40,7 @@ lightshow_mode lightshow_modes[] = {
 };
 
 const uint16_t NUM_LIGHTSHOW_MODES = sizeof(lightshow_modes) / sizeof(lightshow_mode);
+static_assert(NUM_LIGHTSHOW_MODES <= MAX_MODE_HISTOGRAMS, "Every mode needs its own stage histogram (stage_histograms.h)");
 
 extern float lpf_drag; // Used for fade transition
 
@@ -100,7 +101,7 @@ void draw_novelty_curve() {
 	memset(leds, 0, sizeof(CRGBF) * NUM_LEDS);
 
 	for (uint16_t i = 0; i < NUM_LEDS; i++) {
-		float value = novelty_curve_normalized[((NOVELTY_HISTORY_LENGTH - 1) - NUM_LEDS) + i];
+		float value = get_novelty_normalized(((NOVELTY_HISTORY_LENGTH - 1) - NUM_LEDS) + i);
 
 		CRGBF novelty_color = {value * value, 0.0, 0.0};
 		leds[i] = novelty_color;
@@ -118,7 +119,7 @@ void draw_novelty_curve_full() {
 	for (uint16_t i = 0; i < NUM_LEDS; i++) {
 		float max_val = 0.0;
 		for (uint16_t m = 0; m < multiple; m++) {
-			float value = novelty_curve_normalized[i * multiple + m];
+			float value = get_novelty_normalized(i * multiple + m);
 			max_val = max(max_val, value);
 		}
 
@@ -3,8 +3,8 @@ void draw_debug(){
 		float tempo_magnitude = tempi_smooth[i];
 		float contribution = clip_float(tempo_magnitude / tempi_power_sum);
 		
-		float phase_linear = (tempi[i].phase + PI) / (PI*2.0);
-		if(tempi[i].phase_inverted == true){
+		float phase_linear = (get_tempo_phase(i) + PI) / (PI*2.0);
+		if(get_tempo_phase_inverted(i) == true){
 			phase_linear = 1.0 - phase_linear;
 		}
 
@@ -21,8 +21,8 @@ void draw_debug_old(){
 		float tempo_magnitude = tempi_smooth[i];
 		float contribution = clip_float(tempo_magnitude / tempi_power_sum);
 		
-		float phase_linear = ((tempi[i].phase*-1.0) + (PI*2.0)) / (PI*4.0);
-		if(tempi[i].phase_inverted == true){
+		float phase_linear = ((get_tempo_phase(i)*-1.0) + (PI*2.0)) / (PI*4.0);
+		if(get_tempo_phase_inverted(i) == true){
 			phase_linear = 1.0 - phase_linear;
 		}
 
@@ -1,3 +1,5 @@
+#define HYPE_MIN_BEAT_CONTRIBUTION ( 0.0001 ) // Below this a tempo doesn't pulse, all NUM_TEMPI together move beat_sum less than 1/255
+
 void draw_hype() {
 	float beat_sum = 0.0;
 
@@ -6,7 +8,14 @@ void draw_hype() {
 		float tempi_magnitude = tempi_smooth[tempo_bin];
 		float contribution = ((tempi_magnitude * tempi_magnitude) / tempi_power_sum) * tempi_magnitude;
 
-		contribution *= tempi[tempo_bin].beat * 0.5 + 0.5;
+		// Tempi too weak to matter sit at the middle of their beat instead of costing
+		// a phase each. That's off by at most HYPE_MIN_BEAT_CONTRIBUTION * 0.5 per tempo
+		if (contribution > HYPE_MIN_BEAT_CONTRIBUTION) {
+			contribution *= get_tempo_beat(tempo_bin) * 0.5 + 0.5;
+		}
+		else {
+			contribution *= 0.5;
+		}
 
 		beat_sum += contribution;
 	}
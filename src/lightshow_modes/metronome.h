@@ -45,11 +45,11 @@ void draw_metronome() {
 			// Draw tempi and novelty curve together
 			float tempi_val = tempi_smooth[tempo_bin];
 
-			float novelty_val = novelty_curve_normalized[((NOVELTY_HISTORY_LENGTH - 1) - NUM_TEMPI) + tempo_bin];  // Pulls {NUM_TEMPI} of the most recent novelty samples
+			float novelty_val = get_novelty_normalized(((NOVELTY_HISTORY_LENGTH - 1) - NUM_TEMPI) + tempo_bin);  // Pulls {NUM_TEMPI} of the most recent novelty samples
 			novelty_val *= novelty_val;
 			novelty_val *= 0.5;
 
-			float beat = 1.0 - (tempi[tempo_bin].beat * 0.5 + 0.5);
+			float beat = 1.0 - (get_tempo_beat(tempo_bin) * 0.5 + 0.5);
 			beat = beat * beat * beat * beat * (tempi_val * tempi_val);
 
 			beat = beat * 0.99 + 0.01;
@@ -70,7 +70,7 @@ void draw_metronome() {
 		uint16_t tempo_bin = find_closest_tempo_bin(search_bpm);
 
 		if (iter % 5 == 0) {
-			// Serial.println(tempi[tempo_bin].beat);
+			// Serial.println(get_tempo_beat(tempo_bin));
 		}
 	}
 	*/
@@ -83,22 +83,13 @@ void draw_metronome() {
 		float contribution = (tempi_magnitude / tempi_power_sum) * tempi_magnitude;
 
 		/*
-		float phase = (tempi[tempo_bin].phase + M_PI) / (2.0 * M_PI);
+		float phase = (get_tempo_phase(tempo_bin) + M_PI) / (2.0 * M_PI);
 
 		phase = fmod(phase+0.75, 1.0);
 
 		phase = linear_to_half_sine_hold(phase);
 		*/
 
-		float sine = sin(tempi[tempo_bin].phase + (PI*0.5));
-		sine *= 2.0;
-
-		if(sine > 1.0){ sine = 1.0; }
-		else if(sine < -1.0){ sine = -1.0; }
-
-		float metronome_width = 0.5; // Too wide of a show can be distracting, 50% is enough for the effect
-		float dot_pos = clip_float( sine * (0.5*(sqrt(contribution)) * metronome_width) + 0.5 );
-
 		float opacity = (sqrt(contribution));
 
 		float color_offset = 0.0;
@@ -106,7 +97,17 @@ void draw_metronome() {
 			color_offset = 0.25;
 		}
 
+		// Only dots that get drawn ask for their phase, which is what brings it up to date
 		if(opacity > 0.0001){
+			float sine = fast_sin(get_tempo_phase(tempo_bin) + (PI*0.5));
+			sine *= 2.0;
+
+			if(sine > 1.0){ sine = 1.0; }
+			else if(sine < -1.0){ sine = -1.0; }
+
+			float metronome_width = 0.5; // Too wide of a show can be distracting, 50% is enough for the effect
+			float dot_pos = clip_float( sine * (0.5*opacity * metronome_width) + 0.5 );
+
 			CRGBF dot_color = hsv((configuration.color+color_offset*configuration.color_range) + configuration.color_range*progress, configuration.saturation, 1.0);
 
 			if(configuration.mirror_mode == true){
@@ -14,7 +14,7 @@ void draw_neurons() {
 
 		CRGBF color_spectral = {
 			0,
-			spectrogram_smooth[i],
+			analysis->spectrogram_smooth[i],
 			0,
 		};
 
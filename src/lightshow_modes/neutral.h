@@ -1,19 +1,15 @@
 void draw_neutral() {
-	if(configuration.mirror_mode == true){ // Mirror mode
+	const color_palette* palette = get_palette();  // (leds.h)
+
+	if(palette->mirror_mode == true){ // Mirror mode
 		for (uint16_t i = 0; i < (NUM_LEDS >> 1); i++) {
-			float progress = float(i) / (NUM_LEDS >> 1);
-			CRGBF color = hsv(configuration.color+(progress*configuration.color_range), configuration.saturation, 1.0);
+			CRGBF color = palette->colors[i];
 
 			leds[63-i] = color;
 			leds[64+i] = color;
 		}
 	}
 	else{ // Non mirror
-		for (uint16_t i = 0; i < NUM_LEDS; i++) {
-			float progress = float(i) / NUM_LEDS;
-			CRGBF color = hsv(configuration.color+(progress*configuration.color_range), configuration.saturation, 1.0);
-
-			leds[i] = color;
-		}
+		memcpy(leds, palette->colors, sizeof(CRGBF) * NUM_LEDS);
 	}
 }
\ No newline at end of file
@@ -1,9 +1,11 @@
 void draw_octave() {
-	if(configuration.mirror_mode == true){ // Mirror mode
+	const color_palette* palette = get_palette();  // (leds.h)
+
+	if(palette->mirror_mode == true){ // Mirror mode
 		for (uint16_t i = 0; i < (NUM_LEDS >> 1); i++) {
 			float progress = float(i) / (NUM_LEDS >> 1);
-			float mag = clip_float(interpolate(progress, chromagram, 12));
-			CRGBF color = hsv(configuration.color+(progress*configuration.color_range), configuration.saturation, mag);
+			float mag = clip_float(interpolate(progress, analysis->chromagram, 12));
+			CRGBF color = get_palette_color(palette, i, mag);
 
 			leds[63-i] = color;
 			leds[64+i] = color;
@@ -12,8 +14,8 @@ void draw_octave() {
 	else{ // Non mirror
 		for (uint16_t i = 0; i < NUM_LEDS; i++) {
 			float progress = float(i) / NUM_LEDS;
-			float mag = clip_float(interpolate(progress, chromagram, 12));
-			CRGBF color = hsv(configuration.color+(progress*configuration.color_range), configuration.saturation, mag);
+			float mag = clip_float(interpolate(progress, analysis->chromagram, 12));
+			CRGBF color = get_palette_color(palette, i, mag);
 
 			leds[i] = color;
 		}
@@ -35,13 +35,12 @@ void draw_line(float* layer, float x1, float x2, float opacity) {
 void draw_plot(){
 	static float image[NUM_LEDS];
 
-	//if(waveform_locked == false && waveform_sync_flag == true){
-		//waveform_sync_flag = false;
+	//if(analysis_is_new == true){
 		
 		memset(image, 0, sizeof(float)*NUM_LEDS);
 
 		const uint16_t num_samples = 128;
-		float* samples_raw = &sample_history[(SAMPLE_HISTORY_LENGTH-1) - (num_samples)];
+		const float* samples_raw = &analysis->waveform[(ANALYSIS_WAVEFORM_LENGTH-1) - (num_samples)];
 		float samples[num_samples];
 		memcpy(samples, samples_raw, sizeof(float)*num_samples);
 
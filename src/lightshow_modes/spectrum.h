@@ -1,11 +1,12 @@
 void draw_spectrum() {
-	if(configuration.mirror_mode == true){ // Mirror mode
+	const color_palette* palette = get_palette();  // (leds.h)
+
+	if(palette->mirror_mode == true){ // Mirror mode
 		for (uint16_t i = 0; i < NUM_LEDS>>1; i++) {
-			float progress = float(i) / (NUM_LEDS>>1);
-			float mag = spectrogram_smooth[i];
+			float mag = analysis->spectrogram_smooth[i];
 			// TODO: Make "base coat" a slider in the web app for (at least) Spectrum Mode
 			// mag = mag * 0.99 + 0.01;
-			CRGBF color = hsv(configuration.color+(progress*configuration.color_range), configuration.saturation, mag);
+			CRGBF color = get_palette_color(palette, i, mag);
 
 			// TODO: Make "saturation" a slider in the web app
 			
@@ -16,8 +17,8 @@ void draw_spectrum() {
 	else{ // Non mirror
 		for (uint16_t i = 0; i < NUM_LEDS; i++) {
 			float progress = float(i) / NUM_LEDS;
-			float mag = clip_float(interpolate(progress, spectrogram_smooth, NUM_FREQS));
-			CRGBF color = hsv(configuration.color+(progress*configuration.color_range), configuration.saturation, mag);
+			float mag = clip_float(interpolate(progress, analysis->spectrogram_smooth, NUM_FREQS));
+			CRGBF color = get_palette_color(palette, i, mag);
 
 			leds[i] = color;
 		}
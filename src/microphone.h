@@ -8,7 +8,8 @@
 //                                       | |
 //                                       |_|
 //
-// Functions for reading and storing data acquired by the I2S microphone0
+// Functions for reading data acquired by the I2S microphone, the default
+// audio_source (see audio_source.h)
 
 #include "driver/i2s_std.h"
 #include "driver/gpio.h"
@@ -18,18 +19,45 @@
 #define I2S_LRCLK_PIN 17
 #define I2S_DIN_PIN 16
 
-#define CHUNK_SIZE 64
-#define SAMPLE_RATE 12800
+const float recip_scale = 1.0 / 131072.0; // max 18 bit signed value
+
+i2s_chan_handle_t rx_handle;
 
-#define SAMPLE_HISTORY_LENGTH 4096
+volatile uint32_t i2s_overflows = 0; // DMA buffers that filled up before the CPU core read them
 
-float sample_history[SAMPLE_HISTORY_LENGTH];
-const float recip_scale = 1.0 / 131072.0; // max 18 bit signed value
+// Standby doesn't read the microphone, so those don't count
+static bool IRAM_ATTR on_i2s_receive_overflow(i2s_chan_handle_t handle, i2s_event_data_t* event, void* user_ctx) {
+	if (EMOTISCOPE_ACTIVE == true) {
+		i2s_overflows++;
+	}
+	return false;
+}
+
+// Blocks until the I2S DMA has a full chunk for us, which is what paces the CPU core
+bool read_i2s_chunk(float* new_samples, uint16_t num_samples)
+{
+	// Buffer to hold audio samples
+	uint32_t new_samples_raw[CHUNK_SIZE];
+	num_samples = min(num_samples, (uint16_t)CHUNK_SIZE);
 
-volatile bool waveform_locked = false;
-volatile bool waveform_sync_flag = false;
+	size_t bytes_read = 0;
+	i2s_channel_read(rx_handle, new_samples_raw, num_samples*sizeof(uint32_t), &bytes_read, portMAX_DELAY);
 
-i2s_chan_handle_t rx_handle;
+	// Clip the sample value if it's too large, cast to floats
+	for (uint16_t i = 0; i < num_samples; i+=4) {
+		new_samples[i+0] = min(max((((int32_t)new_samples_raw[i+0]) >> 14) + 7000, (int32_t)-131072), (int32_t)131072) - 360;
+		new_samples[i+1] = min(max((((int32_t)new_samples_raw[i+1]) >> 14) + 7000, (int32_t)-131072), (int32_t)131072) - 360;
+		new_samples[i+2] = min(max((((int32_t)new_samples_raw[i+2]) >> 14) + 7000, (int32_t)-131072), (int32_t)131072) - 360;
+		new_samples[i+3] = min(max((((int32_t)new_samples_raw[i+3]) >> 14) + 7000, (int32_t)-131072), (int32_t)131072) - 360;
+	}
+
+	// Convert audio from "18-bit" float range to -1.0 to 1.0 range
+	dsps_mulc_f32(new_samples, new_samples, num_samples, recip_scale, 1, 1);
+
+	return true;
+}
+
+audio_source i2s_audio_source = {"i2s", read_i2s_chunk};
 
 void init_i2s_microphone()
 {
@@ -71,63 +99,13 @@ void init_i2s_microphone()
 	// Initialize the channel
 	i2s_channel_init_std_mode(rx_handle, &std_cfg);
 
+	// Count overflows, the CPU core should never be late enough to cause one
+	i2s_event_callbacks_t callbacks = {};
+	callbacks.on_recv_q_ovf = on_i2s_receive_overflow;
+	i2s_channel_register_event_callback(rx_handle, &callbacks, NULL);
+
 	// Start the RX channel
 	i2s_channel_enable(rx_handle);
-}
 
-void acquire_sample_chunk()
-{
-	profile_function([&]()
-					 {
-		// Buffer to hold audio samples
-		uint32_t new_samples_raw[CHUNK_SIZE];
-		float new_samples[CHUNK_SIZE];
-
-		// Read audio samples into int32_t buffer, but **only when emotiscope is active**
-		if( EMOTISCOPE_ACTIVE == true ){
-			size_t bytes_read = 0;
-			i2s_channel_read(rx_handle, new_samples_raw, CHUNK_SIZE*sizeof(uint32_t), &bytes_read, portMAX_DELAY);
-		}
-		else{
-			memset(new_samples_raw, 0, sizeof(uint32_t) * CHUNK_SIZE);
-		}
-
-		// Clip the sample value if it's too large, cast to floats
-		for (uint16_t i = 0; i < CHUNK_SIZE; i+=4) {
-			new_samples[i+0] = min(max((((int32_t)new_samples_raw[i+0]) >> 14) + 7000, (int32_t)-131072), (int32_t)131072) - 360;
-			new_samples[i+1] = min(max((((int32_t)new_samples_raw[i+1]) >> 14) + 7000, (int32_t)-131072), (int32_t)131072) - 360;
-			new_samples[i+2] = min(max((((int32_t)new_samples_raw[i+2]) >> 14) + 7000, (int32_t)-131072), (int32_t)131072) - 360;
-			new_samples[i+3] = min(max((((int32_t)new_samples_raw[i+3]) >> 14) + 7000, (int32_t)-131072), (int32_t)131072) - 360;
-		}
-
-		// Convert audio from "18-bit" float range to -1.0 to 1.0 range
-		dsps_mulc_f32(new_samples, new_samples, CHUNK_SIZE, recip_scale, 1, 1);
-
-		// Add new chunk to audio history
-		waveform_locked = true;
-		shift_and_copy_arrays(sample_history, SAMPLE_HISTORY_LENGTH, new_samples, CHUNK_SIZE);
-
-		// If debug recording was triggered
-		if(audio_recording_live == true){
-			int16_t out_samples[CHUNK_SIZE];
-			for(uint16_t i = 0; i < CHUNK_SIZE; i += 4){
-				out_samples[i+0] = new_samples[i+0] * 32767;
-				out_samples[i+1] = new_samples[i+1] * 32767;
-				out_samples[i+2] = new_samples[i+2] * 32767;
-				out_samples[i+3] = new_samples[i+3] * 32767;
-			}
-			memcpy(&audio_debug_recording[audio_recording_index], out_samples, sizeof(int16_t)*CHUNK_SIZE);
-			audio_recording_index += CHUNK_SIZE;
-			if(audio_recording_index >= MAX_AUDIO_RECORDING_SAMPLES){
-				audio_recording_index = 0;
-				audio_recording_live = false;
-				broadcast("debug_recording_ready");
-				save_audio_debug_recording();
-			}
-		}
-		
-		// Used to sync GPU to this when needed
-		waveform_locked = false;
-		waveform_sync_flag = true; },
-					 __func__);
+	set_audio_source(&i2s_audio_source);
 }
@@ -0,0 +1,15 @@
+// ----------------------------------------------------------------------------------
+// native/kernel_benchmarks.cpp
+//
+// run_kernel_benchmarks() (kernel_benchmarks.h) as a Linux program, for env:native:
+//
+//   pio run -e native && .pio/build/native/program
+
+#include "native_firmware.h"
+
+int main() {
+	init_native_firmware();   // (native_firmware.h)
+	run_kernel_benchmarks();  // (kernel_benchmarks.h)
+
+	return 0;
+}
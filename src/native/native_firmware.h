@@ -0,0 +1,165 @@
+// ----------------------------------------------------------------------------------
+// native/native_firmware.h
+//
+// The firmware as a Linux program, for env:native and its unit tests (test/).
+// Headers are included in the same order as EMOTISCOPE_FIRMWARE.ino, minus the
+// ones that only make sense on the device: the microphone, WiFi and the web
+// server, OTA updates, the profiler's system printout and the loops. Whatever
+// the rest needs from those is stood in for here, with just enough kept for
+// tests to see what would have gone out.
+//
+// lib/native_shims provides the Arduino core, ESP-IDF and esp-dsp underneath.
+
+#define SOFTWARE_VERSION_MAJOR ( 1 )
+#define SOFTWARE_VERSION_MINOR ( 0 )
+#define SOFTWARE_VERSION_PATCH ( 0 )
+
+#include <Arduino.h>
+#include <PsychicHttp.h>
+#include <Preferences.h>
+#include <WiFi.h>
+#include <esp_dsp.h>
+
+#include "../global_defines.h"
+#include "../hardware_version.h"
+#include "../types.h"
+#include "../trace.h"
+
+// The device streams the trace to GET /trace, here it goes to a file
+bool write_trace_json(const char* path) {
+	FILE* file = fopen(path, "w");
+	if (file == NULL) {
+		printf("TRACE: Can't open %s for writing!\n", path);
+		return false;
+	}
+
+	char buffer[4096];
+	bool written = stream_trace_json(buffer, sizeof(buffer), [](const char* chunk, size_t length, void* context) {
+		return fwrite(chunk, 1, length, (FILE*)context) == length;
+	}, file);
+	fclose(file);
+
+	return written;
+}
+
+// profiler.h ---------------------------------------------------------------------
+// Its print_system_info() wants WiFi and the web server, so only the timekeeping
+// is here, and profile_function() just runs the function
+uint32_t t_now_ms = 0;
+uint32_t t_now_us = 0;
+float FPS_CPU = 0.0;
+float FPS_GPU = 0.0;
+profiler_scope profiler_scopes[1];  // Names for trace.h, no scopes are ever registered
+volatile uint16_t num_profiler_scopes = 0;
+
+template <typename Func>
+inline void profile_function(Func func, const char* func_name) {
+	func();
+}
+
+#include "../stage_histograms.h"
+#include "../sliders.h"
+#include "../toggles.h"
+#include "../menu_toggles.h"
+#include "../filesystem.h"
+#include "../configuration.h"
+#include "../utilities.h"
+#include "../constexpr_math.h"
+
+// system.h -----------------------------------------------------------------------
+volatile bool EMOTISCOPE_ACTIVE = true;
+
+// led_driver.h has its second data pin commented out
+#ifndef LED_DATA_2_PIN
+#define LED_DATA_2_PIN ( 14 )
+#endif
+
+#include "../led_driver.h"
+#include "../leds.h"
+#include "../touch.h"
+#include "../indicator.h"
+#include "../ui.h"
+#include "../goertzel.h"
+#include "../audio_source.h"
+
+// microphone.h -------------------------------------------------------------------
+// There's no microphone, the I2S source hears silence
+bool read_i2s_silence(float* new_samples, uint16_t num_samples) {
+	memset(new_samples, 0, sizeof(float) * num_samples);
+	return true;
+}
+
+audio_source i2s_audio_source = {"i2s", read_i2s_silence};
+
+#include "../analysis.h"
+#include "../vu.h"
+#include "../tempo.h"
+#include "../kernel_benchmarks.h"
+
+// audio_source.h opens WAV files with fopen(), so the click goes where LittleFS lives here
+#define LATENCY_TEST_WAV_PATH NATIVE_LITTLEFS_ROOT "/latency_test.wav"
+#include "../benchmarks.h"
+#include "../screensaver.h"
+
+// gpu_core.h
+float lpf_drag = 0.0;
+
+#include "../standby.h"
+#include "../lightshow_modes.h"
+#include "../commands.h"
+
+// wireless.h, web_core.h, ota.h ------------------------------------------------------
+// The web server is the websocket_handler in lib/native_shims, messages to
+// single clients and jobs queued for other tasks are counted and the last is kept
+PsychicWebSocketHandler websocket_handler;
+volatile bool web_server_ready = false;
+int16_t connection_status = -1;
+char mac_str[18] = "00:00:00:00:00:00";
+
+char last_client_message[MAX_COMMAND_LENGTH] = { 0 };
+uint8_t last_client_slot = 0;
+uint32_t client_messages_sent = 0;
+
+web_job last_web_job;
+uint32_t web_jobs_queued = 0;
+audio_job last_audio_job;
+uint32_t audio_jobs_queued = 0;
+
+void transmit_to_client_in_slot(char* message, uint8_t client_slot) {
+	strncpy(last_client_message, message, MAX_COMMAND_LENGTH - 1);
+	last_client_slot = client_slot;
+	client_messages_sent++;
+}
+
+void reboot_into_wifi_config_mode() {
+	preferences.putBool("CONFIG_TRIG", true);
+	ESP.restart();
+}
+
+void queue_web_job(web_job job) {
+	last_web_job = job;
+	web_jobs_queued++;
+}
+
+void queue_audio_job(audio_job job) {
+	last_audio_job = job;
+	audio_jobs_queued++;
+}
+
+bool check_update() { return false; }
+void perform_update(int16_t client_slot) {}
+
+// What init_system() (system.h) does for the parts that are here
+void init_native_firmware() {
+	init_stage_histograms();            // (stage_histograms.h)
+	init_filesystem();                  // (filesystem.h)
+	init_configuration();               // (configuration.h)
+	init_decimation_filter();           // (goertzel.h)
+	init_goertzel_constants_musical();  // (goertzel.h)
+	init_tempo_goertzel_constants();    // (tempo.h)
+	init_rmt_driver();                  // (led_driver.h)
+	init_touch();                       // (touch.h)
+
+	load_sliders_relevant_to_mode(configuration.current_mode);
+	load_toggles_relevant_to_mode(configuration.current_mode);
+}
@@ -1,12 +1,10 @@
-// UNCOMMENT THIS TO ENABLE IT
-//#define PROFILER_ENABLED  // Slows down the system, but allows watching how much
-// total time each function takes up
+// Always on. Every profile_function() call site gets its own scope the first
+// time it runs, after that a call costs two cycle counter reads and a few adds.
+// Comment this out to compile it away entirely
+#define PROFILER_ENABLED
 
-#define PROFILER_SINGLE_SHOT \
-	(true)	 // Count only the most recent run or all runs since last print?
-
-#define PROFILER_HITS \
-	(false)	 // Count the usage of a function instead of its execution time
+#define PROFILER_MAX_SCOPES ( 128 )
+#define PROFILER_MAX_DEPTH ( 16 ) // Deepest nesting of profile_function() calls on one core
 
 #define PROFILER_PRINT_INTERVAL_MS \
 	(5000)	// How long should data be gathered every period
@@ -18,9 +16,16 @@ extern char mac_str[18];
 uint32_t t_now_ms = 0;
 uint32_t t_now_us = 0;
 
-profiler_function profiler_functions[128];
-uint16_t num_profiled_functions = 0;
-bool profiler_locked = false;
+profiler_scope profiler_scopes[PROFILER_MAX_SCOPES];
+volatile uint16_t num_profiler_scopes = 0;
+portMUX_TYPE profiler_scopes_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Scopes running right now in this task, innermost last, with the cycles their
+// finished children took so far. Per task and not per core, since loop() and
+// loop_web() take turns on the same one
+thread_local uint16_t profiler_stack_scope[PROFILER_MAX_DEPTH];
+thread_local uint32_t profiler_stack_child_cycles[PROFILER_MAX_DEPTH];
+thread_local uint8_t profiler_stack_depth = 0;
 
 float FPS_CPU_SAMPLES[16];
 float FPS_GPU_SAMPLES[16];
@@ -30,6 +35,10 @@ float FPS_GPU = 0.0;
 
 float CPU_CORE_USAGE = 0.0;
 
+// Cadence of the CPU core's audio loop (cpu_core.h), worst case since the last print
+volatile uint32_t CPU_MAX_STALL_US = 0;     // Longest spent on anything but waiting for the next audio chunk
+volatile uint32_t CPU_MAX_INTERVAL_US = 0;  // Longest between two audio chunks
+
 inline bool fastcmp_func_name(const char* input_a, const char* input_b){
 	// Is first char different? DISQUALIFIED!
 	if(input_a[0] != input_b[0]){ return false; }
@@ -63,71 +72,125 @@ float measure_execution(MeasureFunc func) {
     }
     
     // Return the average execution time per iteration in microseconds as a float
-    return (static_cast<float>(total_time_us) / 8) / 240; // divided 8 (averaging), then by (CPU MHz), to get sub-microsecond resolution
+    return (static_cast<float>(total_time_us) / 8) / getCpuFrequencyMhz(); // divided 8 (averaging), then by (CPU MHz), to get sub-microsecond resolution
 }
 
-int16_t find_matching_profiler_entry_index(const char *func_name) {
-	for (uint16_t i = 0; i < num_profiled_functions; i++) {
-		const char *profiled_name = profiler_functions[i].name;
-		if(fastcmp_func_name(func_name, profiled_name)){
-			return i;
-		}
+// Once per call site, the first time it runs. Its parent is whatever scope it
+// first ran inside of, for printing the tree
+uint16_t register_profiler_scope(const char *scope_name) {
+	uint8_t depth = profiler_stack_depth;
+
+	portENTER_CRITICAL(&profiler_scopes_lock);
+	uint16_t scope_id = num_profiler_scopes;
+	if (scope_id < PROFILER_MAX_SCOPES) {
+		profiler_scope* scope = &profiler_scopes[scope_id];
+		memset(scope, 0, sizeof(profiler_scope));
+		strncpy(scope->name, scope_name, 31);
+		scope->parent = (depth > 0) ? profiler_stack_scope[depth - 1] : PROFILER_NO_PARENT;
+		num_profiler_scopes = scope_id + 1;
 	}
+	else {
+		scope_id = PROFILER_MAX_SCOPES - 1;  // Out of room, the rest get lumped into the last one
+	}
+	portEXIT_CRITICAL(&profiler_scopes_lock);
 
-	return -1;
-}
-
-uint16_t register_profiler_entry(const char *func_name) {
-	uint16_t dest_index = num_profiled_functions;
-	memcpy(profiler_functions[dest_index].name, func_name, 32);
-
-	num_profiled_functions += 1;
-	return dest_index;
+	return scope_id;
 }
 
 template<typename ProfileFunc> // used for lambdas
 void profile_function(ProfileFunc func, const char* func_name) {
 	#ifdef PROFILER_ENABLED
-		int16_t index = find_matching_profiler_entry_index(func_name);
-		// Not found yet? Register it:
-		if (index == -1) {
-			index = register_profiler_entry(func_name);
+		// Every lambda is its own type, so this is one static per call site
+		static uint16_t scope_id = register_profiler_scope(func_name);
+
+		uint8_t depth = profiler_stack_depth;
+		if (depth >= PROFILER_MAX_DEPTH) {
+			func();
+			return;
+		}
+
+		profiler_stack_scope[depth] = scope_id;
+		profiler_stack_child_cycles[depth] = 0;
+		profiler_stack_depth = depth + 1;
+
+		if (trace_enabled == true) {
+			record_trace_event(scope_id, 'B');  // (trace.h)
 		}
 
-		profiler_functions[index].hits += 1;
 		uint32_t cycle_start = ESP.getCycleCount();
 
 		// Run the function
 		func();
 
-		uint32_t cycle_end = ESP.getCycleCount();
-		uint32_t num_cycles = cycle_end - cycle_start;
+		uint32_t num_cycles = ESP.getCycleCount() - cycle_start;
+
+		if (trace_enabled == true) {
+			record_trace_event(scope_id, 'E');
+		}
+
+		profiler_stack_depth = depth;
+		if (depth > 0) {
+			profiler_stack_child_cycles[depth - 1] += num_cycles;
+		}
 
-		if (PROFILER_SINGLE_SHOT == true) {
-			profiler_functions[index].cycles_total = num_cycles;
+		profiler_scope_stats* stats = &profiler_scopes[scope_id].cores[xPortGetCoreID()];
+		if (stats->count == 0 || num_cycles < stats->min_cycles) {
+			stats->min_cycles = num_cycles;
 		}
-		else{
-			profiler_functions[index].cycles_total += num_cycles;
+		if (num_cycles > stats->max_cycles) {
+			stats->max_cycles = num_cycles;
 		}
+		stats->total_cycles += num_cycles;
+		stats->self_cycles += num_cycles - profiler_stack_child_cycles[depth];
+		stats->count += 1;
 	#else
 		// Just run the function
 		func();
 	#endif
 }
 
-void print_profiled_function_hits() {
-	#ifdef PROFILER_ENABLED
-	for (uint16_t i = 0; i < num_profiled_functions; i++) {
-		if (PROFILER_HITS == true) {
-			printf("HITS: %lu \t %s\n", profiler_functions[i].hits, profiler_functions[i].name);
+void print_profiler_scope_tree(uint16_t parent, uint8_t indent, float cycles_per_us, uint32_t interval_us) {
+	for (uint16_t i = 0; i < num_profiler_scopes; i++) {
+		profiler_scope* scope = &profiler_scopes[i];
+		if (scope->parent != parent) {
+			continue;
 		}
-		else {
-			uint32_t total_time = profiler_functions[i].cycles_total;
-			printf("CYCLES: %lu \t %s\n", total_time, profiler_functions[i].name);
+
+		for (uint8_t core = 0; core < 2; core++) {
+			profiler_scope_stats* stats = &scope->cores[core];
+			if (stats->count == 0) {
+				continue;
+			}
+
+			float load = (stats->self_cycles / cycles_per_us) / interval_us;
+			printf("%*s%-*s | CORE %u | %7lu CALLS | MEAN %8.1fus | MIN %8.1fus | MAX %8.1fus | SELF %5.1f%%\n",
+				indent * 2, "", 32 - (indent * 2), scope->name, core, stats->count,
+				(stats->total_cycles / stats->count) / cycles_per_us,
+				stats->min_cycles / cycles_per_us,
+				stats->max_cycles / cycles_per_us,
+				load * 100.0
+			);
 		}
 
-		profiler_functions[i].cycles_total = 0;
-		profiler_functions[i].hits = 0;
+		print_profiler_scope_tree(i, indent + 1, cycles_per_us, interval_us);
+	}
+}
+
+// Every scope's stats since the last print, nested under where they were first called from
+void print_profiler_scopes() {
+	#ifdef PROFILER_ENABLED
+	static uint32_t last_print_us = 0;
+	uint32_t now_us = micros();
+	uint32_t interval_us = now_us - last_print_us;
+	last_print_us = now_us;
+	if (interval_us == 0) {
+		return;
+	}
+
+	print_profiler_scope_tree(PROFILER_NO_PARENT, 0, getCpuFrequencyMhz(), interval_us);
+
+	for (uint16_t i = 0; i < num_profiler_scopes; i++) {
+		memset(profiler_scopes[i].cores, 0, sizeof(profiler_scopes[i].cores));
 	}
 	#endif
 }
@@ -172,8 +235,16 @@ void print_system_info() {
 		FPS_GPU /= 16.0;
 
 	    uint32_t free_heap = esp_get_free_heap_size();
-		UBaseType_t free_stack_cpu = uxTaskGetStackHighWaterMark(NULL); // CPU core (this one)
+		UBaseType_t free_stack_cpu = uxTaskGetStackHighWaterMark(xTaskGetHandle("loopTask")); // CPU core
 		UBaseType_t free_stack_gpu = uxTaskGetStackHighWaterMark(xTaskGetHandle("loop_gpu")); // GPU core
+		UBaseType_t free_stack_web = uxTaskGetStackHighWaterMark(NULL); // Web task (this one)
+
+		extern volatile uint32_t i2s_overflows;
+		extern volatile uint32_t web_jobs_dropped;
+		uint32_t max_stall_us = CPU_MAX_STALL_US;
+		uint32_t max_interval_us = CPU_MAX_INTERVAL_US;
+		CPU_MAX_STALL_US = 0;
+		CPU_MAX_INTERVAL_US = 0;
 
 		extern volatile bool web_server_ready;
 		extern PsychicWebSocketClient *get_client_in_slot(uint8_t slot);
@@ -196,9 +267,20 @@ void print_system_info() {
 		printf("CPU CORE USAGE --- %.2f%%\n", CPU_CORE_USAGE*100);
 		printf("CPU FPS ---------- %.3f\n", FPS_CPU);
 		printf("GPU FPS ---------- %.3f\n", FPS_GPU);
+		printf("CPU MAX STALL ---- %luus\n", max_stall_us);
+		printf("CPU MAX INTERVAL - %luus (%luus jitter)\n", max_interval_us, max_interval_us - min(max_interval_us, uint32_t(AUDIO_FRAME_INTERVAL_MS * 1000)));
+		printf("I2S OVERFLOWS ---- %lu\n", i2s_overflows);
+		printf("WEB JOBS DROPPED - %lu\n", web_jobs_dropped);
+
+		extern void print_audio_latency();
+		print_audio_latency();  // (stage_histograms.h)
+
+		extern void print_led_wait();
+		print_led_wait();  // (stage_histograms.h)
 		printf("Free Heap -------- %lu\n", (uint32_t)free_heap);
 		printf("Free Stack CPU --- %lu\n", (uint32_t)free_stack_cpu);
 		printf("Free Stack GPU --- %lu\n", (uint32_t)free_stack_gpu);
+		printf("Free Stack WEB --- %lu\n", (uint32_t)free_stack_web);
 		//printf("Total PSRAM ------ %lu\n", (uint32_t)ESP.getPsramSize());
 		//printf("Free PSRAM ------- %lu\n", (uint32_t)ESP.getFreePsram());
 		printf("IP Address ------- %s\n", WiFi.localIP().toString().c_str());
@@ -215,7 +297,7 @@ void print_system_info() {
 		}
 		printf("------------------------------\n");
 
-		//print_profiled_function_hits();	
+		print_profiler_scopes();
 		printf("##################################\n\n");
 	}
 }
\ No newline at end of file
@@ -15,7 +15,7 @@ bool inactive = false;
 void run_screensaver(){
 	float mag_sum = 0;
 	for(uint16_t i = 0; i < NUM_FREQS; i++){
-		mag_sum += frequencies_musical[i].magnitude;
+		mag_sum += analysis->spectrogram[i];
 	}
 
 	if(mag_sum < screensaver_threshold){
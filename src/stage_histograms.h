@@ -0,0 +1,259 @@
+// ----------------------------------------------------------------------------------
+// stage_histograms.h
+//
+// Latency histograms of each stage of the CPU and GPU loops, and of every
+// lightshow mode's draw(). Averages like FPS_CPU hide the one frame in a
+// thousand that takes 5x as long, these don't.
+//
+// Recording is two cycle counter reads, a count-leading-zeros and a few adds,
+// so they're always on. Buckets are logarithmic, 4 per octave, which puts
+// the percentiles within ~19% of the truth. Each histogram is only written by
+// the core its stage runs on. Reading them from the web task can catch one
+// mid-update, which is fine for statistics.
+//
+// Also here is the audio-to-photon latency: from when an audio chunk came out
+// of its source (audio_source.h), through the analysis_snapshot it ended up in
+// (analysis.h), to rmt_transmit() of the first GPU frame that showed it
+// (led_driver.h). Kept for the last LATENCY_HISTORY_LENGTH audio frames.
+//
+// Downloadable as JSON from http://emotiscope.local/histograms, add ?reset
+// to start over after the download (wireless.h)
+
+#define STAGE_HISTOGRAM_MIN_OCTAVE ( 6 ) // Bucket 0 is anything under 2^6 cycles
+#define MAX_MODE_HISTOGRAMS ( 16 )
+#define LATENCY_HISTORY_LENGTH ( 256 )
+
+stage_histogram stage_histograms[NUM_PIPELINE_STAGES + MAX_MODE_HISTOGRAMS];
+
+const char* pipeline_stage_names[NUM_PIPELINE_STAGES] = {
+	"acquire_sample_chunk",
+	"calculate_magnitudes",
+	"update_tempo",
+	"cpu_frame",
+	"apply_color_grade",
+	"post_process_leds",
+	"wait_for_leds",
+	"single_buffer_wait",
+	"transmit_leds",
+	"gpu_frame",
+};
+
+inline uint16_t get_stage_histogram_bucket(uint32_t cycles) {
+	if (cycles < (1 << STAGE_HISTOGRAM_MIN_OCTAVE)) {
+		return 0;
+	}
+
+	uint16_t octave = 31 - __builtin_clz(cycles);
+	uint16_t quarter = (cycles >> (octave - 2)) & 3;  // The two bits after the leading one
+	uint16_t bucket = (octave - STAGE_HISTOGRAM_MIN_OCTAVE) * 4 + quarter;
+
+	return min(bucket, uint16_t(STAGE_HISTOGRAM_BUCKETS - 1));
+}
+
+// Smallest cycle count that lands in the bucket after this one
+uint32_t get_stage_histogram_bucket_limit(uint16_t bucket) {
+	bucket += 1;
+	uint16_t octave = STAGE_HISTOGRAM_MIN_OCTAVE + (bucket >> 2);
+	return uint32_t(4 + (bucket & 3)) << (octave - 2);
+}
+
+inline void record_stage_cycles(uint16_t stage, uint32_t cycles) {
+	stage_histogram* histogram = &stage_histograms[stage];
+
+	histogram->buckets[get_stage_histogram_bucket(cycles)]++;
+	histogram->total_cycles += cycles;
+	if (histogram->count == 0 || cycles < histogram->min_cycles) {
+		histogram->min_cycles = cycles;
+	}
+	if (cycles > histogram->max_cycles) {
+		histogram->max_cycles = cycles;
+	}
+	histogram->count++;
+}
+
+// Runs func() and records how long it took. Modes pass their own name,
+// since which ones exist is only known in lightshow_modes.h
+template<typename StageFunc> // used for lambdas
+inline void time_stage(uint16_t stage, StageFunc func, const char* stage_name = NULL) {
+	uint32_t cycle_start = ESP.getCycleCount();
+	func();
+	record_stage_cycles(stage, ESP.getCycleCount() - cycle_start);
+
+	if (stage_name != NULL && stage_histograms[stage].name[0] == '\0') {
+		strncpy(stage_histograms[stage].name, stage_name, 31);
+	}
+}
+
+// Written by the GPU core only
+uint32_t audio_to_photon_us[LATENCY_HISTORY_LENGTH];
+uint32_t audio_processing_us[LATENCY_HISTORY_LENGTH];  // The CPU core's part of it
+uint16_t latency_history_index = 0;
+uint16_t latency_history_count = 0;
+
+void record_audio_latency(uint32_t capture_us, uint32_t publish_us, uint32_t transmit_us) {
+	audio_to_photon_us[latency_history_index] = transmit_us - capture_us;
+	audio_processing_us[latency_history_index] = publish_us - capture_us;
+
+	latency_history_index = (latency_history_index + 1) % LATENCY_HISTORY_LENGTH;
+	if (latency_history_count < LATENCY_HISTORY_LENGTH) {
+		latency_history_count++;
+	}
+}
+
+int compare_uint32(const void* a, const void* b) {
+	uint32_t value_a = *(const uint32_t*)a;
+	uint32_t value_b = *(const uint32_t*)b;
+	return (value_a > value_b) - (value_a < value_b);
+}
+
+// p50, p99 and max of one of the latency histories, in microseconds
+void get_latency_percentiles(const uint32_t* history, uint32_t* p50, uint32_t* p99, uint32_t* max_value) {
+	uint16_t count = latency_history_count;
+	if (count == 0) {
+		*p50 = 0; *p99 = 0; *max_value = 0;
+		return;
+	}
+
+	uint32_t sorted[LATENCY_HISTORY_LENGTH];
+	memcpy(sorted, history, sizeof(uint32_t) * count);
+	qsort(sorted, count, sizeof(uint32_t), compare_uint32);
+
+	*p50 = sorted[(count - 1) / 2];
+	*p99 = sorted[((count - 1) * 99) / 100];
+	*max_value = sorted[count - 1];
+}
+
+void print_audio_latency() {
+	uint32_t p50, p99, max_value;
+	get_latency_percentiles(audio_to_photon_us, &p50, &p99, &max_value);
+	printf("AUDIO TO PHOTON -- %luus p50, %luus p99, %luus max\n", p50, p99, max_value);
+
+	get_latency_percentiles(audio_processing_us, &p50, &p99, &max_value);
+	printf("  CPU CORE'S PART  %luus p50, %luus p99, %luus max\n", p50, p99, max_value);
+}
+
+// Mean cycles per sample recorded since the last call, which keeps its own
+// copy of the histogram's running totals. Starts over if they were reset
+float get_stage_mean_cycles_since(const stage_histogram* histogram, uint32_t* last_count, uint64_t* last_total_cycles) {
+	if (histogram->count < *last_count) {
+		*last_count = 0;
+		*last_total_cycles = 0;
+	}
+
+	uint32_t count = histogram->count - *last_count;
+	uint64_t total_cycles = histogram->total_cycles - *last_total_cycles;
+	*last_count = histogram->count;
+	*last_total_cycles = histogram->total_cycles;
+
+	return (count > 0) ? float(total_cycles) / count : 0.0;
+}
+
+// Share of the GPU frame spent waiting for the RMT to free an output buffer,
+// and what it would have been with just one (led_driver.h)
+void print_led_wait() {
+	static uint32_t last_counts[3] = { 0, 0, 0 };
+	static uint64_t last_totals[3] = { 0, 0, 0 };
+
+	float frame_cycles = get_stage_mean_cycles_since(&stage_histograms[STAGE_GPU_FRAME], &last_counts[0], &last_totals[0]);
+	float wait_cycles = get_stage_mean_cycles_since(&stage_histograms[STAGE_WAIT_FOR_LEDS], &last_counts[1], &last_totals[1]);
+	float single_buffer_wait_cycles = get_stage_mean_cycles_since(&stage_histograms[STAGE_SINGLE_BUFFER_WAIT], &last_counts[2], &last_totals[2]);
+
+	if (frame_cycles > 0.0) {
+		printf("GPU LED WAIT ----- %.2f%% (%.2f%% with one buffer)\n", 100.0 * wait_cycles / frame_cycles, 100.0 * single_buffer_wait_cycles / frame_cycles);
+	}
+}
+
+void reset_stage_histograms() {
+	for (uint16_t i = 0; i < NUM_PIPELINE_STAGES + MAX_MODE_HISTOGRAMS; i++) {
+		stage_histogram* histogram = &stage_histograms[i];
+		memset(histogram->buckets, 0, sizeof(histogram->buckets));
+		histogram->count = 0;
+		histogram->min_cycles = 0;
+		histogram->max_cycles = 0;
+		histogram->total_cycles = 0;
+	}
+
+	latency_history_index = 0;
+	latency_history_count = 0;
+}
+
+void init_stage_histograms() {
+	reset_stage_histograms();
+	for (uint16_t i = 0; i < NUM_PIPELINE_STAGES; i++) {
+		strncpy(stage_histograms[i].name, pipeline_stage_names[i], 31);
+	}
+}
+
+// Upper limit of the bucket holding the given fraction of the samples, no higher than the max
+uint32_t get_stage_percentile_cycles(const stage_histogram* histogram, float fraction) {
+	uint32_t target = ceil(histogram->count * fraction);
+	uint32_t seen = 0;
+	for (uint16_t bucket = 0; bucket < STAGE_HISTOGRAM_BUCKETS; bucket++) {
+		seen += histogram->buckets[bucket];
+		if (seen >= target && seen > 0) {
+			return min(get_stage_histogram_bucket_limit(bucket), histogram->max_cycles);
+		}
+	}
+
+	return histogram->max_cycles;
+}
+
+// Every stage that ran at least once, as JSON. Times in microseconds, buckets
+// as [upper limit, count] pairs with the empty ones left out. Returns the length
+// written, or 0 if it didn't fit
+size_t write_stage_histograms_json(char* buffer, size_t buffer_size) {
+	float cycles_per_us = getCpuFrequencyMhz();
+	size_t length = 0;
+
+	auto append = [&](const char* format, auto... values) {
+		if (length < buffer_size) {
+			length += snprintf(buffer + length, buffer_size - length, format, values...);
+		}
+	};
+
+	append("{\"cpu_mhz\":%lu,\"stages\":[", uint32_t(cycles_per_us));
+
+	bool first_stage = true;
+	for (uint16_t i = 0; i < NUM_PIPELINE_STAGES + MAX_MODE_HISTOGRAMS; i++) {
+		const stage_histogram* histogram = &stage_histograms[i];
+		if (histogram->count == 0) {
+			continue;
+		}
+
+		append("%s{\"name\":\"%s\",\"count\":%lu,\"min\":%.1f,\"mean\":%.1f,\"p50\":%.1f,\"p99\":%.1f,\"max\":%.1f,\"buckets\":[",
+			first_stage ? "" : ",",
+			histogram->name,
+			histogram->count,
+			histogram->min_cycles / cycles_per_us,
+			(histogram->total_cycles / histogram->count) / cycles_per_us,
+			get_stage_percentile_cycles(histogram, 0.50) / cycles_per_us,
+			get_stage_percentile_cycles(histogram, 0.99) / cycles_per_us,
+			histogram->max_cycles / cycles_per_us
+		);
+		first_stage = false;
+
+		bool first_bucket = true;
+		for (uint16_t bucket = 0; bucket < STAGE_HISTOGRAM_BUCKETS; bucket++) {
+			if (histogram->buckets[bucket] > 0) {
+				append("%s[%.1f,%lu]", first_bucket ? "" : ",", get_stage_histogram_bucket_limit(bucket) / cycles_per_us, histogram->buckets[bucket]);
+				first_bucket = false;
+			}
+		}
+
+		append("]}");
+	}
+
+	append("],\"latency\":{");
+
+	const char* latency_names[2] = { "audio_to_photon", "audio_processing" };
+	const uint32_t* latency_histories[2] = { audio_to_photon_us, audio_processing_us };
+	for (uint8_t i = 0; i < 2; i++) {
+		uint32_t p50, p99, max_value;
+		get_latency_percentiles(latency_histories[i], &p50, &p99, &max_value);
+		append("%s\"%s\":{\"count\":%u,\"p50\":%lu,\"p99\":%lu,\"max\":%lu}", (i == 0) ? "" : ",", latency_names[i], latency_history_count, p50, p99, max_value);
+	}
+
+	append("}}");
+
+	return (length < buffer_size) ? length : 0;
+}
@@ -27,8 +27,8 @@ void init_serial(uint32_t baud_rate) {
 void init_system() {
 	extern void init_hardware_version_pins(); // (hardware_version.h)
 	extern void init_leds();
+	extern void init_decimation_filter();
 	extern void init_i2s_microphone();
-	extern void init_window_lookup();
 	extern void init_goertzel_constants_musical();
 	extern void init_goertzel_constants_full_spectrum();
 	extern void init_tempo_goertzel_constants();
@@ -37,13 +37,18 @@ void init_system() {
 	extern void init_rmt_driver();
 	extern void init_indicator_light();
 	extern void init_touch();
+	extern void run_benchmarks();
+	extern void init_job_queues();
+	extern void init_stage_histograms();
 
 	init_hardware_version_pins();       // (hardware_version.h)
+	init_stage_histograms();            // (stage_histograms.h)
 	init_serial(2000000);				// (system.h)
 	init_filesystem();                  // (filesystem.h)
 	init_configuration();               // (configuration.h)
+	init_job_queues();                  // (web_core.h)
+	init_decimation_filter();			// (goertzel.h)
 	init_i2s_microphone();				// (microphone.h)
-	init_window_lookup();				// (goertzel.h)
 	init_goertzel_constants_musical();	// (goertzel.h)
 	init_tempo_goertzel_constants();	// (tempo.h)	
 	init_indicator_light();             // (indicator.h)
@@ -56,4 +61,7 @@ void init_system() {
 
 	// Load toggles
 	load_toggles_relevant_to_mode(configuration.current_mode);
+
+	// Only does anything if BENCHMARKS_ENABLED is defined (benchmarks.h)
+	run_benchmarks();
 }
\ No newline at end of file
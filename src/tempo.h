@@ -20,7 +20,21 @@
 
 #define BEAT_SHIFT_PERCENT (0.08)
 
-#define NUM_TEMPI (64)
+#define TEMPO_TRACKER_SIZE        ( 4 )     // How many of the strongest tempi the phase tracker follows
+#define TEMPO_TRACKER_PHASE_GAIN  ( 0.2 )   // How much of the phase error the tracker corrects per measurement
+#define TEMPO_TRACKER_RATE_GAIN   ( 0.02 )  // Same, for how much the tempo is off from the bin's center
+#define TEMPO_TRACKER_MAX_RATE_CORRECTION ( 0.001 ) // Radians per reference frame, about half the spacing of the bins
+#define TEMPO_PHASE_CLOCK_REBASE  ( 4096.0 )  // tempo_phase_clock is wound back by this much before it loses precision
+
+#define SINE_LOOKUP_SIZE ( 1024 ) // Must be a power of two, sine_lookup_table in types.h has one more value
+
+#define TEMPO_HISTORY_FLOOR       ( 0.00001 ) // reduce_tempo_history() never lets the history go full zero
+#define TEMPO_HISTORY_DECAY_FOLD  ( 1e-12 )   // When tempo_history_decay gets this small, it's applied to the rings for real
+
+#define TEMPOGRAM_SAMPLES_PER_FRAME (256)  // Budget of the batched tempogram: novelty samples (times NUM_TEMPI bins) per CPU frame
+
+#define DEFAULT_TEMPO_ENGINE ( TEMPO_ENGINE_GOERTZEL ) // or TEMPO_ENGINE_AUTOCORRELATION
+#define TEMPO_FFT_SIZE       ( 2048 ) // At least twice the novelty history, so the autocorrelation doesn't wrap around
 
 bool silence_detected = true;
 float silence_level = 1.0;
@@ -31,15 +45,81 @@ float MAX_TEMPO_RANGE = 1.0;
 
 float tempi_bpm_values_hz[NUM_TEMPI];
 
-float novelty_curve[NOVELTY_HISTORY_LENGTH];
-float novelty_curve_normalized[NOVELTY_HISTORY_LENGTH];
+// Mirrored ring buffers like sample_history (see write_to_mirrored_ring() in utilities.h),
+// novelty_curve and vu_curve always point at the last NOVELTY_HISTORY_LENGTH values, oldest first
+float novelty_curve_ring[NOVELTY_HISTORY_LENGTH * 2];
+uint16_t novelty_curve_index = 0;
+float* novelty_curve = novelty_curve_ring;
+
+float vu_curve_ring[NOVELTY_HISTORY_LENGTH * 2];
+uint16_t vu_curve_index = 0;
+float* vu_curve = vu_curve_ring;
+
+// The novelty curve isn't rescaled in place anymore, multiply by this to normalize it
+windowed_max<NOVELTY_HISTORY_LENGTH> novelty_curve_max;
+float novelty_curve_scale = 1.0;
+float novelty_curve_peak = 1.0;  // What the curve is normalized to, in real values
+
+// reduce_tempo_history() doesn't touch the rings either. The real value of anything
+// in them is (stored value * tempo_history_decay), and log_novelty()/log_vu() store
+// new values divided by it. novelty_curve_scale already includes it
+float tempo_history_decay = 1.0;
 
-float vu_curve[NOVELTY_HISTORY_LENGTH];
+// The GPU core decays and appends to the history, the CPU core normalizes it and
+// folds the decay into it. Only the CPU core writes novelty_curve_scale, and it only
+// folds between tempogram passes, so a pass never sees its samples rescaled halfway
+volatile bool tempo_history_fold_requested = false;
+portMUX_TYPE tempo_history_lock = portMUX_INITIALIZER_UNLOCKED;
+
+volatile uint32_t novelty_curve_updates = 0;  // Counts log_novelty() calls, so the CPU core knows when there's something new
 
 tempo tempi[NUM_TEMPI];
 float tempi_smooth[NUM_TEMPI];
 float tempi_power_sum = 0.0;
 
+// Phases aren't advanced on every GPU frame anymore. Each bin's phase is stored
+// as of some point on tempo_phase_clock (in reference frames) and brought up to
+// date when something asks for it. Only the TEMPO_TRACKER_SIZE strongest bins
+// are followed by the phase tracker, the others take each measurement as is
+float tempo_phase_clock = 0.0;
+volatile uint32_t tempo_phase_measurements = 0;  // Counts new phase_target measurements from the CPU core
+uint32_t tempo_phase_measurements_seen = 0;
+float tempo_tracker_last_clock = 0.0;
+bool tempo_tracked[NUM_TEMPI];
+uint8_t tempo_tracker_bins[TEMPO_TRACKER_SIZE];  // The bins tempo_tracked[] is set for, strongest first
+
+bool tempogram_legacy_schedule = false;  // Only 2 bins every other frame like before, for benchmark_tempo_lock()
+
+// The batched tempogram runs all NUM_TEMPI Goertzels in one pass over the novelty
+// curve, spread over a few CPU frames. Bins are kept in "lanes" sorted by block
+// size, so the longer ones start first and the others join in as the pass reaches
+// the start of their block (see calculate_magnitudes_of_bin_group() in goertzel.h)
+uint8_t tempogram_lane_bin[NUM_TEMPI];            // Which tempo bin each lane is
+uint16_t tempogram_lane_start[NUM_TEMPI + 1];     // First novelty sample of each lane's block
+float tempogram_coeff[NUM_TEMPI];
+uint32_t tempogram_window_step[NUM_TEMPI];        // 16.16 fixed point
+uint32_t tempogram_window_pos[NUM_TEMPI];
+float tempogram_q1[NUM_TEMPI];
+float tempogram_q2[NUM_TEMPI];
+
+const float* tempogram_snapshot = NULL;           // novelty_curve as it was when the pass started, NULL between passes
+uint32_t tempogram_snapshot_update = 0;           // novelty_curve_updates at that time
+uint16_t tempogram_position = 0;                  // Next novelty sample the pass will read
+uint8_t tempogram_active_lanes = 0;
+uint16_t tempogram_pass_frames = 0;               // CPU frames since the snapshot was taken
+
+uint32_t next_novelty_update_us = 0;
+
+tempo_engine active_tempo_engine = DEFAULT_TEMPO_ENGINE;
+
+// Autocorrelation engine state: the novelty curve is transformed once, the spectrum
+// gives every tempo's phase and its power spectrum transformed again gives the
+// autocorrelation, which is read at every tempo's beat period
+float* tempo_fft_buffer = NULL;  // TEMPO_FFT_SIZE interleaved complex values, only allocated while the engine is in use
+float tempo_autocorrelation_lag[NUM_TEMPI];    // Beat period of each tempo bin, in novelty samples
+uint16_t tempo_autocorrelation_fft_bin[NUM_TEMPI];  // FFT bin closest to each tempo, for its phase
+float tempo_autocorrelation_window_energy = 1.0;    // Sum of the squared window
+
 uint16_t find_closest_tempo_bin(float target_bpm) {
 	float target_bpm_hz = target_bpm / 60.0;
 
@@ -57,38 +137,40 @@ uint16_t find_closest_tempo_bin(float target_bpm) {
 	return smallest_difference_index;
 }
 
-void init_tempo_goertzel_constants() {
+template <typename math>
+constexpr tempo_constants build_tempo_constants() {
+	tempo_constants table;
+
+	float bpm_values_hz[NUM_TEMPI] = {};
 	for (uint16_t i = 0; i < NUM_TEMPI; i++) {
 		float progress = float(i) / NUM_TEMPI;
 		float tempi_range = TEMPO_HIGH - TEMPO_LOW;
 		float tempo = tempi_range * progress + TEMPO_LOW;
 
-		tempi_bpm_values_hz[i] = tempo / 60.0;
-		//Serial.print("TEMPO HZ:");
-		//Serial.println(tempi_bpm_values_hz[i]);
+		bpm_values_hz[i] = tempo / 60.0;
 	}
 
 	for (uint16_t i = 0; i < NUM_TEMPI; i++) {
-		tempi[i].target_tempo_hz = tempi_bpm_values_hz[i];
+		table.target_tempo_hz[i] = bpm_values_hz[i];
 
-		float neighbor_left;
-		float neighbor_right;
+		float neighbor_left = 0.0;
+		float neighbor_right = 0.0;
 
 		if (i == 0) {
-			neighbor_left = tempi_bpm_values_hz[i];
-			neighbor_right = tempi_bpm_values_hz[i + 1];
+			neighbor_left = bpm_values_hz[i];
+			neighbor_right = bpm_values_hz[i + 1];
 		}
 		else if (i == NUM_TEMPI - 1) {
-			neighbor_left = tempi_bpm_values_hz[i - 1];
-			neighbor_right = tempi_bpm_values_hz[i];
+			neighbor_left = bpm_values_hz[i - 1];
+			neighbor_right = bpm_values_hz[i];
 		}
 		else {
-			neighbor_left = tempi_bpm_values_hz[i - 1];
-			neighbor_right = tempi_bpm_values_hz[i + 1];
+			neighbor_left = bpm_values_hz[i - 1];
+			neighbor_right = bpm_values_hz[i + 1];
 		}
 
-		float neighbor_left_distance_hz = fabs(neighbor_left - tempi[i].target_tempo_hz);
-		float neighbor_right_distance_hz = fabs(neighbor_right - tempi[i].target_tempo_hz);
+		float neighbor_left_distance_hz = constexpr_fabs(neighbor_left - table.target_tempo_hz[i]);
+		float neighbor_right_distance_hz = constexpr_fabs(neighbor_right - table.target_tempo_hz[i]);
 		float max_distance_hz = 0;
 
 		if (neighbor_left_distance_hz > max_distance_hz) {
@@ -98,34 +180,142 @@ void init_tempo_goertzel_constants() {
 			max_distance_hz = neighbor_right_distance_hz;
 		}
 
-		tempi[i].block_size = NOVELTY_LOG_HZ / (max_distance_hz*0.5);
+		uint32_t block_size = NOVELTY_LOG_HZ / (max_distance_hz*0.5);
 
-		if (tempi[i].block_size > NOVELTY_HISTORY_LENGTH) {
-			tempi[i].block_size = NOVELTY_HISTORY_LENGTH;
+		// Blocks end one before the newest value, so the longest one that fits is one shorter than the history
+		if (block_size > NOVELTY_HISTORY_LENGTH - 1) {
+			block_size = NOVELTY_HISTORY_LENGTH - 1;
 		}
 
-		//Serial.print("TEMPI ");
-		//Serial.print(i);
-		//Serial.print(" BLOCK SIZE: ");
-		//Serial.println(tempi[i].block_size);
+		table.block_size[i] = block_size;
+
+		float k = (int)(0.5 + ((block_size * table.target_tempo_hz[i]) / NOVELTY_LOG_HZ));
+		float w = (2.0 * PI * k) / block_size;
+		table.cosine[i] = math::cos(w);
+		table.sine[i] = math::sin(w);
+		table.coeff[i] = 2.0 * table.cosine[i];
 
-		float k = (int)(0.5 + ((tempi[i].block_size * tempi[i].target_tempo_hz) / NOVELTY_LOG_HZ));
-		float w = (2.0 * PI * k) / tempi[i].block_size;
-		tempi[i].cosine = cos(w);
-		tempi[i].sine = sin(w);
-		tempi[i].coeff = 2.0 * tempi[i].cosine;
+		table.window_step[i] = 4096.0 / block_size;
 
-		tempi[i].window_step = 4096.0 / tempi[i].block_size;
+		table.phase_radians_per_reference_frame[i] = ((2.0 * PI * table.target_tempo_hz[i]) / float(REFERENCE_FPS));
+	}
 
-		// tempi[i].target_tempo_hz *= 0.5;
+	return table;
+}
+
+template <typename math>
+constexpr void generate_sine_lookup(sine_lookup_table& table) {
+	for (uint16_t i = 0; i <= SINE_LOOKUP_SIZE; i++) {
+		table.values[i] = math::sin((2.0 * PI * (i % SINE_LOOKUP_SIZE)) / SINE_LOOKUP_SIZE);
+	}
+}
+
+constexpr sine_lookup_table bake_sine_lookup() {
+	sine_lookup_table table;
+	generate_sine_lookup<compile_time_math>(table);
+	return table;
+}
+
+static_assert(sizeof(sine_lookup_table::values) == sizeof(float) * (SINE_LOOKUP_SIZE + 1), "SINE_LOOKUP_SIZE doesn't match types.h");
+
+// Baked into flash at compile time (see constexpr_math.h)
+constexpr sine_lookup_table sine_lookup_baked = bake_sine_lookup();
+constexpr const float* sine_lookup = sine_lookup_baked.values;
+
+// sin() from sine_lookup with linear interpolation, accurate to about 5e-6
+inline float fast_sin(float radians) {
+	float position = radians * (SINE_LOOKUP_SIZE / (2.0f * float(PI)));
+	position -= floorf(position / SINE_LOOKUP_SIZE) * SINE_LOOKUP_SIZE;  // Any angle, folded into one cycle
+
+	uint16_t index = uint16_t(position);
+	float fraction = position - index;
+	index &= (SINE_LOOKUP_SIZE - 1);  // In case rounding landed right on SINE_LOOKUP_SIZE
+
+	return sine_lookup[index] + (sine_lookup[index + 1] - sine_lookup[index]) * fraction;
+}
 
-		// float radians_per_second = (PI * (tempi[i].target_tempo_hz));
-		tempi[i].phase_radians_per_reference_frame = ((2.0 * PI * tempi[i].target_tempo_hz) / float(REFERENCE_FPS));
+// Baked into flash at compile time (see constexpr_math.h)
+constexpr tempo_constants tempo_constants_baked = build_tempo_constants<compile_time_math>();
+
+// Returns false if there's no memory for the autocorrelation engine
+bool init_tempo_autocorrelation() {
+	if (tempo_fft_buffer == NULL) {
+		tempo_fft_buffer = (float*)allocate_engine_buffer(TEMPO_FFT_SIZE * 2 * sizeof(float));  // (utilities.h)
+		if (tempo_fft_buffer == NULL) {
+			printf("TEMPO: Can't allocate the autocorrelation buffer!\n");
+			return false;
+		}
+	}
+
+	init_fft_tables(TEMPO_FFT_SIZE);
+	return true;
+}
+
+void free_tempo_autocorrelation() {
+	heap_caps_free(tempo_fft_buffer);
+	tempo_fft_buffer = NULL;
+}
+
+void init_tempo_goertzel_constants() {
+	for (uint16_t i = 0; i < NUM_TEMPI; i++) {
+		tempi_bpm_values_hz[i] = tempo_constants_baked.target_tempo_hz[i];
+
+		tempi[i].target_tempo_hz = tempo_constants_baked.target_tempo_hz[i];
+		tempi[i].block_size = tempo_constants_baked.block_size[i];
+		tempi[i].cosine = tempo_constants_baked.cosine[i];
+		tempi[i].sine = tempo_constants_baked.sine[i];
+		tempi[i].coeff = tempo_constants_baked.coeff[i];
+		tempi[i].window_step = tempo_constants_baked.window_step[i];
+		tempi[i].phase_radians_per_reference_frame = tempo_constants_baked.phase_radians_per_reference_frame[i];
 
 		tempi[i].phase_inverted = false;
+		tempi[i].phase_clock = tempo_phase_clock;
+		tempi[i].phase_measurement = tempo_phase_measurements_seen;
+		tempi[i].phase_rate_correction = 0.0;
+		tempo_tracked[i] = false;
+	}
+
+	// Sort the tempogram's lanes by block size, longest first
+	for (uint16_t lane = 0; lane < NUM_TEMPI; lane++) {
+		uint16_t insert_at = lane;
+		while (insert_at > 0 && tempi[tempogram_lane_bin[insert_at - 1]].block_size < tempi[lane].block_size) {
+			tempogram_lane_bin[insert_at] = tempogram_lane_bin[insert_at - 1];
+			insert_at--;
+		}
+		tempogram_lane_bin[insert_at] = lane;
+	}
+
+	for (uint16_t lane = 0; lane < NUM_TEMPI; lane++) {
+		uint16_t tempo_bin = tempogram_lane_bin[lane];
+		tempogram_lane_start[lane] = (NOVELTY_HISTORY_LENGTH - 1) - tempi[tempo_bin].block_size;
+		tempogram_coeff[lane] = tempi[tempo_bin].coeff;
+		tempogram_window_step[lane] = (4096 << 16) / tempi[tempo_bin].block_size;
+	}
+	tempogram_lane_start[NUM_TEMPI] = NOVELTY_HISTORY_LENGTH - 1;
+
+	for (uint16_t i = 0; i < NUM_TEMPI; i++) {
+		tempo_autocorrelation_lag[i] = NOVELTY_LOG_HZ / tempi[i].target_tempo_hz;
+		tempo_autocorrelation_fft_bin[i] = uint16_t(0.5 + (tempi[i].target_tempo_hz * TEMPO_FFT_SIZE) / NOVELTY_LOG_HZ);
+	}
+
+	const uint16_t window_length = NOVELTY_HISTORY_LENGTH - 1;
+	tempo_autocorrelation_window_energy = 0.0;
+	for (uint16_t n = 0; n < window_length; n++) {
+		float window = window_lookup[uint32_t(n * (4096.0 / window_length))];
+		tempo_autocorrelation_window_energy += window * window;
+	}
+
+	if (active_tempo_engine == TEMPO_ENGINE_AUTOCORRELATION && init_tempo_autocorrelation() == false) {
+		active_tempo_engine = TEMPO_ENGINE_GOERTZEL;
 	}
 }
 
+// The floor is what reduce_tempo_history() used to clamp every value to, which is
+// what makes long silences read as a flat line
+inline float get_novelty_normalized(uint16_t index) {
+	return max(novelty_curve[index] * tempo_history_decay, float(TEMPO_HISTORY_FLOOR)) / novelty_curve_peak;
+}
+
 float unwrap_phase(float phase) {
 	while (phase - phase > M_PI) {
 		phase -= 2 * M_PI;
@@ -137,6 +327,12 @@ float unwrap_phase(float phase) {
 	return phase;
 }
 
+// Called by the tempo engines with a fresh phase measurement, it becomes the
+// bin's phase (or the phase tracker's target) on the next GPU frame
+void set_tempo_phase_target(uint16_t tempo_bin, float phase) {
+	tempi[tempo_bin].phase_target = remainder(phase, 2.0 * PI);
+}
+
 float calculate_magnitude_of_tempo(uint16_t tempo_bin) {
 	float normalized_magnitude;
 
@@ -150,7 +346,7 @@ float calculate_magnitude_of_tempo(uint16_t tempo_bin) {
 
 		for (uint16_t i = 0; i < block_size; i++) {
 			float progress = float(i) / block_size;
-			float sample_novelty = novelty_curve_normalized[((NOVELTY_HISTORY_LENGTH - 1) - block_size) + i];
+			float sample_novelty = novelty_curve[((NOVELTY_HISTORY_LENGTH - 1) - block_size) + i];
 			float sample_vu      =                 vu_curve[((NOVELTY_HISTORY_LENGTH - 1) - block_size) + i];
 			float sample = (sample_novelty + sample_vu) / 2.0;
 
@@ -165,20 +361,13 @@ float calculate_magnitude_of_tempo(uint16_t tempo_bin) {
 		float imag = (q2 * tempi[tempo_bin].sine);
 
 		// Calculate phase
-		tempi[tempo_bin].phase = (unwrap_phase(atan2(imag, real)) + (PI * BEAT_SHIFT_PERCENT));
-		
-		if (tempi[tempo_bin].phase > PI) {
-			tempi[tempo_bin].phase -= (2 * PI);
-			tempi[tempo_bin].phase_inverted = !tempi[tempo_bin].phase_inverted;
-		}
-		else if (tempi[tempo_bin].phase < -PI) {
-			tempi[tempo_bin].phase += (2 * PI);
-			tempi[tempo_bin].phase_inverted = !tempi[tempo_bin].phase_inverted;
-		}
+		set_tempo_phase_target(tempo_bin, unwrap_phase(atan2(imag, real)) + (PI * BEAT_SHIFT_PERCENT));
 
 		float magnitude_squared = (q1 * q1) + (q2 * q2) - q1 * q2 * tempi[tempo_bin].coeff;
 		float magnitude = sqrt(magnitude_squared);
-		normalized_magnitude = magnitude / (block_size / 2.0);
+
+		// The Goertzel is linear, so normalizing its output is the same as normalizing its input
+		normalized_magnitude = (magnitude * novelty_curve_scale) / (block_size / 2.0);
 
 		float progress = 1.0 - (tempo_bin / float(NUM_TEMPI));
 		progress *= progress;
@@ -191,6 +380,26 @@ float calculate_magnitude_of_tempo(uint16_t tempo_bin) {
 	return normalized_magnitude;
 }
 
+void autorange_tempi_magnitudes(float max_val) {
+	if (max_val < 0.04) {
+		max_val = 0.04;
+	}
+
+	float autoranger_scale = 1.0 / (max_val);
+
+	for (uint16_t i = 0; i < NUM_TEMPI; i++) {
+		float scaled_magnitude = (tempi[i].magnitude_full_scale * autoranger_scale);
+		if (scaled_magnitude < 0.0) {
+			scaled_magnitude = 0.0;
+		}
+		if (scaled_magnitude > 1.0) {
+			scaled_magnitude = 1.0;
+		}
+
+		tempi[i].magnitude = scaled_magnitude * scaled_magnitude * scaled_magnitude;
+	}
+}
+
 void calculate_tempi_magnitudes(int16_t single_bin = -1) {
 	profile_function([&]() {
 		float max_val = 0.0;
@@ -210,46 +419,219 @@ void calculate_tempi_magnitudes(int16_t single_bin = -1) {
 			}
 		}
 
-		if (max_val < 0.04) {
-			max_val = 0.04;
+		autorange_tempi_magnitudes(max_val);
+		tempo_phase_measurements++;
+	}, __func__ );
+}
+
+// Advances the first num_active_lanes lanes of the tempogram over num_samples novelty
+// values. Same idea as advance_goertzel_lanes() in goertzel.h: the lanes don't depend
+// on each other, so they keep the FPU busy while each sample is loaded only once
+inline void IRAM_ATTR advance_tempogram_lanes(const float* samples, uint16_t num_samples, uint8_t num_active_lanes) {
+	for (uint16_t n = 0; n < num_samples; n++) {
+		const float sample = samples[n];
+		for (uint8_t lane = 0; lane < num_active_lanes; lane++) {
+			float q0 = tempogram_coeff[lane] * tempogram_q1[lane] - tempogram_q2[lane] + sample * window_lookup[tempogram_window_pos[lane] >> 16];
+			tempogram_q2[lane] = tempogram_q1[lane];
+			tempogram_q1[lane] = q0;
+
+			tempogram_window_pos[lane] += tempogram_window_step[lane];
 		}
+	}
+}
 
-		float autoranger_scale = 1.0 / (max_val);
+void start_tempogram_pass() {
+	// No copy needed: log_novelty() only overwrites the oldest value of the mirrored
+	// ring, which the pass has long read by the time the next value comes in
+	tempogram_snapshot = novelty_curve;
+	tempogram_snapshot_update = novelty_curve_updates;
 
-		for (uint16_t i = 0; i < NUM_TEMPI; i++) {
-			float scaled_magnitude = (tempi[i].magnitude_full_scale * autoranger_scale);
-			if (scaled_magnitude < 0.0) {
-				scaled_magnitude = 0.0;
+	tempogram_position = tempogram_lane_start[0];
+	tempogram_active_lanes = 0;
+	tempogram_pass_frames = 0;
+
+	memset(tempogram_q1, 0, sizeof(tempogram_q1));
+	memset(tempogram_q2, 0, sizeof(tempogram_q2));
+	memset(tempogram_window_pos, 0, sizeof(tempogram_window_pos));
+}
+
+void finish_tempogram_pass() {
+	// The phases are of the snapshot's newest value, but the beat kept going while
+	// the pass ran. Push them forward by that much, like get_tempo_phase() would have
+	float reference_frames_elapsed = (tempogram_pass_frames * AUDIO_FRAME_INTERVAL_MS) / (1000.0 / REFERENCE_FPS);
+
+	float max_val = 0.0;
+	for (uint16_t lane = 0; lane < NUM_TEMPI; lane++) {
+		uint16_t tempo_bin = tempogram_lane_bin[lane];
+		float q1 = tempogram_q1[lane];
+		float q2 = tempogram_q2[lane];
+
+		float real = (q1 - q2 * tempi[tempo_bin].cosine);
+		float imag = (q2 * tempi[tempo_bin].sine);
+
+		// Calculate phase
+		set_tempo_phase_target(tempo_bin, (unwrap_phase(atan2(imag, real)) + (PI * BEAT_SHIFT_PERCENT)) + (tempi[tempo_bin].phase_radians_per_reference_frame * reference_frames_elapsed));
+
+		float magnitude_squared = (q1 * q1) + (q2 * q2) - q1 * q2 * tempogram_coeff[lane];
+		float magnitude = sqrt(magnitude_squared);
+
+		tempi[tempo_bin].magnitude_full_scale = (magnitude * novelty_curve_scale) / (tempi[tempo_bin].block_size / 2.0);
+		max_val = max(max_val, tempi[tempo_bin].magnitude_full_scale);
+	}
+
+	autorange_tempi_magnitudes(max_val);
+	tempo_phase_measurements++;
+
+	tempogram_snapshot = NULL;
+}
+
+// Every tempo bin is refreshed once for each new novelty value, at a cost of
+// TEMPOGRAM_SAMPLES_PER_FRAME samples per CPU frame
+void update_tempogram() {
+	profile_function([&]() {
+		if (tempogram_snapshot == NULL) {
+			if (tempogram_snapshot_update == novelty_curve_updates) {
+				return;  // Nothing new since the last pass
 			}
-			if (scaled_magnitude > 1.0) {
-				scaled_magnitude = 1.0;
+
+			start_tempogram_pass();
+		}
+
+		uint16_t slice_end = min(tempogram_position + TEMPOGRAM_SAMPLES_PER_FRAME, NOVELTY_HISTORY_LENGTH - 1);
+		while (tempogram_position < slice_end) {
+			// Lanes join in as we reach the start of their block
+			while (tempogram_active_lanes < NUM_TEMPI && tempogram_lane_start[tempogram_active_lanes] <= tempogram_position) {
+				tempogram_active_lanes++;
 			}
 
-			tempi[i].magnitude = scaled_magnitude * scaled_magnitude * scaled_magnitude;
+			uint16_t run_end = min(slice_end, tempogram_lane_start[tempogram_active_lanes]);
+			advance_tempogram_lanes(&tempogram_snapshot[tempogram_position], run_end - tempogram_position, tempogram_active_lanes);
+			tempogram_position = run_end;
+		}
+
+		tempogram_pass_frames++;
+
+		if (tempogram_position >= NOVELTY_HISTORY_LENGTH - 1) {
+			finish_tempogram_pass();
 		}
 	}, __func__ );
 }
 
-void normalize_novelty_curve_slow() {
-	static float max_val = 0.00001;
-	static float max_val_smooth = 0.1;
+// Every tempo bin in one go, from the same window of the novelty curve the longest
+// Goertzel block sees. Costs a forward and an inverse FFT instead of NUM_TEMPI
+// Goertzels over up to NOVELTY_HISTORY_LENGTH samples each
+void calculate_tempi_autocorrelation() {
+	profile_function([&]() {
+		const uint16_t window_length = NOVELTY_HISTORY_LENGTH - 1;
+		const float window_center = (window_length - 1) / 2.0;
+
+		// Without its mean, the novelty curve would correlate with itself at every lag
+		float mean = 0.0;
+		for (uint16_t n = 0; n < window_length; n++) {
+			mean += novelty_curve[n];
+		}
+		mean /= window_length;
+
+		memset(tempo_fft_buffer, 0, TEMPO_FFT_SIZE * 2 * sizeof(float));
+		float window_pos = 0.0;
+		const float window_step = 4096.0 / window_length;
+		for (uint16_t n = 0; n < window_length; n++) {
+			tempo_fft_buffer[n * 2] = (novelty_curve[n] - mean) * window_lookup[uint32_t(window_pos)];
+			window_pos += window_step;
+		}
+
+		dsps_fft2r_fc32(tempo_fft_buffer, TEMPO_FFT_SIZE);
+		dsps_bit_rev_fc32(tempo_fft_buffer, TEMPO_FFT_SIZE);
+
+		for (uint16_t i = 0; i < NUM_TEMPI; i++) {
+			uint16_t fft_bin = tempo_autocorrelation_fft_bin[i];
+			float real = tempo_fft_buffer[fft_bin * 2 + 0];
+			float imag = tempo_fft_buffer[fft_bin * 2 + 1];
+
+			// The FFT bin is only close to the tempo, but its phase is right at the centre
+			// of the window. From there, the tempo itself carries it to the newest sample
+			float fft_bin_radians_per_sample = (2.0 * PI * fft_bin) / TEMPO_FFT_SIZE;
+			float tempo_radians_per_sample = (2.0 * PI * tempi[i].target_tempo_hz) / NOVELTY_LOG_HZ;
+			float phase = atan2(imag, real) + (fft_bin_radians_per_sample * window_center) + (tempo_radians_per_sample * ((window_length - 1) - window_center));
+			set_tempo_phase_target(i, phase + (PI * BEAT_SHIFT_PERCENT));
+		}
+
+		// Power spectrum, which is real and symmetric, so a second forward FFT is the
+		// inverse one (times TEMPO_FFT_SIZE)
+		for (uint16_t f = 0; f < TEMPO_FFT_SIZE; f++) {
+			float real = tempo_fft_buffer[f * 2 + 0];
+			float imag = tempo_fft_buffer[f * 2 + 1];
+			tempo_fft_buffer[f * 2 + 0] = real * real + imag * imag;
+			tempo_fft_buffer[f * 2 + 1] = 0.0;
+		}
 
-	max_val *= 0.99;
-	for (uint16_t i = 0; i < NOVELTY_HISTORY_LENGTH; i += 4) {
-		max_val = max(max_val, novelty_curve[i + 0]);
-		max_val = max(max_val, novelty_curve[i + 1]);
-		max_val = max(max_val, novelty_curve[i + 2]);
-		max_val = max(max_val, novelty_curve[i + 3]);
+		dsps_fft2r_fc32(tempo_fft_buffer, TEMPO_FFT_SIZE);
+		dsps_bit_rev_fc32(tempo_fft_buffer, TEMPO_FFT_SIZE);
+
+		float max_val = 0.0;
+		for (uint16_t i = 0; i < NUM_TEMPI; i++) {
+			float lag = tempo_autocorrelation_lag[i];
+			uint16_t lag_index = uint16_t(lag);
+			float lag_fraction = lag - lag_index;
+
+			float autocorrelation = tempo_fft_buffer[lag_index * 2] * (1.0 - lag_fraction) + tempo_fft_buffer[(lag_index + 1) * 2] * lag_fraction;
+			autocorrelation /= TEMPO_FFT_SIZE;
+
+			// The RMS of what repeats at this period, on the same scale as a Goertzel bin's amplitude
+			float magnitude = sqrt(max(0.0f, autocorrelation) / tempo_autocorrelation_window_energy);
+
+			tempi[i].magnitude_full_scale = magnitude * novelty_curve_scale;
+			max_val = max(max_val, tempi[i].magnitude_full_scale);
+		}
+
+		autorange_tempi_magnitudes(max_val);
+		tempo_phase_measurements++;
+	}, __func__ );
+}
+
+void set_tempo_engine(tempo_engine new_engine) {
+	if (new_engine == TEMPO_ENGINE_AUTOCORRELATION) {
+		if (init_tempo_autocorrelation() == false) {
+			new_engine = TEMPO_ENGINE_GOERTZEL;
+		}
 	}
-	max_val_smooth = max(0.1f, max_val_smooth * 0.99f + max_val * 0.01f);
+	else {
+		free_tempo_autocorrelation();
+	}
+
+	tempogram_snapshot = NULL;  // Drop any half-done tempogram pass
+	tempogram_snapshot_update = novelty_curve_updates - 1;  // And start fresh right away
+	active_tempo_engine = new_engine;
+}
+
+// CPU core only. The GPU core waits on the lock for the length of the fold, which
+// happens once every few seconds of full silence. What modes draw from the history
+// isn't locked, they can see floor level values for a frame while it runs
+void fold_tempo_history_decay() {
+	profile_function([&]() {
+		portENTER_CRITICAL(&tempo_history_lock);
 
-	float auto_scale = 1.0 / max_val_smooth;
+		// Both copies of every value in the mirrored rings
+		for (uint16_t i = 0; i < NOVELTY_HISTORY_LENGTH * 2; i++) {
+			novelty_curve_ring[i] = max(novelty_curve_ring[i] * tempo_history_decay, float(TEMPO_HISTORY_FLOOR));
+			vu_curve_ring[i]      = max(     vu_curve_ring[i] * tempo_history_decay, float(TEMPO_HISTORY_FLOOR));
+		}
+
+		novelty_curve_scale /= tempo_history_decay;
+		tempo_history_decay = 1.0;
+		tempo_history_fold_requested = false;
+
+		novelty_curve_max.rebuild(novelty_curve);
+
+		portEXIT_CRITICAL(&tempo_history_lock);
+	}, __func__ );
+}
 
-	for (uint16_t i = 0; i < NOVELTY_HISTORY_LENGTH; i += 4) {
-		novelty_curve_normalized[i + 0] = clip_float(novelty_curve[i + 0] * auto_scale);
-		novelty_curve_normalized[i + 1] = clip_float(novelty_curve[i + 1] * auto_scale);
-		novelty_curve_normalized[i + 2] = clip_float(novelty_curve[i + 2] * auto_scale);
-		novelty_curve_normalized[i + 3] = clip_float(novelty_curve[i + 3] * auto_scale);
+// Called by update_tempo() before anything reads the history. A batched tempogram
+// pass holds on to novelty_curve across frames, so the fold waits for it to finish
+void fold_tempo_history_if_requested() {
+	if (tempo_history_fold_requested == true && tempogram_snapshot == NULL) {
+		fold_tempo_history_decay();
 	}
 }
 
@@ -258,17 +640,18 @@ void normalize_novelty_curve() {
 		static float max_val = 0.00001;
 		static float max_val_smooth = 0.1;
 
+		portENTER_CRITICAL(&tempo_history_lock);
+
+		// novelty_curve_max is kept up to date by log_novelty(), no need to scan the history
 		max_val *= 0.99;
-		for (uint16_t i = 0; i < NOVELTY_HISTORY_LENGTH; i += 4) {
-			max_val = max(max_val, novelty_curve[i + 0]);
-			max_val = max(max_val, novelty_curve[i + 1]);
-			max_val = max(max_val, novelty_curve[i + 2]);
-			max_val = max(max_val, novelty_curve[i + 3]);
-		}
+		max_val = max(max_val, novelty_curve_max.get() * tempo_history_decay);
+		max_val = max(max_val, float(TEMPO_HISTORY_FLOOR));
 		max_val_smooth = max(0.1f, max_val_smooth * 0.99f + max_val * 0.01f);
 
-		float auto_scale = 1.0 / max_val;
-		dsps_mulc_f32(novelty_curve, novelty_curve_normalized, NOVELTY_HISTORY_LENGTH, auto_scale, 1, 1);
+		novelty_curve_peak = max_val;
+		novelty_curve_scale = tempo_history_decay / max_val;
+
+		portEXIT_CRITICAL(&tempo_history_lock);
 	}, __func__ );
 }
 
@@ -277,9 +660,20 @@ void update_tempo() {
 		static uint32_t iter = 0;
 		iter++;
 
+		fold_tempo_history_if_requested();
 		normalize_novelty_curve();
 
-		if (iter % 2 == 0) {
+		if (active_tempo_engine == TEMPO_ENGINE_AUTOCORRELATION) {
+			// Cheap enough to do all at once, but only worth it when there's a new novelty value
+			if (tempogram_snapshot_update != novelty_curve_updates) {
+				tempogram_snapshot_update = novelty_curve_updates;
+				calculate_tempi_autocorrelation();
+			}
+		}
+		else if (tempogram_legacy_schedule == false) {
+			update_tempogram();
+		}
+		else if (iter % 2 == 0) {
 			static uint16_t calc_bin = 0;
 
 			uint16_t max_bin = (NUM_TEMPI - 1) * MAX_TEMPO_RANGE;
@@ -296,29 +690,63 @@ void update_tempo() {
 }
 
 void log_novelty(float input) {
-	shift_array_left(novelty_curve, NOVELTY_HISTORY_LENGTH, 1);
-	novelty_curve[NOVELTY_HISTORY_LENGTH - 1] = input;
+	input /= tempo_history_decay;
+	write_to_mirrored_ring(novelty_curve_ring, NOVELTY_HISTORY_LENGTH, &novelty_curve_index, &input, 1);
+	novelty_curve = &novelty_curve_ring[novelty_curve_index];
+
+	novelty_curve_max.push(input);
+	novelty_curve_updates++;
 }
 
 void log_vu(float input) {
-	shift_array_left(vu_curve, NOVELTY_HISTORY_LENGTH, 1);
-	vu_curve[NOVELTY_HISTORY_LENGTH - 1] = input;
+	input /= tempo_history_decay;
+	write_to_mirrored_ring(vu_curve_ring, NOVELTY_HISTORY_LENGTH, &vu_curve_index, &input, 1);
+	vu_curve = &vu_curve_ring[vu_curve_index];
 }
 
+// Multiplies the whole novelty and VU history by (1.0 - reduction_amount), which is
+// called on every novelty tick while it's silent. That's O(1) now, only once in a
+// while (a few seconds into full silence) does the CPU core fold the decay in
 void reduce_tempo_history(float reduction_amount) {
-	float reduction_amount_inv = 1.0 - reduction_amount;
+	tempo_history_decay *= (1.0 - reduction_amount);
 
-	for (uint16_t i = 0; i < NOVELTY_HISTORY_LENGTH; i++) {
-		novelty_curve[i] = max(novelty_curve[i] * reduction_amount_inv, 0.00001f);	// never go full zero
-		vu_curve[i]      = max(     vu_curve[i] * reduction_amount_inv, 0.00001f);
+	// New values are stored divided by the decay, which can't be allowed to grow
+	// so large that the Goertzels' squared sums overflow. The few more ticks it
+	// takes the CPU core to get to it are nowhere near that
+	if (tempo_history_decay < TEMPO_HISTORY_DECAY_FOLD) {
+		tempo_history_fold_requested = true;
 	}
 }
 
+// Forgets all tempo and novelty history, as if the device just booted
+void clear_tempo_history() {
+	memset(novelty_curve_ring, 0, sizeof(novelty_curve_ring));
+	memset(vu_curve_ring, 0, sizeof(vu_curve_ring));
+	novelty_curve_max.rebuild(novelty_curve);
+	tempo_history_decay = 1.0;
+	tempo_history_fold_requested = false;
+
+	for (uint16_t i = 0; i < NUM_TEMPI; i++) {
+		tempi[i].phase = 0.0;
+		tempi[i].phase_target = 0.0;
+		tempi[i].phase_clock = tempo_phase_clock;
+		tempi[i].phase_rate_correction = 0.0;
+		tempo_tracked[i] = false;
+		tempi[i].magnitude = 0.0;
+		tempi[i].magnitude_full_scale = 0.0;
+		tempi_smooth[i] = 0.0;
+	}
+
+	tempogram_snapshot = NULL;
+	tempogram_snapshot_update = novelty_curve_updates;
+	next_novelty_update_us = t_now_us;
+}
+
 void check_silence(float current_novelty) {
 	float min_val = 1.0;
 	float max_val = 0.0;
 	for (uint16_t i = 0; i < 128; i++) {
-		float recent_novelty = novelty_curve_normalized[(NOVELTY_HISTORY_LENGTH - 1 - 128) + i];
+		float recent_novelty = get_novelty_normalized((NOVELTY_HISTORY_LENGTH - 1 - 128) + i);
 		recent_novelty = min(0.5f, recent_novelty) * 2.0;
 
 		float scaled_value = sqrt(recent_novelty);
@@ -342,20 +770,23 @@ void check_silence(float current_novelty) {
 }
 
 void update_novelty() {
-	static uint32_t next_update = t_now_us;
-
 	const float update_interval_hz = NOVELTY_LOG_HZ;
 	const uint32_t update_interval_us = 1000000 / update_interval_hz;
 
-	if (t_now_us >= next_update) {
-		next_update += update_interval_us;
+	// Loudest of the audio frames since the last novelty update
+	if (analysis_is_new == true) {
+		vu_max = max(vu_max, analysis->vu_level);
+	}
+
+	if (t_now_us >= next_novelty_update_us) {
+		next_novelty_update_us += update_interval_us;
 
 		static uint32_t iter = 0;
 		iter++;
 
 		float current_novelty = 0.0;
 		for (uint16_t i = 0; i < NUM_FREQS; i++) {
-			float new_mag = spectrogram_smooth[i];	 // sqrt(sqrt(frequencies[i].magnitude));
+			float new_mag = analysis->spectrogram_smooth[i];	 // sqrt(sqrt(frequencies[i].magnitude));
 			frequencies_musical[i].novelty = max(0.0f, new_mag - frequencies_musical[i].magnitude_last);
 			frequencies_musical[i].magnitude_last = new_mag;
 
@@ -363,67 +794,152 @@ void update_novelty() {
 		}
 		current_novelty /= float(NUM_FREQS);
 
+		portENTER_CRITICAL(&tempo_history_lock);
+
 		check_silence(current_novelty);
 
 		log_novelty(log(1.0 + current_novelty));
 
 		log_vu(vu_max);
+
+		portEXIT_CRITICAL(&tempo_history_lock);
+
 		vu_max = 0.000001;
 	}
 }
 
-void sync_beat_phase(uint16_t tempo_bin, float delta) {
-	float push = (tempi[tempo_bin].phase_radians_per_reference_frame * delta);
-
-	tempi[tempo_bin].phase += push;
-
-	if (tempi[tempo_bin].phase > PI) {
-		tempi[tempo_bin].phase -= (2 * PI);
-		
-		tempi[tempo_bin].phase_inverted = !tempi[tempo_bin].phase_inverted;
+// Brings a bin's phase up to tempo_phase_clock
+inline void advance_tempo_phase(uint16_t tempo_bin) {
+	// Untracked bins take the latest measurement as is, but only once something asks
+	if (tempo_tracked[tempo_bin] == false && tempi[tempo_bin].phase_measurement != tempo_phase_measurements_seen) {
+		tempi[tempo_bin].phase = analysis->tempi_phase_target[tempo_bin];
+		tempi[tempo_bin].phase_clock = tempo_tracker_last_clock;
+		tempi[tempo_bin].phase_rate_correction = 0.0;
+		tempi[tempo_bin].phase_measurement = tempo_phase_measurements_seen;
 	}
-	else if (tempi[tempo_bin].phase < -PI) {
-		tempi[tempo_bin].phase += (2 * PI);
 
-		tempi[tempo_bin].phase_inverted = !tempi[tempo_bin].phase_inverted;
+	float elapsed = tempo_phase_clock - tempi[tempo_bin].phase_clock;
+	if (elapsed == 0.0) {
+		return;
 	}
 
-	/*
-	float walk_divider = 200.0;
-	float sync_distance = fabs(tempi[tempo_bin].phase - tempi[tempo_bin].phase_target);
-	if (tempi[tempo_bin].phase > tempi[tempo_bin].phase_target) {
-		tempi[tempo_bin].phase -= (sync_distance / walk_divider);
-	}
-	else if (tempi[tempo_bin].phase < tempi[tempo_bin].phase_target) {
-		tempi[tempo_bin].phase += (sync_distance / walk_divider);
+	float phase = tempi[tempo_bin].phase + (tempi[tempo_bin].phase_radians_per_reference_frame + tempi[tempo_bin].phase_rate_correction) * elapsed;
+
+	// Back into -PI to PI, phase_inverted flips every time it wraps like it used to
+	float wraps = floorf((phase + PI) / (2.0f * float(PI)));
+	if (wraps != 0.0) {
+		phase -= wraps * (2.0f * float(PI));
+		if (int32_t(wraps) & 1) {
+			tempi[tempo_bin].phase_inverted = !tempi[tempo_bin].phase_inverted;
+		}
 	}
-	*/
 
-	tempi[tempo_bin].beat = sin(tempi[tempo_bin].phase);
+	tempi[tempo_bin].phase = phase;
+	tempi[tempo_bin].phase_clock = tempo_phase_clock;
 }
 
-void update_tempi_phase(float delta) {
-	tempi_power_sum = 0.00000001;
-	// Iterate over all tempi to smooth them and calculate the power sum
-	for (uint16_t tempo_bin = 0; tempo_bin < NUM_TEMPI; tempo_bin++) {
-		float progress = float(tempo_bin) / NUM_TEMPI;
+float get_tempo_phase(uint16_t tempo_bin) {
+	advance_tempo_phase(tempo_bin);
+	return tempi[tempo_bin].phase;
+}
 
-		// Load the magnitude
-		float tempi_magnitude = tempi[tempo_bin].magnitude;
+bool get_tempo_phase_inverted(uint16_t tempo_bin) {
+	advance_tempo_phase(tempo_bin);
+	return tempi[tempo_bin].phase_inverted;
+}
 
-		// Smooth it
-		tempi_smooth[tempo_bin] = tempi_smooth[tempo_bin] * 0.975 + (tempi_magnitude) * 0.025;
-		tempi_power_sum += tempi_smooth[tempo_bin];
+// -1.0 to 1.0, peaks on the beat
+float get_tempo_beat(uint16_t tempo_bin) {
+	return fast_sin(get_tempo_phase(tempo_bin));
+}
 
-		sync_beat_phase(tempo_bin, delta);
-	}
+// Takes the latest phase measurements. The strongest bins are followed by a
+// phase-locked loop that pulls their phase (and tempo, within its bin) toward
+// the measurements. The rest jump to them, next time their phase is asked for
+void update_tempo_tracker() {
+	profile_function([&]() {
+		// One pass to find the TEMPO_TRACKER_SIZE strongest bins, strongest first
+		uint8_t strongest_bins[TEMPO_TRACKER_SIZE];
+		uint8_t num_strongest = 0;
+		for (uint16_t i = 0; i < NUM_TEMPI; i++) {
+			if (num_strongest == TEMPO_TRACKER_SIZE && tempi_smooth[i] <= tempi_smooth[strongest_bins[TEMPO_TRACKER_SIZE - 1]]) {
+				continue;
+			}
 
-	// Measure contribution factor of each tempi, calculate confidence level
-	float max_contribution = 0.000001;
-	for (uint16_t tempo_bin = 0; tempo_bin < NUM_TEMPI; tempo_bin++) {
-		float contribution = tempi_smooth[tempo_bin] / tempi_power_sum;
-		max_contribution = max(contribution, max_contribution);
-	}
+			uint8_t k = (num_strongest < TEMPO_TRACKER_SIZE) ? num_strongest++ : TEMPO_TRACKER_SIZE - 1;
+			while (k > 0 && tempi_smooth[i] > tempi_smooth[strongest_bins[k - 1]]) {
+				strongest_bins[k] = strongest_bins[k - 1];
+				k--;
+			}
+			strongest_bins[k] = i;
+		}
 
-	tempo_confidence = max_contribution;
-}
\ No newline at end of file
+		float elapsed = max(tempo_phase_clock - tempo_tracker_last_clock, 0.001f);
+		tempo_tracker_last_clock = tempo_phase_clock;
+
+		for (uint8_t k = 0; k < TEMPO_TRACKER_SIZE; k++) {
+			uint8_t i = strongest_bins[k];
+			if (tempo_tracked[i] == true) {
+				advance_tempo_phase(i);
+				float phase_error = remainder(analysis->tempi_phase_target[i] - tempi[i].phase, 2.0 * PI);
+
+				tempi[i].phase += phase_error * TEMPO_TRACKER_PHASE_GAIN;
+
+				float rate_correction = tempi[i].phase_rate_correction + (phase_error * TEMPO_TRACKER_RATE_GAIN) / elapsed;
+				tempi[i].phase_rate_correction = min(max(rate_correction, float(-TEMPO_TRACKER_MAX_RATE_CORRECTION)), float(TEMPO_TRACKER_MAX_RATE_CORRECTION));
+			}
+			else {
+				tempi[i].phase = analysis->tempi_phase_target[i];
+				tempi[i].phase_clock = tempo_phase_clock;
+				tempi[i].phase_rate_correction = 0.0;
+				tempi[i].phase_measurement = tempo_phase_measurements_seen;
+			}
+		}
+
+		// Bins that dropped out of the top keep an older phase_measurement, so
+		// advance_tempo_phase() hands them this measurement when asked
+		for (uint8_t k = 0; k < TEMPO_TRACKER_SIZE; k++) {
+			tempo_tracked[tempo_tracker_bins[k]] = false;
+		}
+		for (uint8_t k = 0; k < TEMPO_TRACKER_SIZE; k++) {
+			tempo_tracker_bins[k] = strongest_bins[k];
+			tempo_tracked[strongest_bins[k]] = true;
+		}
+	}, __func__ );
+}
+
+void update_tempi_phase(float delta) {
+	profile_function([&]() {
+		tempo_phase_clock += delta;
+
+		// Wind the clock back before floats get too coarse to count frames with
+		if (tempo_phase_clock >= TEMPO_PHASE_CLOCK_REBASE) {
+			tempo_phase_clock -= TEMPO_PHASE_CLOCK_REBASE;
+			tempo_tracker_last_clock -= TEMPO_PHASE_CLOCK_REBASE;
+			for (uint16_t tempo_bin = 0; tempo_bin < NUM_TEMPI; tempo_bin++) {
+				tempi[tempo_bin].phase_clock -= TEMPO_PHASE_CLOCK_REBASE;
+			}
+		}
+
+		tempi_power_sum = 0.00000001;
+		float max_smooth = 0.0;
+		// Iterate over all tempi to smooth them and calculate the power sum
+		for (uint16_t tempo_bin = 0; tempo_bin < NUM_TEMPI; tempo_bin++) {
+			// Load the magnitude
+			float tempi_magnitude = analysis->tempi_magnitude[tempo_bin];
+
+			// Smooth it
+			tempi_smooth[tempo_bin] = tempi_smooth[tempo_bin] * 0.975 + (tempi_magnitude) * 0.025;
+			tempi_power_sum += tempi_smooth[tempo_bin];
+			max_smooth = max(max_smooth, tempi_smooth[tempo_bin]);
+		}
+
+		if (analysis->tempo_phase_measurements != tempo_phase_measurements_seen) {
+			tempo_phase_measurements_seen = analysis->tempo_phase_measurements;
+			update_tempo_tracker();
+		}
+
+		// Contribution factor of the strongest tempo is the confidence level
+		tempo_confidence = max(max_smooth / tempi_power_sum, 0.000001f);
+	}, __func__ );
+}
@@ -0,0 +1,146 @@
+// ----------------------------------------------------------------------------------
+// trace.h
+//
+// Records what both cores were doing, in order, for chrome://tracing or
+// https://ui.perfetto.dev. Every profile_function() scope (profiler.h) adds a
+// begin and an end event while tracing is on, and a few key moments add
+// instant events (see trace_event_type in types.h).
+//
+// The events go in a fixed ring of TRACE_BUFFER_LENGTH, oldest overwritten
+// first, which both cores write to without locks. The ring is allocated by the
+// first start_trace() and kept for the download. Off, it costs one branch per
+// scope. GET /trace?start on the device starts a fresh recording, GET /trace
+// stops it and streams the JSON straight out of the ring (wireless.h). The host
+// harness can call start_trace() and write_trace_json() itself (native/).
+
+#include <atomic>
+#include <esp_heap_caps.h>
+
+#define TRACE_BUFFER_LENGTH ( 2048 ) // Must be a power of two
+#define TRACE_EVENT_TYPE_FLAG ( 0x8000 ) // Set on name_id when it's a trace_event_type and not a profiler scope
+#define TRACE_JSON_MAX_EVENT_LENGTH ( 256 ) // Room one event needs at the end of the chunk buffer
+#define TRACE_MAX_TASKS ( 16 )
+
+trace_event* trace_buffer = NULL;  // TRACE_BUFFER_LENGTH events, NULL until tracing is first started
+std::atomic<uint32_t> trace_write_index(0);
+volatile bool trace_enabled = false;
+
+const char* trace_event_type_names[NUM_TRACE_EVENT_TYPES] = {
+	"audio_chunk",
+	"analysis_acquired",
+	"command",
+	"led_transmit",
+};
+
+inline void record_trace_event(uint16_t name_id, char phase) {
+	uint32_t slot = trace_write_index.fetch_add(1) & (TRACE_BUFFER_LENGTH - 1);
+
+	trace_event* event = &trace_buffer[slot];
+	event->time_us = micros();
+	event->task = xTaskGetCurrentTaskHandle();
+	event->name_id = name_id;
+	event->phase = phase;
+	event->core = xPortGetCoreID();
+}
+
+inline void trace_instant(trace_event_type type) {
+	if (trace_enabled == true) {
+		record_trace_event(TRACE_EVENT_TYPE_FLAG | type, 'i');
+	}
+}
+
+// Returns false if there's no memory for the ring
+bool start_trace() {
+	trace_enabled = false;
+
+	if (trace_buffer == NULL) {
+		// Internal RAM keeps recording cheap, PSRAM will do if that's all there is
+		trace_buffer = (trace_event*)heap_caps_malloc(sizeof(trace_event) * TRACE_BUFFER_LENGTH, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+		if (trace_buffer == NULL) {
+			trace_buffer = (trace_event*)heap_caps_malloc(sizeof(trace_event) * TRACE_BUFFER_LENGTH, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+		}
+		if (trace_buffer == NULL) {
+			printf("TRACE: Can't allocate %u events!\n", TRACE_BUFFER_LENGTH);
+			return false;
+		}
+	}
+
+	memset(trace_buffer, 0, sizeof(trace_event) * TRACE_BUFFER_LENGTH);
+	trace_write_index = 0;
+	trace_enabled = true;
+	return true;
+}
+
+void stop_trace() {
+	trace_enabled = false;
+}
+
+// Hands out a piece of the JSON, returns false to give up on the rest
+typedef bool (*trace_json_writer)(const char* chunk, size_t length, void* context);
+
+// Chrome trace JSON of everything still in the ring, oldest first, passed to
+// write_chunk whenever buffer fills up. Stop the trace first, or events written
+// meanwhile can come out torn
+bool stream_trace_json(char* buffer, size_t buffer_size, trace_json_writer write_chunk, void* context) {
+	extern profiler_scope profiler_scopes[];
+	extern volatile uint16_t num_profiler_scopes;
+
+	if (buffer_size < TRACE_JSON_MAX_EVENT_LENGTH * 2) {
+		return false;
+	}
+
+	uint32_t end_index = trace_write_index;
+	uint32_t start_index = (end_index > TRACE_BUFFER_LENGTH) ? end_index - TRACE_BUFFER_LENGTH : 0;
+
+	// Tasks get numbered in order of appearance, and named with metadata events
+	void* tasks[TRACE_MAX_TASKS];
+	uint8_t num_tasks = 0;
+
+	size_t length = snprintf(buffer, buffer_size, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+	bool first_event = true;
+	for (uint32_t i = start_index; i < end_index; i++) {
+		const trace_event* event = &trace_buffer[i & (TRACE_BUFFER_LENGTH - 1)];
+
+		// Each snprintf() below fits in TRACE_JSON_MAX_EVENT_LENGTH, so there's always room for two
+		if (buffer_size - length < TRACE_JSON_MAX_EVENT_LENGTH * 2) {
+			if (write_chunk(buffer, length, context) == false) {
+				return false;
+			}
+			length = 0;
+		}
+
+		uint8_t tid = 0;
+		while (tid < num_tasks && tasks[tid] != event->task) {
+			tid++;
+		}
+		if (tid == num_tasks && num_tasks < TRACE_MAX_TASKS) {
+			tasks[num_tasks] = event->task;
+			num_tasks++;
+
+			length += snprintf(buffer + length, TRACE_JSON_MAX_EVENT_LENGTH, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"%.16s\"}}", first_event ? "" : ",\n", tid, pcTaskGetName((TaskHandle_t)event->task));
+			first_event = false;
+		}
+
+		const char* name = "?";
+		if (event->name_id & TRACE_EVENT_TYPE_FLAG) {
+			uint16_t type = event->name_id & ~TRACE_EVENT_TYPE_FLAG;
+			if (type < NUM_TRACE_EVENT_TYPES) {
+				name = trace_event_type_names[type];
+			}
+		}
+		else if (event->name_id < num_profiler_scopes) {
+			name = profiler_scopes[event->name_id].name;
+		}
+
+		length += snprintf(buffer + length, TRACE_JSON_MAX_EVENT_LENGTH, "%s{\"name\":\"%.128s\",\"ph\":\"%c\",\"ts\":%lu,\"pid\":0,\"tid\":%u,%s\"args\":{\"core\":%u}}",
+			first_event ? "" : ",\n", name, event->phase, (unsigned long)event->time_us, tid,
+			(event->phase == 'i') ? "\"s\":\"t\"," : "",
+			event->core
+		);
+		first_event = false;
+	}
+
+	length += snprintf(buffer + length, buffer_size - length, "\n]}\n");
+	return write_chunk(buffer, length, context);
+}
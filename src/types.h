@@ -5,15 +5,12 @@ struct command {
 	uint8_t origin_client_slot;
 };
 
-struct freq {
+struct freq {	// Goertzel constants live in spectral_analyzer::constants in goertzel.h
 	float target_freq;
-	float coeff;
-	float window_step;
 	float magnitude;
 	float magnitude_full_scale;
 	float magnitude_last;
 	float novelty;
-	uint16_t block_size;
 };
 
 struct CRGBF {	// A bit like FastLED with floating point color channels that
@@ -28,11 +25,87 @@ struct fx_dot {	 // Used to draw dots with subpixel precision and motion blur
 	float position_past = 0.5;
 };
 
+struct window_lookup_table {
+	float values[4096] = {};
+};
+
+struct sine_lookup_table {
+	float values[1024 + 1] = {};  // One cycle, plus the first value again so interpolation never has to wrap
+};
+
+template <uint16_t num_bins>
+struct goertzel_constants {	// Constants of all Goertzel bins of a spectral_analyzer, as a structure of arrays
+	float target_freq[num_bins] = {};
+	float coeff[num_bins] = {};
+	float window_step[num_bins] = {};
+	uint32_t window_step_fixed[num_bins] = {};  // window_step in 16.16 fixed point
+	float output_scale[num_bins] = {};         // Block size normalization and high-frequency boost
+	uint16_t block_size[num_bins] = {};         // At the bin's own sample rate
+	uint8_t rate_level[num_bins] = {};          // Which of get_sample_history()'s rates the bin reads
+	uint16_t max_block_size = 0;                // At the full sample rate
+};
+
+struct analysis_snapshot {	// One audio frame's worth of results, as the GPU core sees them (analysis.h)
+	uint32_t frame;                            // Counts up with every audio frame
+	float spectrogram[NUM_FREQS];
+	float spectrogram_smooth[NUM_FREQS];
+	float chromagram[12];
+	float vu_level;
+	float waveform[ANALYSIS_WAVEFORM_LENGTH];  // Newest samples, oldest first
+	float tempi_magnitude[NUM_TEMPI];
+	float tempi_phase_target[NUM_TEMPI];
+	uint32_t tempo_phase_measurements;         // Changes when tempi_phase_target does
+	uint32_t capture_us;                       // When its newest audio chunk was read (audio_source.h)
+	uint32_t publish_us;                       // When the CPU core was done with it
+};
+
+struct tempo_constants {	// Constants of all tempo Goertzel bins, copied into tempi[] at boot
+	float target_tempo_hz[NUM_TEMPI] = {};
+	float coeff[NUM_TEMPI] = {};
+	float sine[NUM_TEMPI] = {};
+	float cosine[NUM_TEMPI] = {};
+	float window_step[NUM_TEMPI] = {};
+	float phase_radians_per_reference_frame[NUM_TEMPI] = {};
+	uint32_t block_size[NUM_TEMPI] = {};
+};
+
 struct lightshow_mode {
 	char name[32];
 	void (*draw)();
 };
 
+struct audio_source {	// Anything that can fill a buffer with mono samples in the -1.0 to 1.0 range
+	char name[32];
+	bool (*read_chunk)(float* new_samples, uint16_t num_samples);  // Returns false once the source runs dry
+};
+
+enum spectral_engine {
+	SPECTRAL_ENGINE_GOERTZEL,     // Each bin recomputed over its whole block every frame
+	SPECTRAL_ENGINE_SLIDING_DFT,  // Each bin updated with only the newest chunk every frame
+	SPECTRAL_ENGINE_FFT_CONSTANT_Q // One FFT per frame, mapped onto the bins with sparse kernels
+};
+
+enum tempo_engine {
+	TEMPO_ENGINE_GOERTZEL,        // One Goertzel per tempo bin over the novelty curve
+	TEMPO_ENGINE_AUTOCORRELATION  // One FFT pair: autocorrelation for magnitudes, spectrum for phases
+};
+
+enum web_job {	// Things the CPU core wants the web task to do (web_core.h)
+	WEB_JOB_NOISE_CALIBRATION_FINISHED,  // Tell the app, save the config and noise spectrum
+	WEB_JOB_DEBUG_RECORDING_FINISHED     // Tell the app, save the recording
+};
+
+enum audio_job {	// Commands from the app for the CPU core (web_core.h)
+	AUDIO_JOB_START_NOISE_CALIBRATION,
+	AUDIO_JOB_START_DEBUG_RECORDING
+};
+
+enum synth_waveform {
+	SYNTH_TONE,
+	SYNTH_CLICK,
+	SYNTH_NOISE
+};
+
 struct slider {
 	char name[32];
 	float slider_min;
@@ -48,10 +121,20 @@ struct menu_toggle {
 	char name[32];
 };
 
-struct profiler_function {
+#define PROFILER_NO_PARENT ( 0xFFFF )
+
+struct profiler_scope_stats {	// One scope on one core, since the last print
+	uint32_t count;
+	uint32_t min_cycles;
+	uint32_t max_cycles;
+	uint64_t total_cycles;
+	uint64_t self_cycles;  // Minus the time spent in nested scopes
+};
+
+struct profiler_scope {	// One profile_function() call site (profiler.h)
 	char name[32];
-	uint32_t cycles_total;
-	uint32_t hits;
+	uint16_t parent;       // Scope it was first called from, or PROFILER_NO_PARENT
+	profiler_scope_stats cores[2];
 };
 
 struct tempo {
@@ -60,16 +143,67 @@ struct tempo {
 	float sine;
 	float cosine;
 	float window_step;
-	float phase;
-	float phase_target;
+	float phase;                  // As of phase_clock, see get_tempo_phase()
+	float phase_clock;
+	float phase_target;           // Latest measurement from the tempogram
+	uint32_t phase_measurement;   // Which measurement phase last took as is, see advance_tempo_phase()
 	bool  phase_inverted;
 	float phase_radians_per_reference_frame;
-	float beat;
+	float phase_rate_correction;  // Added by the phase tracker while it follows this bin
 	float magnitude;
 	float magnitude_full_scale;
 	uint32_t block_size;
 };
 
+#define STAGE_HISTOGRAM_BUCKETS ( 80 ) // 4 per octave, from 64 cycles to 2^26 (~280ms at 240MHz)
+
+struct stage_histogram {	// Latency of one pipeline stage since boot or the last reset (stage_histograms.h)
+	char name[32];
+	uint32_t buckets[STAGE_HISTOGRAM_BUCKETS];
+	uint32_t count;
+	uint32_t min_cycles;
+	uint32_t max_cycles;
+	uint64_t total_cycles;
+};
+
+enum pipeline_stage {	// Fixed stages, each lightshow mode's draw() follows them
+	STAGE_ACQUIRE_SAMPLE_CHUNK,
+	STAGE_CALCULATE_MAGNITUDES,
+	STAGE_UPDATE_TEMPO,
+	STAGE_CPU_FRAME,        // Everything but waiting for audio
+	STAGE_APPLY_COLOR_GRADE,
+	STAGE_POST_PROCESS_LEDS,
+	STAGE_WAIT_FOR_LEDS,      // For the RMT to be done with an output buffer
+	STAGE_SINGLE_BUFFER_WAIT, // What that would be with one output buffer, not part of any frame
+	STAGE_TRANSMIT_LEDS,    // Includes post_process_leds() and waiting for an output buffer
+	STAGE_GPU_FRAME,
+	NUM_PIPELINE_STAGES
+};
+
+struct kernel_benchmark_stats {	// Cycles per call of one kernel, over all timed runs (kernel_benchmarks.h)
+	uint32_t min_cycles;
+	uint32_t median_cycles;
+	float mean_cycles;
+	uint32_t p99_cycles;
+	uint32_t max_cycles;
+};
+
+enum trace_event_type {	// Moments worth seeing in a trace, next to the profiler scopes (trace.h)
+	TRACE_AUDIO_CHUNK,        // A chunk came out of the audio source
+	TRACE_ANALYSIS_ACQUIRED,  // The GPU core took a new analysis_snapshot
+	TRACE_COMMAND,            // A command came in from the app
+	TRACE_LED_TRANSMIT,       // rmt_transmit() was issued
+	NUM_TRACE_EVENT_TYPES
+};
+
+struct trace_event {
+	uint32_t time_us;
+	void* task;        // Which FreeRTOS task, they get their own row in the trace
+	uint16_t name_id;  // A profiler scope, or a trace_event_type with TRACE_EVENT_TYPE_FLAG set
+	char phase;        // 'B'egin, 'E'nd or 'i'nstant, like the Chrome trace format
+	uint8_t core;
+};
+
 struct websocket_client {
 	int socket;
 	uint32_t last_ping;
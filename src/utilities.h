@@ -35,7 +35,7 @@ float linear_to_tri(float input) {
 }
 
 // Can return a value between two array indices with linear interpolation
-float IRAM_ATTR interpolate(float index, float* array, uint16_t array_size) {
+float IRAM_ATTR interpolate(float index, const float* array, uint16_t array_size) {
 	float index_f = index * (array_size - 1);
 	uint16_t index_i = (uint16_t)index_f;
 	float index_f_frac = index_f - index_i;
@@ -61,6 +61,78 @@ void shift_and_copy_arrays(float history_array[], size_t history_size, const flo
 	}, __func__ );
 }
 
+// Mirrored ring buffer write: the ring is (ring_length * 2) floats long and every
+// sample is stored twice, ring_length apart. This means the most recent
+// ring_length samples are *always* contiguous in memory starting at
+// &ring[*index], oldest first, so readers can keep using a plain pointer.
+// Costs 2 * num_new_samples writes instead of moving the whole history.
+void write_to_mirrored_ring(float ring[], uint16_t ring_length, uint16_t* index, const float new_samples[], uint16_t num_new_samples) {
+	uint16_t write_index = *index;
+	uint16_t samples_remaining = num_new_samples;
+
+	while (samples_remaining > 0) {
+		// Copy up to the end of the first half, then wrap around
+		uint16_t samples_until_wrap = ring_length - write_index;
+		uint16_t samples_to_copy = min(samples_remaining, samples_until_wrap);
+
+		memcpy(&ring[write_index], new_samples, samples_to_copy * sizeof(float));
+		memcpy(&ring[write_index + ring_length], new_samples, samples_to_copy * sizeof(float));
+
+		new_samples += samples_to_copy;
+		samples_remaining -= samples_to_copy;
+
+		write_index += samples_to_copy;
+		if (write_index >= ring_length) {
+			write_index = 0;
+		}
+	}
+
+	*index = write_index;
+}
+
+// Running maximum of the last window_length values pushed, O(1) per push on average.
+// It's a monotonic deque: every value kept is larger than all the values pushed after
+// it, so the front is always the maximum. A new value evicts the smaller ones from
+// the back, since they can never be the maximum again while it's in the window.
+template <uint16_t window_length>
+struct windowed_max {
+	float values[window_length];
+	uint32_t positions[window_length];  // When each value was pushed, to know when it leaves the window
+	uint16_t head = 0;
+	uint16_t count = 0;
+	uint32_t num_pushed = 0;
+
+	void push(float value) {
+		if (count > 0 && num_pushed - positions[head] >= window_length) {
+			head = (head + 1) % window_length;
+			count--;
+		}
+
+		while (count > 0 && values[(head + count - 1) % window_length] <= value) {
+			count--;
+		}
+
+		uint16_t slot = (head + count) % window_length;
+		values[slot] = value;
+		positions[slot] = num_pushed;
+		count++;
+		num_pushed++;
+	}
+
+	float get() {
+		return (count > 0) ? values[head] : 0.0;
+	}
+
+	// For when the whole window was changed at once, pass it oldest first
+	void rebuild(const float window[window_length]) {
+		head = 0;
+		count = 0;
+		for (uint16_t i = 0; i < window_length; i++) {
+			push(window[i]);
+		}
+	}
+};
+
 // Function to shift array contents to the left
 void shift_array_left(float* array, uint16_t array_size, uint16_t shift_amount) {
 	// Check if the shift amount is greater than the array size
@@ -79,6 +151,34 @@ void shift_array_left(float* array, uint16_t array_size, uint16_t shift_amount)
 
 float clip_float(float input) { return min(1.0f, max(0.0f, input)); }
 
+// For the big buffers of engines that are off by default, so they only take up
+// memory once picked. PSRAM is used if the board has it, internal RAM if not.
+// 16-byte aligned for esp-dsp, free with heap_caps_free()
+void* allocate_engine_buffer(size_t size) {
+	void* buffer = heap_caps_aligned_alloc(16, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+	if (buffer == NULL) {
+		buffer = heap_caps_aligned_alloc(16, size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+	}
+
+	return buffer;
+}
+
+// Converts a time constant in milliseconds into the coefficient of a one-pole
+// smoother that's updated every interval_ms, so it behaves the same at any frame rate
+float time_constant_to_coefficient(float time_constant_ms, float interval_ms) {
+	if (time_constant_ms <= 0.0) {
+		return 1.0; // No smoothing
+	}
+
+	return 1.0 - exp(-interval_ms / time_constant_ms);
+}
+
+// One-pole smoother that can rise and fall at different speeds
+inline float smooth_attack_release(float current_value, float new_value, float attack_coefficient, float release_coefficient) {
+	float coefficient = (new_value > current_value) ? attack_coefficient : release_coefficient;
+	return current_value + (new_value - current_value) * coefficient;
+}
+
 // Fast approximation of the square root using Newton-Raphson method
 float fast_sqrt(float number) {
 	// Initial guess for the square root
@@ -1,10 +1,10 @@
 #define NUM_VU_AVERAGE_SAMPLES 4
 
-extern uint32_t noise_calibration_active_frames_remaining;
+extern uint32_t& noise_calibration_active_frames_remaining; // (goertzel.h)
 
 volatile float vu_level_raw = 0.0;
 volatile float vu_level = 0.0;
-volatile float vu_max = 0.0;
+float vu_max = 0.0; // GPU core, from analysis snapshots (tempo.h)
 
 float vu_history[NUM_VU_AVERAGE_SAMPLES] = { 0 };
 uint8_t vu_history_index = 0;
@@ -58,6 +58,4 @@ void run_vu(){
 		vu_sum += vu_history[i];
 	}
 	vu_level = vu_sum / NUM_VU_AVERAGE_SAMPLES;
-
-	vu_max = max(vu_max, vu_level);
 }
\ No newline at end of file
@@ -1,8 +1,76 @@
+// Main loop of the web task, on the same core as the CPU core but at a
+// lower priority. It only runs while the CPU core waits on the microphone, so
+// HTTP requests, WiFi reconnects and flash writes can take as long as they
+// like without making the CPU core late for an audio chunk.
+//
+// The two only talk through queues: web jobs are things the CPU core wants
+// done but can't wait for (flash writes, telling the app), audio jobs are
+// commands from the app that change the CPU core's state.
+
+#define WEB_JOB_QUEUE_LENGTH ( 8 )
+#define AUDIO_JOB_QUEUE_LENGTH ( 8 )
+
+QueueHandle_t web_job_queue = NULL;
+QueueHandle_t audio_job_queue = NULL;
+volatile uint32_t web_jobs_dropped = 0;
+
+void init_job_queues() {
+	web_job_queue = xQueueCreate(WEB_JOB_QUEUE_LENGTH, sizeof(web_job));
+	audio_job_queue = xQueueCreate(AUDIO_JOB_QUEUE_LENGTH, sizeof(audio_job));
+}
+
+// CPU core. Never waits, if the web task is this far behind the job is dropped
+void queue_web_job(web_job job) {
+	if (web_job_queue == NULL || xQueueSend(web_job_queue, &job, 0) != pdTRUE) {
+		web_jobs_dropped++;
+	}
+}
+
+// Web task (or the HTTP server's), waits for room if it has to
+void queue_audio_job(audio_job job) {
+	if (audio_job_queue != NULL) {
+		xQueueSend(audio_job_queue, &job, portMAX_DELAY);
+	}
+}
+
+// CPU core, once per audio frame
+void run_audio_jobs() {
+	audio_job job;
+	while (xQueueReceive(audio_job_queue, &job, 0) == pdTRUE) {
+		if (job == AUDIO_JOB_START_NOISE_CALIBRATION) {
+			start_noise_calibration();  // (goertzel.h)
+		}
+		else if (job == AUDIO_JOB_START_DEBUG_RECORDING) {
+			audio_recording_index = 0;
+			memset(audio_debug_recording, 0, sizeof(int16_t)*MAX_AUDIO_RECORDING_SAMPLES);
+			audio_recording_live = true;
+		}
+	}
+}
+
+void run_web_jobs() {
+	web_job job;
+	while (xQueueReceive(web_job_queue, &job, 0) == pdTRUE) {
+		if (job == WEB_JOB_NOISE_CALIBRATION_FINISHED) {
+			// Let the UI know
+			broadcast("noise_cal_ready");
+			save_config();
+			save_noise_spectrum();
+		}
+		else if (job == WEB_JOB_DEBUG_RECORDING_FINISHED) {
+			broadcast("debug_recording_ready");
+			save_audio_debug_recording();
+		}
+	}
+}
+
 void run_web() {
 	profile_function([&]() {
 		handle_wifi();
 		dns_server.processNextRequest();
 
+		run_web_jobs();
+
 		if (web_server_ready == true && wifi_config_mode == false) {
 			process_command_queue();
 			discovery_check_in();
@@ -10,5 +78,8 @@ void run_web() {
 			// Write pending changes to LittleFS
 			sync_configuration_to_file_system();
 		}
+
+		// Occasionally print the average frame rate
+		print_system_info();  // (profiler.h)
 	}, __func__ );
-}
\ No newline at end of file
+}
@@ -270,6 +270,64 @@ void init_web_server() {
    		return request->reply(mac_str);
 	});
 
+	// ?start begins a fresh recording, without it the recording stops and downloads
+	server.on("/trace", HTTP_GET, [](PsychicRequest *request) {
+		if(request->hasParam("start") == true){
+			if(start_trace() == false){
+				return request->reply(500);
+			}
+			return request->reply("Tracing, GET /trace to stop and download");
+		}
+
+		stop_trace();
+
+		const size_t buffer_size = 2048;
+		char* buffer = (char*)malloc(buffer_size);
+		if(buffer == NULL){
+			return request->reply(500);
+		}
+
+		// Chunked straight out of the ring, the whole thing would be ~180KB
+		PsychicResponse response(request);
+		response.setCode(200);
+		response.setContentType("application/json");
+		response.sendHeaders();
+
+		bool sent = stream_trace_json(buffer, buffer_size, [](const char* chunk, size_t length, void* context) {
+			return ((PsychicResponse*)context)->sendChunk((uint8_t*)chunk, length) == ESP_OK;
+		}, &response);
+		free(buffer);
+
+		if(sent == false){
+			return ESP_FAIL;  // Headers are out already, dropping the connection is all that's left
+		}
+
+		return response.finishChunking();
+	});
+
+	server.on("/histograms", HTTP_GET, [](PsychicRequest *request) {
+		const size_t buffer_size = 16384;
+		char* buffer = (char*)malloc(buffer_size);
+		if (buffer == NULL) {
+			return request->reply(500);
+		}
+
+		esp_err_t result;
+		if (write_stage_histograms_json(buffer, buffer_size) > 0) {
+			result = request->reply(200, "application/json", buffer);
+		}
+		else {
+			result = request->reply(500);
+		}
+		free(buffer);
+
+		if (request->hasParam("reset") == true) {
+			reset_stage_histograms();
+		}
+
+		return result;
+	});
+
 	server.on("/*", HTTP_GET, [](PsychicRequest *request) {
 		esp_err_t result = ESP_OK;
 		String path = "";
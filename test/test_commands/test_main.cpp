@@ -0,0 +1,175 @@
+// ----------------------------------------------------------------------------------
+// Command parsing (commands.h), as the app's websocket messages reach it
+//
+//   pio test -e native -f test_commands
+
+#include <unity.h>
+
+#include "../../src/native/native_firmware.h"
+
+void run_command(const char* text, uint8_t client_slot = 0) {
+	command com;
+	memset(&com, 0, sizeof(command));
+	strncpy(com.command, text, MAX_COMMAND_LENGTH - 1);
+	com.origin_client_slot = client_slot;
+
+	parse_command(t_now_ms, com);  // (commands.h)
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_load_substring_from_split_index() {
+	char result[MAX_COMMAND_LENGTH];
+
+	TEST_ASSERT_TRUE(load_substring_from_split_index("set|brightness|0.5", 0, result, sizeof(result)));
+	TEST_ASSERT_EQUAL_STRING("set", result);
+	TEST_ASSERT_TRUE(load_substring_from_split_index("set|brightness|0.5", 2, result, sizeof(result)));
+	TEST_ASSERT_EQUAL_STRING("0.5", result);
+
+	// Empty segments are still segments
+	TEST_ASSERT_TRUE(load_substring_from_split_index("a||c", 1, result, sizeof(result)));
+	TEST_ASSERT_EQUAL_STRING("", result);
+
+	TEST_ASSERT_TRUE(load_substring_from_split_index("a,b", 1, result, sizeof(result), ','));
+	TEST_ASSERT_EQUAL_STRING("b", result);
+}
+
+void test_load_substring_from_split_index_rejects_bad_input() {
+	char result[4];
+
+	TEST_ASSERT_FALSE(load_substring_from_split_index("set|brightness", 2, result, sizeof(result)));
+	TEST_ASSERT_FALSE(load_substring_from_split_index("set|brightness", 1, result, sizeof(result)));  // Doesn't fit
+	TEST_ASSERT_FALSE(load_substring_from_split_index(NULL, 0, result, sizeof(result)));
+}
+
+void test_set_brightness_is_clipped_and_saved_later() {
+	save_request_open = false;
+
+	run_command("set|brightness|0.42");
+	TEST_ASSERT_FLOAT_WITHIN(0.0001, 0.42, configuration.brightness);
+	TEST_ASSERT_TRUE(save_request_open);
+
+	run_command("set|brightness|7.0");
+	TEST_ASSERT_FLOAT_WITHIN(0.0001, 1.0, configuration.brightness);
+}
+
+void test_set_toggles() {
+	run_command("set|mirror_mode|0");
+	TEST_ASSERT_FALSE(configuration.mirror_mode);
+	run_command("set|mirror_mode|1");
+	TEST_ASSERT_TRUE(configuration.mirror_mode);
+}
+
+void test_set_touch_thresholds() {
+	run_command("set|touch_thresholds|1000|2000|3000");
+
+	TEST_ASSERT_EQUAL_UINT32(1000, configuration.touch_left_threshold);
+	TEST_ASSERT_EQUAL_UINT32(2000, touch_pins[TOUCH_CENTER].threshold);
+	TEST_ASSERT_EQUAL_UINT32(3000, touch_pins[TOUCH_RIGHT].threshold);
+}
+
+void test_set_mode_by_name() {
+	run_command("set|mode|Spectrum", 3);
+
+	TEST_ASSERT_EQUAL_STRING("Spectrum", lightshow_modes[configuration.current_mode].name);
+	TEST_ASSERT_EQUAL_STRING("mode_selected", last_client_message);
+	TEST_ASSERT_EQUAL_UINT8(3, last_client_slot);
+}
+
+void test_get_version_answers_the_asking_client() {
+	uint32_t messages_before = client_messages_sent;
+	run_command("get|version", 5);
+
+	char expected[32];
+	snprintf(expected, 32, "version|%d.%d.%d", SOFTWARE_VERSION_MAJOR, SOFTWARE_VERSION_MINOR, SOFTWARE_VERSION_PATCH);
+
+	TEST_ASSERT_EQUAL_STRING(expected, last_client_message);
+	TEST_ASSERT_EQUAL_UINT8(5, last_client_slot);
+	TEST_ASSERT_EQUAL_UINT32(messages_before + 1, client_messages_sent);
+}
+
+void test_get_modes_ends_with_modes_ready() {
+	uint32_t messages_before = client_messages_sent;
+	run_command("get|modes");
+
+	uint16_t num_modes = sizeof(lightshow_modes) / sizeof(lightshow_mode);
+	TEST_ASSERT_EQUAL_STRING("modes_ready", last_client_message);
+	TEST_ASSERT_EQUAL_UINT32(messages_before + num_modes + 2, client_messages_sent);  // clear_modes, the modes, modes_ready
+}
+
+void test_get_config_broadcasts() {
+	uint32_t messages_before = websocket_handler.messages_sent;
+	run_command("get|config");
+
+	TEST_ASSERT_EQUAL_STRING("config_ready", websocket_handler.last_message);
+	TEST_ASSERT_TRUE(websocket_handler.messages_sent > messages_before);
+}
+
+void test_noise_cal_queues_an_audio_job() {
+	uint32_t jobs_before = audio_jobs_queued;
+	run_command("noise_cal");
+
+	TEST_ASSERT_EQUAL_UINT32(jobs_before + 1, audio_jobs_queued);
+	TEST_ASSERT_EQUAL(AUDIO_JOB_START_NOISE_CALIBRATION, last_audio_job);
+}
+
+void test_reset_restarts() {
+	uint32_t restarts_before = ESP.restart_count;
+	run_command("reset");
+
+	TEST_ASSERT_EQUAL_STRING("disconnect_immediately", last_client_message);
+	TEST_ASSERT_EQUAL_UINT32(restarts_before + 1, ESP.restart_count);
+}
+
+void test_unknown_commands_change_nothing() {
+	config configuration_before = configuration;
+	uint32_t messages_before = client_messages_sent;
+
+	run_command("set|nonsense|1.0");
+	run_command("get|nonsense");
+	run_command("nonsense");
+	run_command("");
+
+	TEST_ASSERT_EQUAL_MEMORY(&configuration_before, &configuration, sizeof(config));
+	TEST_ASSERT_EQUAL_UINT32(messages_before, client_messages_sent);
+}
+
+void test_command_queue() {
+	char text[] = "set|brightness|0.25";
+	commands_queued = 0;
+
+	TEST_ASSERT_TRUE(queue_command(text, strlen(text), 0));
+	TEST_ASSERT_EQUAL_UINT16(1, commands_queued);
+
+	process_command_queue();
+	TEST_ASSERT_EQUAL_UINT16(0, commands_queued);
+	TEST_ASSERT_FLOAT_WITHIN(0.0001, 0.25, configuration.brightness);
+
+	// One slot is always kept free
+	for (uint16_t i = 0; i < COMMAND_QUEUE_SLOTS - 1; i++) {
+		TEST_ASSERT_TRUE(queue_command(text, strlen(text), 0));
+	}
+	TEST_ASSERT_FALSE(queue_command(text, strlen(text), 0));
+	commands_queued = 0;
+}
+
+int main() {
+	init_native_firmware();  // (native_firmware.h)
+
+	UNITY_BEGIN();
+	RUN_TEST(test_load_substring_from_split_index);
+	RUN_TEST(test_load_substring_from_split_index_rejects_bad_input);
+	RUN_TEST(test_set_brightness_is_clipped_and_saved_later);
+	RUN_TEST(test_set_toggles);
+	RUN_TEST(test_set_touch_thresholds);
+	RUN_TEST(test_set_mode_by_name);
+	RUN_TEST(test_get_version_answers_the_asking_client);
+	RUN_TEST(test_get_modes_ends_with_modes_ready);
+	RUN_TEST(test_get_config_broadcasts);
+	RUN_TEST(test_noise_cal_queues_an_audio_job);
+	RUN_TEST(test_reset_restarts);
+	RUN_TEST(test_unknown_commands_change_nothing);
+	RUN_TEST(test_command_queue);
+	return UNITY_END();
+}
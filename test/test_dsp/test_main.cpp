@@ -0,0 +1,277 @@
+// ----------------------------------------------------------------------------------
+// Audio DSP (goertzel.h, tempo.h, utilities.h) and the esp-dsp shim under it, plus
+// the DSP table and audio latency checks from benchmarks.h
+//
+//   pio test -e native -f test_dsp
+
+#include <unity.h>
+
+#include "../../src/native/native_firmware.h"
+
+void fill_sample_history(float frequency_hz) {
+	for (uint16_t i = 0; i < CHUNK_SIZE * 64; i += CHUNK_SIZE) {
+		float new_samples[CHUNK_SIZE];
+		for (uint16_t n = 0; n < CHUNK_SIZE; n++) {
+			new_samples[n] = sin(2.0 * M_PI * frequency_hz * (i + n) / SAMPLE_RATE) * 0.5;
+		}
+		musical_analyzer.write_to_sample_history(new_samples);
+	}
+}
+
+// Same as above, for analyzers other than musical_analyzer
+template <typename analyzer_type>
+void fill_analyzer_history(analyzer_type* analyzer, float frequency_hz) {
+	for (uint16_t i = 0; i < CHUNK_SIZE * 64; i += CHUNK_SIZE) {
+		float new_samples[CHUNK_SIZE];
+		for (uint16_t n = 0; n < CHUNK_SIZE; n++) {
+			new_samples[n] = sin(2.0 * M_PI * frequency_hz * (i + n) / SAMPLE_RATE) * 0.5;
+		}
+		analyzer->write_to_sample_history(new_samples);
+	}
+}
+
+template <typename analyzer_type>
+uint16_t find_loudest_bin(analyzer_type* analyzer, uint16_t num_bins) {
+	float peak_magnitude = 0.0;
+	uint16_t peak_bin = 0;
+	for (uint16_t bin = 0; bin < num_bins; bin++) {
+		float magnitude = analyzer->calculate_magnitude_of_bin(bin);
+		if (magnitude > peak_magnitude) {
+			peak_magnitude = magnitude;
+			peak_bin = bin;
+		}
+	}
+
+	return peak_bin;
+}
+
+void setUp() {}
+
+void tearDown() {
+	musical_analyzer.clear_sample_history();
+}
+
+void test_fft_matches_dft() {
+	const uint16_t fft_size = 256;
+	static float data[fft_size * 2];
+	static float input[fft_size * 2];
+
+	for (uint16_t i = 0; i < fft_size; i++) {
+		input[2 * i + 0] = sin(i * 0.3) + 0.5 * cos(i * 1.7);
+		input[2 * i + 1] = 0.0;
+	}
+	memcpy(data, input, sizeof(data));
+
+	init_fft_tables(fft_size);  // (goertzel.h)
+	TEST_ASSERT_EQUAL(ESP_OK, dsps_fft2r_fc32(data, fft_size));
+	TEST_ASSERT_EQUAL(ESP_OK, dsps_bit_rev_fc32(data, fft_size));
+
+	for (uint16_t k = 0; k < fft_size; k += 7) {
+		double re = 0.0;
+		double im = 0.0;
+		for (uint16_t n = 0; n < fft_size; n++) {
+			re += input[2 * n] * cos(2.0 * M_PI * k * n / fft_size);
+			im -= input[2 * n] * sin(2.0 * M_PI * k * n / fft_size);
+		}
+
+		TEST_ASSERT_FLOAT_WITHIN(0.001, re, data[2 * k + 0]);
+		TEST_ASSERT_FLOAT_WITHIN(0.001, im, data[2 * k + 1]);
+	}
+}
+
+void test_goertzel_lanes_match_single_bins() {
+	fill_sample_history(440.0);
+
+	float scalar_magnitudes[NUM_FREQS];
+	float lane_magnitudes[NUM_FREQS];
+	for (uint16_t bin = 0; bin < NUM_FREQS; bin++) {
+		scalar_magnitudes[bin] = musical_analyzer.calculate_magnitude_of_bin(bin);
+	}
+	for (uint16_t bin = 0; bin < NUM_FREQS; bin += GOERTZEL_LANES) {
+		musical_analyzer.calculate_magnitudes_of_bin_group(bin, &lane_magnitudes[bin]);
+	}
+
+	// Bins far from the tone are close to zero, so errors are relative to the peak
+	float peak_magnitude = 0.0;
+	float max_error = 0.0;
+	for (uint16_t bin = 0; bin < NUM_FREQS; bin++) {
+		peak_magnitude = max(peak_magnitude, scalar_magnitudes[bin]);
+		max_error = max(max_error, fabsf(lane_magnitudes[bin] - scalar_magnitudes[bin]));
+	}
+
+	TEST_ASSERT_TRUE(peak_magnitude > 0.0);
+	TEST_ASSERT_TRUE(max_error / peak_magnitude < 0.001);
+}
+
+void test_goertzel_finds_the_tone() {
+	uint16_t target_bin = NUM_FREQS / 2;
+	fill_sample_history(frequencies_musical[target_bin].target_freq);
+
+	float peak_magnitude = 0.0;
+	uint16_t peak_bin = 0;
+	for (uint16_t bin = 0; bin < NUM_FREQS; bin++) {
+		float magnitude = musical_analyzer.calculate_magnitude_of_bin(bin);
+		if (magnitude > peak_magnitude) {
+			peak_magnitude = magnitude;
+			peak_bin = bin;
+		}
+	}
+
+	TEST_ASSERT_UINT16_WITHIN(1, target_bin, peak_bin);
+}
+
+void test_silence_has_no_magnitude() {
+	for (uint16_t bin = 0; bin < NUM_FREQS; bin++) {
+		TEST_ASSERT_EQUAL_FLOAT(0.0, musical_analyzer.calculate_magnitude_of_bin(bin));
+	}
+}
+
+void test_fft_constant_q_state_only_exists_while_in_use() {
+	TEST_ASSERT_NULL(musical_analyzer.fft_constant_q);
+
+	musical_analyzer.set_spectral_engine(SPECTRAL_ENGINE_FFT_CONSTANT_Q);
+	TEST_ASSERT_EQUAL(SPECTRAL_ENGINE_FFT_CONSTANT_Q, musical_analyzer.engine);
+	TEST_ASSERT_NOT_NULL(musical_analyzer.fft_constant_q);
+	TEST_ASSERT_EQUAL_UINT32(0, uintptr_t(musical_analyzer.fft_constant_q->buffer) % 16);
+
+	musical_analyzer.set_spectral_engine(SPECTRAL_ENGINE_GOERTZEL);
+	TEST_ASSERT_NULL(musical_analyzer.fft_constant_q);
+}
+
+void test_tempo_history_fold_waits_for_the_tempogram_pass() {
+	for (uint16_t i = 0; i < NOVELTY_HISTORY_LENGTH; i++) {
+		log_novelty(0.5);
+	}
+	while (tempo_history_fold_requested == false) {
+		reduce_tempo_history(0.5);
+	}
+
+	float stored_value = novelty_curve[NOVELTY_HISTORY_LENGTH - 1];
+	tempogram_snapshot = novelty_curve;  // A pass is still reading it
+	fold_tempo_history_if_requested();
+	TEST_ASSERT_EQUAL_FLOAT(stored_value, novelty_curve[NOVELTY_HISTORY_LENGTH - 1]);
+	TEST_ASSERT_TRUE(tempo_history_fold_requested);
+
+	tempogram_snapshot = NULL;
+	fold_tempo_history_if_requested();
+	TEST_ASSERT_FALSE(tempo_history_fold_requested);
+	TEST_ASSERT_EQUAL_FLOAT(1.0, tempo_history_decay);
+	TEST_ASSERT_EQUAL_FLOAT(TEMPO_HISTORY_FLOOR, novelty_curve[NOVELTY_HISTORY_LENGTH - 1]);
+
+	clear_tempo_history();
+}
+
+void test_only_the_strongest_tempi_are_tracked() {
+	const uint16_t strongest_bins[TEMPO_TRACKER_SIZE] = { 5, 9, 20, 40 };
+	for (uint16_t i = 0; i < NUM_TEMPI; i++) {
+		tempi_smooth[i] = 0.01;
+		tempi[i].phase_target = (i % 6) * 0.5 - 1.25;
+	}
+	for (uint8_t k = 0; k < TEMPO_TRACKER_SIZE; k++) {
+		tempi_smooth[strongest_bins[k]] = 1.0 - k * 0.1;
+	}
+
+	tempo_phase_measurements++;
+	publish_analysis_snapshot();
+	acquire_analysis_snapshot();
+	update_tempi_phase(1.0);
+
+	uint16_t num_tracked = 0;
+	for (uint16_t i = 0; i < NUM_TEMPI; i++) {
+		num_tracked += tempo_tracked[i];
+	}
+	TEST_ASSERT_EQUAL(TEMPO_TRACKER_SIZE, num_tracked);
+	for (uint8_t k = 0; k < TEMPO_TRACKER_SIZE; k++) {
+		TEST_ASSERT_TRUE(tempo_tracked[strongest_bins[k]]);
+	}
+
+	// Untracked bins take the measurement as is once asked
+	TEST_ASSERT_FLOAT_WITHIN(0.0001, tempi[33].phase_target, get_tempo_phase(33));
+
+	clear_tempo_history();
+}
+
+void test_click_reaches_the_analysis_in_time() {
+	TEST_ASSERT_TRUE(test_audio_latency());  // (benchmarks.h)
+}
+
+void test_analyzers_of_different_sizes_find_the_same_note() {
+	// Both are too big for the stack
+	spectral_analyzer<32, CHUNK_SIZE, SAMPLE_RATE, SAMPLE_HISTORY_LENGTH>* whole_tones = new spectral_analyzer<32, CHUNK_SIZE, SAMPLE_RATE, SAMPLE_HISTORY_LENGTH>;
+	spectral_analyzer<128, CHUNK_SIZE, SAMPLE_RATE, SAMPLE_HISTORY_LENGTH>* quarter_tones = new spectral_analyzer<128, CHUNK_SIZE, SAMPLE_RATE, SAMPLE_HISTORY_LENGTH>;
+	whole_tones->init();
+	quarter_tones->init();
+
+	// Whole step 10 is quarter step 40, from the same BOTTOM_NOTE
+	float frequency_hz = whole_tones->bins[10].target_freq;
+	TEST_ASSERT_FLOAT_WITHIN(0.001, frequency_hz, quarter_tones->bins[40].target_freq);
+
+	fill_analyzer_history(whole_tones, frequency_hz);
+	fill_analyzer_history(quarter_tones, frequency_hz);
+
+	TEST_ASSERT_EQUAL_UINT16(10, find_loudest_bin(whole_tones, 32));
+
+	// Neighboring quarter steps can round to the same block size and k, which
+	// makes them the same filter, so either one of them may come out on top
+	TEST_ASSERT_UINT16_WITHIN(1, 40, find_loudest_bin(quarter_tones, 128));
+
+	delete whole_tones;
+	delete quarter_tones;
+}
+
+void test_dsp_tables_are_bit_exact() {
+	TEST_ASSERT_TRUE(verify_dsp_tables());  // (benchmarks.h)
+}
+
+void test_median_filter_removes_spikes() {
+	float column[NUM_FREQS];
+	for (uint16_t i = 0; i < NUM_FREQS; i++) {
+		column[i] = 0.5;
+	}
+	column[NUM_FREQS / 2] = 10.0;
+
+	median_filter(column);
+
+	TEST_ASSERT_FLOAT_WITHIN(0.0001, 0.5, column[NUM_FREQS / 2]);
+}
+
+void test_interpolate() {
+	const float array[3] = { 0.0, 1.0, 3.0 };
+
+	TEST_ASSERT_FLOAT_WITHIN(0.0001, 0.0, interpolate(0.0, array, 3));
+	TEST_ASSERT_FLOAT_WITHIN(0.0001, 2.0, interpolate(0.75, array, 3));
+	TEST_ASSERT_FLOAT_WITHIN(0.0001, 3.0, interpolate(1.0, array, 3));
+}
+
+void test_write_to_mirrored_ring() {
+	float ring[8 * 2] = { 0.0 };
+	uint16_t index = 0;
+	const float new_samples[5] = { 1, 2, 3, 4, 5 };
+
+	write_to_mirrored_ring(ring, 8, &index, new_samples, 5);
+	write_to_mirrored_ring(ring, 8, &index, new_samples, 5);
+
+	// The newest 8 samples are always contiguous, starting at index
+	const float expected[8] = { 3, 4, 5, 1, 2, 3, 4, 5 };
+	TEST_ASSERT_EQUAL_FLOAT_ARRAY(expected, &ring[index], 8);
+}
+
+int main() {
+	init_native_firmware();  // (native_firmware.h)
+
+	UNITY_BEGIN();
+	RUN_TEST(test_fft_matches_dft);
+	RUN_TEST(test_goertzel_lanes_match_single_bins);
+	RUN_TEST(test_goertzel_finds_the_tone);
+	RUN_TEST(test_silence_has_no_magnitude);
+	RUN_TEST(test_fft_constant_q_state_only_exists_while_in_use);
+	RUN_TEST(test_tempo_history_fold_waits_for_the_tempogram_pass);
+	RUN_TEST(test_only_the_strongest_tempi_are_tracked);
+	RUN_TEST(test_click_reaches_the_analysis_in_time);
+	RUN_TEST(test_analyzers_of_different_sizes_find_the_same_note);
+	RUN_TEST(test_dsp_tables_are_bit_exact);
+	RUN_TEST(test_median_filter_removes_spikes);
+	RUN_TEST(test_interpolate);
+	RUN_TEST(test_write_to_mirrored_ring);
+	return UNITY_END();
+}
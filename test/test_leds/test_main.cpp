@@ -0,0 +1,334 @@
+// ----------------------------------------------------------------------------------
+// LED math (leds.h, led_driver.h)
+//
+//   pio test -e native -f test_leds
+
+#include <unity.h>
+
+#include "../../src/native/native_firmware.h"
+
+void setUp() {
+	memset(leds, 0, sizeof(CRGBF) * NUM_LEDS);
+}
+
+void tearDown() {}
+
+void test_hsv_follows_the_lookup_table() {
+	for (uint16_t i = 0; i < 255; i += 17) {  // A hue of 1.0 wraps around to 0.0
+		CRGBF color = hsv(i / 255.0, 1.0, 1.0);
+
+		TEST_ASSERT_FLOAT_WITHIN(0.002, hsv_lookup[i][0] / 255.0, color.r);
+		TEST_ASSERT_FLOAT_WITHIN(0.002, hsv_lookup[i][1] / 255.0, color.g);
+		TEST_ASSERT_FLOAT_WITHIN(0.002, hsv_lookup[i][2] / 255.0, color.b);
+	}
+}
+
+void test_hsv_wraps_hue_and_clips_value() {
+	CRGBF color = hsv(0.3, 0.8, 0.6);
+	CRGBF wrapped = hsv(1.3, 0.8, 0.6);
+	CRGBF negative = hsv(-0.7, 0.8, 0.6);
+
+	TEST_ASSERT_FLOAT_WITHIN(0.0001, color.r, wrapped.r);
+	TEST_ASSERT_FLOAT_WITHIN(0.0001, color.g, wrapped.g);
+	TEST_ASSERT_FLOAT_WITHIN(0.0001, color.b, negative.b);
+
+	CRGBF full = hsv(0.3, 0.8, 1.0);
+	CRGBF too_bright = hsv(0.3, 0.8, 5.0);
+	TEST_ASSERT_FLOAT_WITHIN(0.0001, full.g, too_bright.g);
+}
+
+void test_hsv_without_saturation_is_gray() {
+	CRGBF color = hsv(0.6, 0.0, 0.5);
+
+	TEST_ASSERT_FLOAT_WITHIN(0.0001, color.r, color.g);
+	TEST_ASSERT_FLOAT_WITHIN(0.0001, color.g, color.b);
+}
+
+void test_palette_matches_hsv() {
+	configuration.color = 0.8;  // Wraps around past 1.0
+	configuration.color_range = 0.5;
+	configuration.saturation = 0.7;
+
+	for (uint8_t mirrored = 0; mirrored < 2; mirrored++) {
+		configuration.mirror_mode = mirrored;
+		uint16_t ramp_length = (mirrored == true) ? (NUM_LEDS >> 1) : NUM_LEDS;
+
+		const color_palette* palette = get_palette();
+		for (uint16_t i = 0; i < ramp_length; i++) {
+			float progress = float(i) / ramp_length;
+			float v = (i % 7) / 5.0;  // Some of them over 1.0
+			CRGBF expected = hsv(configuration.color + (progress * configuration.color_range), configuration.saturation, v);
+			CRGBF color = get_palette_color(palette, i, v);
+
+			TEST_ASSERT_FLOAT_WITHIN(0.00001, expected.r, color.r);
+			TEST_ASSERT_FLOAT_WITHIN(0.00001, expected.g, color.g);
+			TEST_ASSERT_FLOAT_WITHIN(0.00001, expected.b, color.b);
+		}
+	}
+}
+
+void test_palette_follows_the_settings() {
+	configuration.color = 0.0;
+	configuration.color_range = 0.0;
+	configuration.saturation = 1.0;
+	configuration.mirror_mode = false;
+	CRGBF red = get_palette()->colors[0];
+
+	configuration.color = 0.5;
+	CRGBF cyan = get_palette()->colors[0];
+
+	TEST_ASSERT_FLOAT_WITHIN(0.01, 1.0, red.r);
+	TEST_ASSERT_FLOAT_WITHIN(0.01, 0.0, cyan.r);
+
+	// Modes branch on the palette's own copy, the ramp it built is that long
+	TEST_ASSERT_FALSE(get_palette()->mirror_mode);
+	configuration.mirror_mode = true;
+	TEST_ASSERT_TRUE(get_palette()->mirror_mode);
+	configuration.mirror_mode = false;
+}
+
+void test_clip_leds() {
+	leds[0] = { -1.0, 0.5, 2.0 };
+	leds[NUM_LEDS - 1] = { 1.5, -0.25, 1.0 };
+
+	clip_leds();
+
+	TEST_ASSERT_EQUAL_FLOAT(0.0, leds[0].r);
+	TEST_ASSERT_EQUAL_FLOAT(0.5, leds[0].g);
+	TEST_ASSERT_EQUAL_FLOAT(1.0, leds[0].b);
+	TEST_ASSERT_EQUAL_FLOAT(1.0, leds[NUM_LEDS - 1].r);
+	TEST_ASSERT_EQUAL_FLOAT(0.0, leds[NUM_LEDS - 1].g);
+}
+
+void test_multiply_CRGBF_array_by_LUT_matches_scalar() {
+	CRGBF reference[NUM_LEDS];
+	fill_kernel_benchmark_image(leds, NUM_LEDS, 3);  // (kernel_benchmarks.h)
+	memcpy(reference, leds, sizeof(CRGBF) * NUM_LEDS);
+
+	multiply_CRGBF_array_by_LUT(leds, WHITE_BALANCE, NUM_LEDS);
+	multiply_CRGBF_array_by_LUT_scalar(reference, WHITE_BALANCE, NUM_LEDS);  // (kernel_benchmarks.h)
+
+	TEST_ASSERT_EQUAL_FLOAT(0.0, get_max_relative_error((float*)reference, (float*)leds, NUM_LEDS * 3));
+}
+
+void test_apply_image_lpf_matches_scalar() {
+	CRGBF reference_leds[NUM_LEDS];
+	CRGBF reference_last[NUM_LEDS];
+	FPS_GPU = REFERENCE_FPS;
+
+	fill_kernel_benchmark_image(leds, NUM_LEDS, 1);
+	fill_kernel_benchmark_image(leds_last, NUM_LEDS, 2);
+	memcpy(reference_leds, leds, sizeof(CRGBF) * NUM_LEDS);
+	memcpy(reference_last, leds_last, sizeof(CRGBF) * NUM_LEDS);
+	apply_image_lpf(5.0);
+
+	CRGBF filtered[NUM_LEDS];
+	memcpy(filtered, leds, sizeof(CRGBF) * NUM_LEDS);
+	memcpy(leds, reference_leds, sizeof(CRGBF) * NUM_LEDS);
+	memcpy(leds_last, reference_last, sizeof(CRGBF) * NUM_LEDS);
+	apply_image_lpf_scalar(5.0);  // (kernel_benchmarks.h)
+
+	TEST_ASSERT_TRUE(get_max_relative_error((float*)leds, (float*)filtered, NUM_LEDS * 3) < 0.00001);
+	TEST_ASSERT_EQUAL_MEMORY(leds, leds_last, sizeof(CRGBF) * NUM_LEDS);
+}
+
+void test_apply_box_blur_keeps_flat_images_flat() {
+	for (uint16_t i = 0; i < NUM_LEDS; i++) {
+		leds[i] = { 0.25, 0.5, 0.75 };
+	}
+
+	apply_box_blur(leds, NUM_LEDS, 13);
+
+	for (uint16_t i = 0; i < NUM_LEDS; i++) {
+		TEST_ASSERT_FLOAT_WITHIN(0.00001, 0.25, leds[i].r);
+		TEST_ASSERT_FLOAT_WITHIN(0.00001, 0.75, leds[i].b);
+	}
+}
+
+void test_quantize_color_is_grb() {
+	leds[0] = { 1.0, 0.5, 0.0 };
+
+	quantize_color(false);
+
+	TEST_ASSERT_EQUAL_UINT8(127, raw_led_data[0]);  // G
+	TEST_ASSERT_EQUAL_UINT8(255, raw_led_data[1]);  // R
+	TEST_ASSERT_EQUAL_UINT8(0,   raw_led_data[2]);  // B
+}
+
+void test_quantize_color_dithering_averages_out() {
+	leds[0] = { 0.4, 0.0, 1.0 };
+
+	uint32_t r_sum = 0;
+	uint32_t b_sum = 0;
+	for (uint8_t frame = 0; frame < 4; frame++) {
+		quantize_color(true);
+		r_sum += raw_led_data[1];
+		b_sum += raw_led_data[2];
+	}
+
+	TEST_ASSERT_FLOAT_WITHIN(0.25, 0.4 * 254, r_sum / 4.0);
+	TEST_ASSERT_EQUAL_UINT32(254 * 4, b_sum);
+}
+
+void test_fused_post_processing_matches_passes() {
+	uint8_t reference[NUM_LEDS * 3];
+	CRGBF reference_last[NUM_LEDS];
+	FPS_GPU = REFERENCE_FPS;
+
+	for (uint8_t dithering = 0; dithering < 2; dithering++) {
+		for (uint8_t frame = 0; frame < 4; frame++) {
+			fill_kernel_benchmark_image(leds, NUM_LEDS, frame);
+			scale_CRGBF_array_by_constant(leds, 1.5, NUM_LEDS);  // Something for clip_leds() to do
+			fill_kernel_benchmark_image(leds_last, NUM_LEDS, 7);
+			dither_step = frame;
+			post_process_leds_unfused(0.5, 5.0, dithering);  // (kernel_benchmarks.h)
+			memcpy(reference, raw_led_data, NUM_LEDS * 3);
+			memcpy(reference_last, leds_last, sizeof(CRGBF) * NUM_LEDS);
+
+			fill_kernel_benchmark_image(leds, NUM_LEDS, frame);
+			scale_CRGBF_array_by_constant(leds, 1.5, NUM_LEDS);
+			fill_kernel_benchmark_image(leds_last, NUM_LEDS, 7);
+			dither_step = frame;
+			apply_color_grade(0.5);
+			post_process_leds(5.0, dithering);
+
+			// The blue light filter is one gain now, rounding can differ by a step
+			TEST_ASSERT_TRUE(get_max_byte_error(reference, raw_led_data, NUM_LEDS * 3) <= 1);
+			TEST_ASSERT_TRUE(get_max_relative_error((float*)reference_last, (float*)leds_last, NUM_LEDS * 3) < 0.0001);
+		}
+	}
+}
+
+// Not one of the LED channels, so nothing here counts as a frame sent
+rmt_channel_handle_t get_test_channel() {
+	static rmt_channel_handle_t channel = NULL;
+	if (channel == NULL) {
+		rmt_tx_channel_config_t config = {};
+		config.mem_block_symbols = 64;
+		rmt_new_tx_channel(&config, &channel);
+	}
+	return channel;
+}
+
+void test_led_encoder_sends_ws2812_bits() {
+	const uint8_t bytes[2] = { 0xA5, 0x0F };
+	rmt_channel_handle_t channel = get_test_channel();
+
+	rmt_transmit(channel, led_encoder_a, bytes, 2, &tx_config);
+
+	TEST_ASSERT_EQUAL_UINT32(17, channel->symbols.size());
+	for (uint8_t i = 0; i < 16; i++) {
+		bool bit = bytes[i >> 3] & (0x80 >> (i & 7));
+		rmt_symbol_word_t symbol = channel->symbols[i];
+
+		TEST_ASSERT_EQUAL_UINT16(bit ? 7 : 4, symbol.duration0);  // 0.7us or 0.4us high, then 0.6us low
+		TEST_ASSERT_EQUAL_UINT16(1, symbol.level0);
+		TEST_ASSERT_EQUAL_UINT16(6, symbol.duration1);
+		TEST_ASSERT_EQUAL_UINT16(0, symbol.level1);
+	}
+
+	rmt_symbol_word_t reset_code = channel->symbols[16];
+	TEST_ASSERT_EQUAL_UINT16(250, reset_code.duration0);
+	TEST_ASSERT_EQUAL_UINT16(0, reset_code.level0);
+	TEST_ASSERT_EQUAL_UINT16(250, reset_code.duration1);
+}
+
+void test_led_encoder_matches_bitwise_over_many_blocks() {
+	const size_t num_bytes = (NUM_LEDS >> 1) * 3;
+	uint8_t bytes[num_bytes];
+	static rmt_symbol_word_t reference[num_bytes * 8];
+	for (size_t i = 0; i < num_bytes; i++) {
+		bytes[i] = uint8_t(i * 37 + 11);
+	}
+	expand_led_bytes_bitwise(bytes, num_bytes, reference, led_nibble_symbols[0][0], led_nibble_symbols[15][0]);  // (kernel_benchmarks.h)
+	rmt_channel_handle_t channel = get_test_channel();
+
+	// Twice, to see the encoder start over after a whole frame
+	for (uint8_t frame = 0; frame < 2; frame++) {
+		rmt_transmit(channel, led_encoder_b, bytes, num_bytes, &tx_config);
+
+		TEST_ASSERT_EQUAL_UINT32(LED_SYMBOLS_PER_CHANNEL, channel->symbols.size());
+		for (size_t i = 0; i < num_bytes * 8; i++) {
+			TEST_ASSERT_EQUAL_HEX32(reference[i].val, channel->symbols[i].val);
+		}
+	}
+}
+
+void test_transmit_leds_rotates_output_buffers() {
+	fill_kernel_benchmark_image(leds, NUM_LEDS, 3);
+	uint32_t frames_queued = led_frames_queued;
+	uint32_t transmissions = tx_chan_a->transmissions;
+	uint32_t waits = stage_histograms[STAGE_WAIT_FOR_LEDS].count;
+
+	uint8_t* buffers[LED_OUTPUT_BUFFERS + 1];
+	for (uint8_t frame = 0; frame < LED_OUTPUT_BUFFERS + 1; frame++) {
+		transmit_leds(5.0);
+		buffers[frame] = raw_led_data;
+	}
+
+	for (uint8_t frame = 1; frame < LED_OUTPUT_BUFFERS; frame++) {
+		TEST_ASSERT_TRUE(buffers[frame] != buffers[frame - 1]);
+	}
+	TEST_ASSERT_TRUE(buffers[LED_OUTPUT_BUFFERS] == buffers[0]);
+
+	TEST_ASSERT_EQUAL_UINT32(frames_queued + LED_OUTPUT_BUFFERS + 1, led_frames_queued);
+	TEST_ASSERT_EQUAL_UINT32(transmissions + LED_OUTPUT_BUFFERS + 1, tx_chan_a->transmissions);
+	TEST_ASSERT_EQUAL_UINT32(led_frames_queued, led_frames_done[0]);
+	TEST_ASSERT_EQUAL_UINT32(led_frames_queued, led_frames_done[1]);
+	TEST_ASSERT_EQUAL_UINT32(waits + LED_OUTPUT_BUFFERS + 1, stage_histograms[STAGE_WAIT_FOR_LEDS].count);
+
+	// Transmissions here finish right away, every buffer is free again
+	TEST_ASSERT_EQUAL_UINT32(LED_OUTPUT_BUFFERS, uxSemaphoreGetCount(led_buffers_free[0]));
+	TEST_ASSERT_EQUAL_UINT32(LED_OUTPUT_BUFFERS, uxSemaphoreGetCount(led_buffers_free[1]));
+}
+
+void test_latency_history_restarts_after_a_reset() {
+	for (uint32_t i = 0; i < 3; i++) {
+		record_audio_latency(0, 100, 9000);
+	}
+	reset_stage_histograms();
+	record_audio_latency(1000, 1200, 1500);
+
+	uint32_t p50, p99, max_value;
+	get_latency_percentiles(audio_to_photon_us, &p50, &p99, &max_value);
+	TEST_ASSERT_EQUAL_UINT32(500, max_value);
+	TEST_ASSERT_EQUAL_UINT32(500, p50);
+
+	reset_stage_histograms();
+}
+
+void test_transmit_leds_without_filesystem_frees_the_buffer() {
+	uint32_t frames_queued = led_frames_queued;
+
+	filesystem_ready = false;
+	transmit_leds(5.0);
+	filesystem_ready = true;
+
+	TEST_ASSERT_EQUAL_UINT32(frames_queued, led_frames_queued);
+	TEST_ASSERT_EQUAL_UINT32(LED_OUTPUT_BUFFERS, uxSemaphoreGetCount(led_buffers_free[0]));
+	TEST_ASSERT_EQUAL_UINT32(LED_OUTPUT_BUFFERS, uxSemaphoreGetCount(led_buffers_free[1]));
+}
+
+int main() {
+	init_native_firmware();  // (native_firmware.h)
+
+	UNITY_BEGIN();
+	RUN_TEST(test_hsv_follows_the_lookup_table);
+	RUN_TEST(test_hsv_wraps_hue_and_clips_value);
+	RUN_TEST(test_hsv_without_saturation_is_gray);
+	RUN_TEST(test_palette_matches_hsv);
+	RUN_TEST(test_palette_follows_the_settings);
+	RUN_TEST(test_clip_leds);
+	RUN_TEST(test_multiply_CRGBF_array_by_LUT_matches_scalar);
+	RUN_TEST(test_apply_image_lpf_matches_scalar);
+	RUN_TEST(test_apply_box_blur_keeps_flat_images_flat);
+	RUN_TEST(test_quantize_color_is_grb);
+	RUN_TEST(test_quantize_color_dithering_averages_out);
+	RUN_TEST(test_fused_post_processing_matches_passes);
+	RUN_TEST(test_led_encoder_sends_ws2812_bits);
+	RUN_TEST(test_led_encoder_matches_bitwise_over_many_blocks);
+	RUN_TEST(test_transmit_leds_rotates_output_buffers);
+	RUN_TEST(test_latency_history_restarts_after_a_reset);
+	RUN_TEST(test_transmit_leds_without_filesystem_frees_the_buffer);
+	return UNITY_END();
+}
@@ -0,0 +1,73 @@
+// ----------------------------------------------------------------------------------
+// Performance regressions, timed with time_kernel() (kernel_benchmarks.h). The host
+// isn't an ESP32-S3, so only speedups that should hold on any CPU are checked here,
+// run_kernel_benchmarks() on the device is still the real measurement.
+//
+//   pio test -e native -f test_performance
+
+#include <unity.h>
+
+#include "../../src/native/native_firmware.h"
+
+void setUp() {}
+
+void tearDown() {
+	musical_analyzer.clear_sample_history();
+}
+
+void test_goertzel_lanes_beat_single_bins() {
+	for (uint16_t i = 0; i < CHUNK_SIZE * 64; i += CHUNK_SIZE) {
+		float new_samples[CHUNK_SIZE];
+		for (uint16_t n = 0; n < CHUNK_SIZE; n++) {
+			new_samples[n] = sin((i + n) * 0.05) * 0.25 + sin((i + n) * 0.71) * 0.25;
+		}
+		musical_analyzer.write_to_sample_history(new_samples);
+	}
+
+	float magnitudes[NUM_FREQS];
+	kernel_benchmark_stats scalar = time_kernel("calculate_magnitude_of_bin x64", "scalar", [](){}, [&]() {
+		for (uint16_t bin = 0; bin < NUM_FREQS; bin++) {
+			magnitudes[bin] = musical_analyzer.calculate_magnitude_of_bin(bin);
+		}
+	});
+	kernel_benchmark_stats lanes = time_kernel("calculate_magnitudes_of_bin_group x16", "lanes", [](){}, [&]() {
+		for (uint16_t bin = 0; bin < NUM_FREQS; bin += GOERTZEL_LANES) {
+			musical_analyzer.calculate_magnitudes_of_bin_group(bin, &magnitudes[bin]);
+		}
+	});
+
+	TEST_ASSERT_LESS_THAN_UINT32(scalar.median_cycles, lanes.median_cycles);
+}
+
+void test_tempo_autocorrelation_beats_goertzel() {
+	for (uint16_t i = 0; i < NOVELTY_HISTORY_LENGTH; i++) {
+		log_novelty(fabs(sin(i * 0.25)));
+		log_vu(fabs(sin(i * 0.25)));
+	}
+	normalize_novelty_curve();
+	TEST_ASSERT_TRUE(init_tempo_autocorrelation());
+
+	kernel_benchmark_stats goertzel = time_kernel("calculate_magnitude_of_tempo x64", "scalar", [](){}, []() {
+		float magnitude_sum = 0.0;
+		for (uint16_t bin = 0; bin < NUM_TEMPI; bin++) {
+			magnitude_sum += calculate_magnitude_of_tempo(bin);
+		}
+		kernel_benchmark_sink = magnitude_sum;
+	}, 32);
+	kernel_benchmark_stats autocorrelation = time_kernel("calculate_tempi_autocorrelation", "esp-dsp", [](){}, []() {
+		calculate_tempi_autocorrelation();
+	}, 32);
+
+	TEST_ASSERT_LESS_THAN_UINT32(goertzel.median_cycles, autocorrelation.median_cycles);
+	free_tempo_autocorrelation();
+	clear_tempo_history();
+}
+
+int main() {
+	init_native_firmware();  // (native_firmware.h)
+
+	UNITY_BEGIN();
+	RUN_TEST(test_goertzel_lanes_beat_single_bins);
+	RUN_TEST(test_tempo_autocorrelation_beats_goertzel);
+	return UNITY_END();
+}
@@ -0,0 +1,137 @@
+// ----------------------------------------------------------------------------------
+// Configuration in NVS, the noise spectrum in LittleFS, and what goes out to the
+// app over the websocket (configuration.h, utilities.h), WAV files (audio_source.h)
+//
+//   pio test -e native -f test_storage
+
+#include <unity.h>
+
+#include "../../src/native/native_firmware.h"
+
+void setUp() {}
+void tearDown() {}
+
+void test_config_survives_a_reboot() {
+	configuration.brightness = 0.33;
+	configuration.current_mode = 4;
+	configuration.mirror_mode = false;
+	configuration.touch_center_threshold = 123456;
+	TEST_ASSERT_TRUE(save_config());
+
+	config saved = configuration;
+	memset(&configuration, 0, sizeof(config));
+	load_config();
+
+	TEST_ASSERT_EQUAL_MEMORY(&saved, &configuration, sizeof(config));
+}
+
+void test_missing_keys_load_defaults() {
+	preferences.clear();
+	load_config();
+
+	TEST_ASSERT_EQUAL_FLOAT(1.00, configuration.brightness);
+	TEST_ASSERT_EQUAL_INT32(0, configuration.current_mode);
+	TEST_ASSERT_TRUE(configuration.mirror_mode);
+	TEST_ASSERT_EQUAL_UINT32(95000 * 2, configuration.touch_center_threshold);
+}
+
+void test_saves_wait_for_values_to_settle() {
+	preferences.clear();
+	configuration.brightness = 0.5;
+
+	t_now_ms = 1000;
+	save_config_delayed();
+
+	t_now_ms += MIN_SAVE_WAIT_MS - 1;
+	sync_configuration_to_file_system();
+	TEST_ASSERT_FALSE(preferences.isKey("brightness"));
+
+	t_now_ms += 1;
+	sync_configuration_to_file_system();
+	TEST_ASSERT_EQUAL_FLOAT(0.5, preferences.getFloat("brightness", 0.0));
+	TEST_ASSERT_FALSE(save_request_open);
+}
+
+void test_noise_spectrum_survives_a_reboot() {
+	for (uint16_t i = 0; i < NUM_FREQS; i++) {
+		noise_spectrum[i] = i * 0.01;
+	}
+	TEST_ASSERT_TRUE(save_noise_spectrum());
+
+	float saved[NUM_FREQS];
+	memcpy(saved, noise_spectrum, sizeof(noise_spectrum));
+	memset(noise_spectrum, 0, sizeof(noise_spectrum));
+
+	TEST_ASSERT_TRUE(load_noise_spectrum());
+	TEST_ASSERT_EQUAL_FLOAT_ARRAY(saved, noise_spectrum, NUM_FREQS);
+}
+
+void test_truncated_noise_spectrum_is_rejected() {
+	File file = LittleFS.open(NOISE_SPECTRUM_FILENAME, FILE_WRITE);
+	file.write(0x42);
+	file.close();
+
+	TEST_ASSERT_FALSE(load_noise_spectrum());
+	LittleFS.remove(NOISE_SPECTRUM_FILENAME);
+}
+
+void test_wav_with_a_short_fmt_chunk_is_rejected() {
+	const char* path = NATIVE_LITTLEFS_ROOT "/short_fmt.wav";
+	FILE* file = fopen(path, "wb");
+	uint32_t riff_size = 4 + 8 + 8;
+	uint32_t fmt_size = 8;  // Needs at least 16
+	uint16_t fmt[4] = {1, 1, 0, 0};
+	fwrite("RIFF", 1, 4, file);
+	fwrite(&riff_size, 4, 1, file);
+	fwrite("WAVE", 1, 4, file);
+	fwrite("fmt ", 1, 4, file);
+	fwrite(&fmt_size, 4, 1, file);
+	fwrite(fmt, 2, 4, file);
+	fclose(file);
+
+	audio_source* source_before = active_audio_source;
+	TEST_ASSERT_FALSE(open_wav_audio_source(path, false));
+	TEST_ASSERT_NULL(wav_file);
+	TEST_ASSERT_EQUAL_PTR(source_before, active_audio_source);
+	remove(path);
+}
+
+void test_broadcast_reaches_the_websocket() {
+	uint32_t messages_before = websocket_handler.messages_sent;
+	char message[] = "noise_cal_ready";
+
+	broadcast(message);  // (utilities.h)
+
+	TEST_ASSERT_EQUAL_STRING("noise_cal_ready", websocket_handler.last_message);
+	TEST_ASSERT_EQUAL_UINT32(messages_before + 1, websocket_handler.messages_sent);
+}
+
+void test_wifi_config_reboot_is_remembered() {
+	char text[] = "wifi_config_reboot";
+	uint32_t restarts_before = ESP.restart_count;
+	wifi_config_mode = false;
+
+	queue_command(text, strlen(text), 0);  // (commands.h)
+	process_command_queue();
+	TEST_ASSERT_EQUAL_UINT32(restarts_before + 1, ESP.restart_count);
+
+	// What the next boot sees
+	init_configuration();
+	TEST_ASSERT_TRUE(wifi_config_mode);
+	TEST_ASSERT_FALSE(preferences.getBool("CONFIG_TRIG", true));
+}
+
+int main() {
+	init_native_firmware();  // (native_firmware.h)
+
+	UNITY_BEGIN();
+	RUN_TEST(test_config_survives_a_reboot);
+	RUN_TEST(test_missing_keys_load_defaults);
+	RUN_TEST(test_saves_wait_for_values_to_settle);
+	RUN_TEST(test_noise_spectrum_survives_a_reboot);
+	RUN_TEST(test_truncated_noise_spectrum_is_rejected);
+	RUN_TEST(test_wav_with_a_short_fmt_chunk_is_rejected);
+	RUN_TEST(test_broadcast_reaches_the_websocket);
+	RUN_TEST(test_wifi_config_reboot_is_remembered);
+	return UNITY_END();
+}